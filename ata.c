@@ -0,0 +1,314 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	ATA commands sent to the disk, through SG_IO or a mock drive.
+
+	Commands are wrapped in an ATA PASS-THROUGH(16) CDB and sent with the
+	SG_IO ioctl, which libata and most USB bridges translate for SATA
+	drives. The check condition bit is always set, so the drive's output
+	registers come back in the ATA status return descriptor of the sense
+	data. SG_IO with pass-through commands needs CAP_SYS_RAWIO, so this
+	only works while running as root.
+
+	The mock backend answers the same commands from a drive emulated in
+	memory. It spins down on STANDBY IMMEDIATE, or on its own after a
+	while without I/O like a drive with a hdparm -S timer, and back up as
+	soon as /proc/diskstats shows I/O. Its heads unload after 8 seconds
+	without I/O, counted in the SMART attributes it reports. The mock only
+	looks at the disk when it is sent a command, so it misses unloads
+	unless it is polled often, e.g. with --power-poll=1. Policies can be
+	tried out on disks, or in virtual machines, that do not take ATA
+	commands.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <scsi/sg.h>
+#include "wdantiparkd.h"
+#include "ata.h"
+
+#define ATA_PASS_THROUGH_16 0x85
+#define ATA_PROTOCOL_NON_DATA 3
+#define ATA_PROTOCOL_PIO_IN 4
+
+#define ATA_STATUS_ERR 0x01
+#define ATA_STATUS_DRDY 0x40
+
+// milliseconds, a spin-up can take a while
+#define ATA_COMMAND_TIMEOUT 30000
+
+#define SMART_READ_DATA 0xd0
+#define SMART_ATTRIBUTES 30
+
+// seconds without I/O before the heads of the mock drive unload
+#define MOCK_UNLOAD_TIME 8
+
+/*
+ Issues the command with SG_IO. dataLen bytes are read into data, in
+ 512 byte blocks, or none when dataLen is 0.
+ Returns 0, or -errno.
+ */
+static int sgioCommand(struct ataDevice *dev,struct ataTaskfile *tf,void *data,int dataLen)
+{
+	unsigned char cdb[16], sense[32];
+	const unsigned char *desc;
+	struct sg_io_hdr io;
+
+	memset(cdb,0,16);
+	cdb[0] = ATA_PASS_THROUGH_16;
+	cdb[1] = (dataLen ? ATA_PROTOCOL_PIO_IN : ATA_PROTOCOL_NON_DATA) << 1;
+	cdb[2] = 0x20; // check condition, return the registers
+	if(dataLen) cdb[2] |= 0x08 | 0x04 | 0x02; // from the device, in blocks, length in the sector count
+	cdb[4] = tf->features;
+	cdb[6] = tf->sectorCount;
+	cdb[8] = tf->lbaLow;
+	cdb[10] = tf->lbaMid;
+	cdb[12] = tf->lbaHigh;
+	cdb[13] = tf->device;
+	cdb[14] = tf->command;
+
+	memset(&io,0,sizeof(struct sg_io_hdr));
+	memset(sense,0,32);
+	io.interface_id = 'S';
+	io.cmdp = cdb;
+	io.cmd_len = 16;
+	io.sbp = sense;
+	io.mx_sb_len = 32;
+	io.dxfer_direction = dataLen ? SG_DXFER_FROM_DEV : SG_DXFER_NONE;
+	io.dxferp = data;
+	io.dxfer_len = dataLen;
+	io.timeout = ATA_COMMAND_TIMEOUT;
+
+	if(ioctl(dev->fd,SG_IO,&io) < 0) return -errno;
+
+	// descriptor format sense with the ATA status return descriptor
+	desc = sense + 8;
+	if(io.sb_len_wr < 22 || (sense[0] & 0x7f) != 0x72 || desc[0] != 0x09) {
+		if(io.status || io.host_status || io.driver_status) return -EIO;
+		tf->status = 0;
+		tf->error = 0;
+		return 0;
+	}
+	tf->error = desc[3];
+	tf->sectorCount = desc[5];
+	tf->lbaLow = desc[7];
+	tf->lbaMid = desc[9];
+	tf->lbaHigh = desc[11];
+	tf->device = desc[12];
+	tf->status = desc[13];
+	return tf->status & ATA_STATUS_ERR ? -EIO : 0;
+}
+
+/*
+ Emulates the command on the mock drive. Any I/O since the last command
+ has spun it up, a long enough time without spins it down.
+ */
+static int mockCommand(struct ataDevice *dev,struct ataTaskfile *tf,void *data,int dataLen)
+{
+	unsigned long readSectorCount, writeSectorCount;
+	long long now = monotonicTimeMs();
+
+	if(readDiskSectors(dev->disk,&readSectorCount,&writeSectorCount) < 0) return -EIO;
+	if(!dev->mockLastIo || readSectorCount != dev->mockReadSectors || writeSectorCount != dev->mockWriteSectors) {
+		dev->mockStandby = 0;
+		dev->mockHeadsLoaded = 1;
+		dev->mockLastIo = now;
+	} else {
+		if(dev->mockHeadsLoaded && now - dev->mockLastIo >= MOCK_UNLOAD_TIME * 1000LL) {
+			dev->mockHeadsLoaded = 0;
+			dev->mockLoadCycles++;
+		}
+		if(!dev->mockStandby && dev->mockTimer && now - dev->mockLastIo >= dev->mockTimer * 1000LL) {
+			dev->mockStandby = 1;
+			dev->mockStartStops++;
+		}
+	}
+	dev->mockReadSectors = readSectorCount;
+	dev->mockWriteSectors = writeSectorCount;
+
+	if(dataLen) memset(data,0,dataLen);
+	tf->status = 0x50; // ready, seek complete
+	tf->error = 0;
+
+	switch(tf->command) {
+		case ATA_STANDBY_IMMEDIATE:
+			if(dev->mockHeadsLoaded) dev->mockLoadCycles++;
+			if(!dev->mockStandby) dev->mockStartStops++;
+			dev->mockHeadsLoaded = 0;
+			dev->mockStandby = 1;
+			return 0;
+		case ATA_CHECK_POWER_MODE:
+			tf->sectorCount = dev->mockStandby ? 0x00 : 0xff;
+			return 0;
+		case ATA_SMART:
+			if(tf->features == SMART_READ_DATA && dataLen >= 512) {
+				unsigned char *table = data, sum = 0;
+				int i;
+				table[0] = 0x10; // revision
+				table[2] = SMART_START_STOP_COUNT;
+				table[5] = table[6] = 100;
+				for(i = 0; i < 4; i++) table[7 + i] = dev->mockStartStops >> (i * 8);
+				table[14] = SMART_LOAD_CYCLE_COUNT;
+				table[17] = table[18] = 200;
+				for(i = 0; i < 4; i++) table[19 + i] = dev->mockLoadCycles >> (i * 8);
+				for(i = 0; i < 511; i++) sum += table[i];
+				table[511] = -sum;
+				return 0;
+			}
+			break;
+	}
+
+	tf->status |= ATA_STATUS_ERR;
+	tf->error = 0x04; // aborted
+	return -EIO;
+}
+
+/*
+ Opens the disk for ATA commands. Each SG_IO command needs CAP_SYS_RAWIO,
+ not only the open, so privileges cannot be dropped while it is in use.
+ Returns 0, or -errno.
+ */
+int ataOpen(struct ataDevice *dev,const char *disk,int backend,int mockTimer)
+{
+	char path[64];
+
+	memset(dev,0,sizeof(struct ataDevice));
+	strncpy(dev->disk,disk,16);
+	dev->disk[15] = 0;
+	dev->backend = backend;
+	dev->fd = -1;
+	dev->mockTimer = mockTimer;
+
+	if(backend == AtaMock) return 0;
+
+	snprintf(path,64,"/dev/%s",disk);
+	path[63] = 0;
+	dev->fd = open(path,O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(dev->fd < 0) {
+		fprintf(stderr,"Failed to open '%s' for ATA commands (root required).\n",path);
+		return -errno;
+	}
+	return 0;
+}
+
+int ataCommand(struct ataDevice *dev,struct ataTaskfile *tf,void *data,int dataLen)
+{
+	dev->commands++;
+	if(dev->backend == AtaMock) return mockCommand(dev,tf,data,dataLen);
+	return sgioCommand(dev,tf,data,dataLen);
+}
+
+/*
+ Spins the disk down now. The drive spins up again on its own with the
+ next access.
+ */
+int ataStandbyImmediate(struct ataDevice *dev)
+{
+	struct ataTaskfile tf;
+
+	memset(&tf,0,sizeof(struct ataTaskfile));
+	tf.command = ATA_STANDBY_IMMEDIATE;
+	return ataCommand(dev,&tf,NULL,0);
+}
+
+/*
+ Asks the drive for its power mode. Unlike any other access, this does not
+ spin up a drive in standby.
+ Returns an AtaPowerMode, or -errno.
+ */
+int ataCheckPowerMode(struct ataDevice *dev)
+{
+	struct ataTaskfile tf;
+	int result;
+
+	memset(&tf,0,sizeof(struct ataTaskfile));
+	tf.command = ATA_CHECK_POWER_MODE;
+	result = ataCommand(dev,&tf,NULL,0);
+	if(result < 0) return result;
+	if(!(tf.status & ATA_STATUS_DRDY)) return -ENODATA; // the registers did not come back
+
+	// 0x00 standby, 0x01 standby_y, 0x80-0x83 idle, 0xff active or idle
+	if(tf.sectorCount == 0x00 || tf.sectorCount == 0x01) return PowerStandby;
+	if(tf.sectorCount >= 0x80 && tf.sectorCount <= 0x83) return PowerIdle;
+	return PowerActive;
+}
+
+const char *ataPowerModeName(int mode)
+{
+	static const char *names[] = { "standby", "idle", "active" };
+	return mode >= PowerStandby && mode <= PowerActive ? names[mode] : "unknown";
+}
+
+/*
+ Reads the 512 byte table of SMART attributes.
+ Returns 0, or -errno.
+ */
+int ataSmartReadData(struct ataDevice *dev,unsigned char *data)
+{
+	struct ataTaskfile tf;
+	unsigned char sum = 0;
+	int i, result;
+
+	memset(&tf,0,sizeof(struct ataTaskfile));
+	tf.command = ATA_SMART;
+	tf.features = SMART_READ_DATA;
+	tf.sectorCount = 1;
+	tf.lbaMid = 0x4f;
+	tf.lbaHigh = 0xc2;
+	result = ataCommand(dev,&tf,data,512);
+	if(result < 0) return result;
+
+	for(i = 0; i < 512; i++) sum += data[i];
+	return sum ? -EBADMSG : 0;
+}
+
+/*
+ Finds the raw value of the attribute in the SMART table.
+ Returns 0, or -ENOENT if the drive does not have the attribute.
+ */
+int ataSmartAttribute(const unsigned char *data,int id,unsigned long long *raw)
+{
+	int i, j;
+
+	for(i = 0; i < SMART_ATTRIBUTES; i++) {
+		const unsigned char *entry = data + 2 + i * 12;
+		if(entry[0] != id) continue;
+
+		// 48 bit little endian
+		*raw = 0;
+		for(j = 5; j >= 0; j--) *raw = *raw << 8 | entry[5 + j];
+		return 0;
+	}
+	return -ENOENT;
+}
+
+const char *ataBackendName(int backend)
+{
+	return backend == AtaMock ? "mock" : "SG_IO";
+}
+
+void ataClose(struct ataDevice *dev)
+{
+	if(dev->fd >= 0) close(dev->fd);
+	dev->fd = -1;
+}
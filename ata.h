@@ -0,0 +1,89 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	ATA commands sent to the disk, through SG_IO or a mock drive.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ATA_H
+#define ATA_H
+
+#define ATA_STANDBY_IMMEDIATE 0xe0
+#define ATA_CHECK_POWER_MODE 0xe5
+#define ATA_SMART 0xb0
+
+#define SMART_START_STOP_COUNT 4
+#define SMART_LOAD_CYCLE_COUNT 193
+
+enum AtaBackend
+{
+	AtaSgIo, // ATA PASS-THROUGH(16) on the block device
+	AtaMock // a drive emulated in memory, for trying policies out
+};
+
+// as reported by CHECK POWER MODE
+enum AtaPowerMode
+{
+	PowerStandby, // spun down
+	PowerIdle, // spinning, in one of the drive's idle modes
+	PowerActive
+};
+
+// registers of a command, the outputs are filled in on return
+struct ataTaskfile
+{
+	unsigned char command;
+	unsigned char features;
+	unsigned char sectorCount;
+	unsigned char lbaLow;
+	unsigned char lbaMid;
+	unsigned char lbaHigh;
+	unsigned char device;
+	unsigned char status; // output
+	unsigned char error; // output
+};
+
+struct ataDevice
+{
+	char disk[16];
+	int backend;
+	int fd;
+	unsigned long commands;
+
+	// mock drive
+	int mockStandby;
+	int mockTimer; // seconds without I/O before it spins down on its own, 0 for never
+	int mockHeadsLoaded;
+	unsigned long mockLoadCycles;
+	unsigned long mockStartStops;
+	long long mockLastIo;
+	unsigned long mockReadSectors;
+	unsigned long mockWriteSectors;
+};
+
+int ataOpen(struct ataDevice *dev,const char *disk,int backend,int mockTimer);
+int ataCommand(struct ataDevice *dev,struct ataTaskfile *tf,void *data,int dataLen);
+int ataStandbyImmediate(struct ataDevice *dev);
+int ataCheckPowerMode(struct ataDevice *dev);
+const char *ataPowerModeName(int mode);
+int ataSmartReadData(struct ataDevice *dev,unsigned char *data);
+int ataSmartAttribute(const unsigned char *data,int id,unsigned long long *raw);
+const char *ataBackendName(int backend);
+void ataClose(struct ataDevice *dev);
+
+#endif
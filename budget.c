@@ -0,0 +1,174 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Keeps the load cycles of the disk within a daily budget.
+
+	A drive is rated for a number of load cycles over its service life,
+	e.g. 300,000 over 5 years, or about 164 a day. The cycles and touches
+	are counted per drive serial in the state directory, so the count
+	survives restarts. Every hour the cycle rate, smoothed over about a
+	day, is compared with the target, corrected by any surplus or deficit
+	against the allowance to date spread over 30 days. The state timeouts
+	are scaled up when cycles run over the budget, and back down to save
+	touches when they run under.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include "wdantiparkd.h"
+#include "diskinfo.h"
+#include "budget.h"
+
+#define HOUR_MS 3600000LL
+
+// seconds between saves of the counters
+#define BUDGET_SAVE_INTERVAL 600
+
+// range of the timeout scale
+#define MIN_SCALE 0.25
+#define MAX_SCALE 8.0
+
+// days over which a surplus or deficit is evened out
+#define DEBT_DAYS 30.0
+
+/*
+ Opens the counters of the disk, creating them on first use. Must be called
+ before dropping privileges, the file stays open.
+ Returns 0, or -errno.
+ */
+int budgetOpen(struct cycleBudget *budget,const char *stateDir,const char *disk,double target,long rating)
+{
+	char serial[128], path[256], buffer[256];
+	int len;
+
+	memset(budget,0,sizeof(struct cycleBudget));
+	budget->target = target;
+	budget->rating = rating;
+	budget->since = time(NULL);
+	budget->rate = target;
+	budget->scale = 1.0;
+	budget->hourStart = monotonicTimeMs();
+	budget->lastSave = monotonicTimeMs();
+
+	if(readDiskSerial(disk,serial,128) < 0) {
+		fprintf(stderr,"Could not determine the serial of '%s', load cycles are not kept.\n",disk);
+		budget->fd = -1;
+		return -ENOENT;
+	}
+
+	snprintf(path,256,"%s/cycles-%s",stateDir,serial);
+	path[255] = 0;
+	budget->fd = open(path,O_RDWR | O_CREAT | O_CLOEXEC,0644);
+	if(budget->fd < 0) {
+		fprintf(stderr,"Failed to open '%s', load cycles are not kept.\n",path);
+		return -errno;
+	}
+
+	len = pread(budget->fd,buffer,255,0);
+	if(len > 0) {
+		long since;
+		buffer[len] = 0;
+		if(sscanf(buffer,"%ld %lu %lu %lf %lf",&since,&budget->cycles,&budget->touches,&budget->rate,&budget->scale) == 5) {
+			budget->since = since;
+			if(budget->scale < MIN_SCALE || budget->scale > MAX_SCALE) budget->scale = 1.0;
+		}
+	}
+	return 0;
+}
+
+static void adjustScale(struct cycleBudget *budget)
+{
+	double days = (time(NULL) - budget->since) / 86400.0;
+	double target = budget->target + (budget->target * days - budget->cycles) / DEBT_DAYS;
+
+	// an hour's cycles into the rate smoothed over a day
+	budget->rate += (budget->hourCycles * 24.0 - budget->rate) / 24.0;
+	budget->hourCycles = 0;
+
+	if(target < budget->target * 0.1) target = budget->target * 0.1;
+	budget->scale *= sqrt(budget->rate / target);
+	if(budget->scale < MIN_SCALE) budget->scale = MIN_SCALE;
+	if(budget->scale > MAX_SCALE) budget->scale = MAX_SCALE;
+}
+
+/*
+ Feeds the controller with the daemon's cycle and touch counts. The counts
+ are saved only while the heads are loaded, a write would wake a parked
+ disk.
+ */
+void budgetUpdate(struct cycleBudget *budget,unsigned long llc,unsigned long touches,int headsLoaded)
+{
+	long long now = monotonicTimeMs();
+
+	budget->cycles += llc - budget->lastLlc;
+	budget->hourCycles += llc - budget->lastLlc;
+	budget->touches += touches - budget->lastTouches;
+	budget->lastLlc = llc;
+	budget->lastTouches = touches;
+
+	if(now - budget->hourStart >= HOUR_MS) {
+		adjustScale(budget);
+		budget->hourStart = now;
+	}
+	if(headsLoaded && now - budget->lastSave >= BUDGET_SAVE_INTERVAL * 1000LL) budgetSave(budget);
+}
+
+int budgetTimeout(const struct cycleBudget *budget,int timeout)
+{
+	return (int)(timeout * budget->scale + 0.5);
+}
+
+int budgetSave(struct cycleBudget *budget)
+{
+	char buffer[256];
+	int len;
+
+	budget->lastSave = monotonicTimeMs();
+	if(budget->fd < 0) return -EBADF;
+
+	len = snprintf(buffer,256,"%ld %lu %lu %.3f %.4f\n",(long)budget->since,budget->cycles,budget->touches,budget->rate,budget->scale);
+	if(pwrite(budget->fd,buffer,len,0) != len || ftruncate(budget->fd,len) < 0) return -errno;
+	return 0;
+}
+
+void budgetReport(const struct cycleBudget *budget)
+{
+	double days = (time(NULL) - budget->since) / 86400.0;
+	double surplus = budget->target * days - budget->cycles;
+	long remaining = budget->rating - (long)budget->cycles;
+	double rate = budget->rate > 0.01 ? budget->rate : 0.01;
+
+	printf("[%s] Cycle budget - target: %.0f/day, rate: %.1f/day, counted: %lu in %.1f days, %s: %.0f, timeout scale: %.2f\n",
+		   formatCurrentTime(NULL,0),budget->target,budget->rate,budget->cycles,days,surplus >= 0 ? "under budget" : "over budget",
+		   fabs(surplus),budget->scale);
+	printf("[%s] Cycle budget - remaining of %ld rated: %ld, projected lifetime: %.1f years\n",formatCurrentTime(NULL,0),
+		   budget->rating,remaining,(days + (remaining > 0 ? remaining : 0) / rate) / 365.0);
+	fflush(stdout);
+}
+
+void budgetClose(struct cycleBudget *budget)
+{
+	budgetSave(budget);
+	if(budget->fd >= 0) close(budget->fd);
+}
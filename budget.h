@@ -0,0 +1,55 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Keeps the load cycles of the disk within a daily budget.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BUDGET_H
+#define BUDGET_H
+
+#include <time.h>
+
+struct cycleBudget
+{
+	int fd; // counter file, kept open across the privilege drop
+	double target; // cycles per day
+	long rating; // load cycles the drive is rated for
+
+	// persisted
+	time_t since; // start of counting
+	unsigned long cycles;
+	unsigned long touches;
+	double rate; // smoothed cycles per day
+	double scale; // applied to the timeouts
+
+	unsigned long lastLlc;
+	unsigned long lastTouches;
+	unsigned long hourCycles;
+	long long hourStart;
+	long long lastSave;
+};
+
+int budgetOpen(struct cycleBudget *budget,const char *stateDir,const char *disk,double target,long rating);
+void budgetUpdate(struct cycleBudget *budget,unsigned long llc,unsigned long touches,int headsLoaded);
+int budgetTimeout(const struct cycleBudget *budget,int timeout);
+int budgetSave(struct cycleBudget *budget);
+void budgetReport(const struct cycleBudget *budget);
+void budgetClose(struct cycleBudget *budget);
+
+#endif
@@ -0,0 +1,318 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Calibration of the drive's head unload timer.
+
+	The drive is probed with timed, uncached reads separated by increasing
+	gaps of inactivity. While the heads are loaded, a read costs a seek. Once
+	the gap exceeds the drive's unload timer, the read also has to wait for
+	the heads to be loaded back from the ramp, which shows up as a jump in
+	latency. The largest gap without a jump is the learned unload timer. It
+	is stored per drive serial in the state directory, and the touch interval
+	is set just under it on the next start. If no jump shows up within
+	--calibrate-max, nothing is stored.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "wdantiparkd.h"
+#include "diskinfo.h"
+#include "calibrate.h"
+
+#define CALIBRATION_FILE "calibration"
+#define PROBE_BUFFER_SIZE 4096
+
+// latency must grow by both factors before it counts as a head reload
+#define JUMP_FACTOR 3
+#define JUMP_MIN_US 50000
+
+struct probeDevice
+{
+	int fd;
+	void *buffer;
+	unsigned long long blocks;
+	unsigned int seed;
+};
+
+static const int probeGaps[] = {
+	2, 3, 4, 5, 6, 7, 8, 9, 10, 12, 15, 20, 25, 30, 40, 50, 60, 90,
+	120, 180, 240, 300, 450, 600, 900, 1200, 1800, 3600, 0
+};
+
+static int openProbeDevice(const char *disk,struct probeDevice *dev)
+{
+	char path[64], value[64];
+
+	if(readDiskAttribute(disk,"size",value,64) <= 0) {
+		fprintf(stderr,"Could not read size of '%s'.\n",disk);
+		return -ENOENT;
+	}
+	dev->blocks = strtoull(value,NULL,10) * 512 / PROBE_BUFFER_SIZE;
+	if(dev->blocks < 2) {
+		fprintf(stderr,"Disk '%s' is too small to calibrate.\n",disk);
+		return -EINVAL;
+	}
+
+	snprintf(path,64,"/dev/%s",disk);
+	path[63] = 0;
+	dev->fd = open(path,O_RDONLY | O_DIRECT);
+	if(dev->fd < 0) {
+		fprintf(stderr,"Failed to open '%s' for direct reading (root required).\n",path);
+		return -errno;
+	}
+
+	if(posix_memalign(&dev->buffer,PROBE_BUFFER_SIZE,PROBE_BUFFER_SIZE)) {
+		close(dev->fd);
+		return -ENOMEM;
+	}
+	dev->seed = (unsigned int)time(NULL);
+	return 0;
+}
+
+static void closeProbeDevice(struct probeDevice *dev)
+{
+	close(dev->fd);
+	free(dev->buffer);
+}
+
+/*
+ Reads one block at a random offset, bypassing the page cache. A different
+ block is read every time so the drive's own cache cannot serve it.
+ Returns the latency in microseconds, or -errno.
+ */
+static long probeLatency(struct probeDevice *dev)
+{
+	unsigned long long block = ((unsigned long long)rand_r(&dev->seed) << 16 ^ rand_r(&dev->seed)) % dev->blocks;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC,&start);
+	if(pread(dev->fd,dev->buffer,PROBE_BUFFER_SIZE,block * PROBE_BUFFER_SIZE) < 0) return -errno;
+	clock_gettime(CLOCK_MONOTONIC,&end);
+
+	return (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_nsec - start.tv_nsec) / 1000;
+}
+
+static void sleepSeconds(int secs)
+{
+	while(secs > 0 && !terminateProgram) secs = sleep(secs);
+}
+
+/*
+ Loads the heads, waits for gap seconds and measures the next read.
+ Gaps disturbed by other I/O on the disk are retried.
+ */
+static long measureGap(const char *disk,struct probeDevice *dev,int gap)
+{
+	int attempt;
+
+	for(attempt = 0; attempt < 5 && !terminateProgram; attempt++) {
+		int haveReadActivity, haveWriteActivity;
+
+		if(probeLatency(dev) < 0) return -EIO;
+		checkForDiskActivity(disk,NULL,NULL);
+		sleepSeconds(gap);
+		if(terminateProgram) break;
+
+		checkForDiskActivity(disk,&haveReadActivity,&haveWriteActivity);
+		if(!haveReadActivity && !haveWriteActivity) return probeLatency(dev);
+
+		printf("[%s] Gap of %s disturbed by disk activity, retrying.\n",formatCurrentTime(NULL,0),formatSeconds(gap,NULL,0));
+		fflush(stdout);
+	}
+	return -EBUSY;
+}
+
+static long median3(long a,long b,long c)
+{
+	if(a > b) { long t = a; a = b; b = t; }
+	if(b > c) b = c;
+	return a > b ? a : b;
+}
+
+/*
+ Returns 1 if the heads were unloaded after gap seconds, 0 if not, -errno on error.
+ A single fast read is trusted, a slow read is confirmed by two more.
+ */
+static int headsUnloadedAfter(const char *disk,struct probeDevice *dev,int gap,long baseline)
+{
+	long latency[3];
+	int i;
+
+	for(i = 0; i < 3; i++) {
+		latency[i] = measureGap(disk,dev,gap);
+		if(latency[i] < 0) return latency[i];
+		if(latency[i] < baseline * JUMP_FACTOR || latency[i] < baseline + JUMP_MIN_US) {
+			if(i == 0) return 0;
+		}
+	}
+
+	printf("[%s]  gap %s: %ld/%ld/%ld us\n",formatCurrentTime(NULL,0),formatSeconds(gap,NULL,0),latency[0],latency[1],latency[2]);
+	fflush(stdout);
+
+	latency[0] = median3(latency[0],latency[1],latency[2]);
+	return latency[0] >= baseline * JUMP_FACTOR && latency[0] >= baseline + JUMP_MIN_US;
+}
+
+static int saveCalibratedTimer(const char *stateDir,const char *serial,int timer)
+{
+	char path[256], tmpPath[260], line[256], lineSerial[128];
+	FILE *in, *out;
+
+	snprintf(path,256,"%s/" CALIBRATION_FILE,stateDir);
+	path[255] = 0;
+	snprintf(tmpPath,260,"%s.tmp",path);
+
+	out = fopen(tmpPath,"w");
+	if(!out) {
+		fprintf(stderr,"Failed to open '%s' for writing.\n",tmpPath);
+		return -errno;
+	}
+
+	fprintf(out,"# wdantiparkd head unload timers (serial seconds)\n");
+	in = fopen(path,"r");
+	if(in) {
+		while(fgets(line,256,in)) {
+			if(line[0] == '#') continue;
+			if(sscanf(line,"%127s",lineSerial) == 1 && !strcmp(lineSerial,serial)) continue;
+			fputs(line,out);
+		}
+		fclose(in);
+	}
+	fprintf(out,"%s %d\n",serial,timer);
+
+	if(fclose(out) || rename(tmpPath,path) < 0) {
+		fprintf(stderr,"Failed to write '%s'.\n",path);
+		unlink(tmpPath);
+		return -errno;
+	}
+	return 0;
+}
+
+/*
+ Looks up the learned unload timer of the drive with the given serial.
+ Returns the timer in seconds, or -1 if the drive was never calibrated.
+ */
+int loadCalibratedTimer(const char *stateDir,const char *serial)
+{
+	char path[256], line[256], lineSerial[128];
+	int timer, result = -1;
+	FILE *in;
+
+	snprintf(path,256,"%s/" CALIBRATION_FILE,stateDir);
+	path[255] = 0;
+
+	in = fopen(path,"r");
+	if(!in) return -1;
+	while(fgets(line,256,in)) {
+		if(line[0] == '#') continue;
+		if(sscanf(line,"%127s %d",lineSerial,&timer) == 2 && !strcmp(lineSerial,serial) && timer > 0)
+			result = timer;
+	}
+	fclose(in);
+	return result;
+}
+
+/*
+ Touch interval for a drive which unloads after unloadTimer seconds,
+ leaving a 10% (at least 1s) safety margin.
+ */
+int calibratedInterval(int unloadTimer)
+{
+	int margin = unloadTimer / 10;
+	if(margin < 1) margin = 1;
+	return unloadTimer - margin > 1 ? unloadTimer - margin : 1;
+}
+
+int wdAntiParkCalibrate(struct wdAntiParkConfig *config)
+{
+	struct probeDevice dev;
+	char serial[128], intervalStr[32];
+	long samples[5], baseline;
+	int i, result, lastGood = 1, unloadGap = 0;
+
+	if(readDiskSerial(config->disk,serial,128) < 0) {
+		fprintf(stderr,"Could not determine the serial of '%s'.\n",config->disk);
+		return -1;
+	}
+
+	result = openProbeDevice(config->disk,&dev);
+	if(result < 0) return result;
+
+	printf("[%s] Calibrating head unload timer of %s (serial %s), up to %s.\n",
+		   formatCurrentTime(NULL,0),config->disk,serial,formatSeconds(config->calibrateMax,NULL,0));
+	printf("[%s] Keep the disk otherwise idle, this may take a while.\n",formatCurrentTime(NULL,0));
+	fflush(stdout);
+
+	// baseline: latency with heads surely loaded, first read warms up
+	probeLatency(&dev);
+	for(i = 0; i < 5; i++) {
+		samples[i] = measureGap(config->disk,&dev,1);
+		if(samples[i] < 0) goto failed;
+	}
+	baseline = median3(samples[1],samples[2],samples[3]);
+	if(baseline < 1) baseline = 1;
+	printf("[%s] Baseline read latency: %ld us\n",formatCurrentTime(NULL,0),baseline);
+	fflush(stdout);
+
+	// coarse search for the first gap that unloads the heads
+	for(i = 0; probeGaps[i] && probeGaps[i] <= config->calibrateMax && !terminateProgram; i++) {
+		result = headsUnloadedAfter(config->disk,&dev,probeGaps[i],baseline);
+		if(result < 0) goto failed;
+		if(result) {
+			unloadGap = probeGaps[i];
+			break;
+		}
+		lastGood = probeGaps[i];
+	}
+
+	// bisect down to the second
+	while(unloadGap && unloadGap - lastGood > 1 && !terminateProgram) {
+		int mid = (lastGood + unloadGap) / 2;
+		result = headsUnloadedAfter(config->disk,&dev,mid,baseline);
+		if(result < 0) goto failed;
+		if(result) unloadGap = mid;
+		else lastGood = mid;
+	}
+
+	closeProbeDevice(&dev);
+	if(terminateProgram) return -1;
+
+	// gaps beyond the last probe were never tried, nothing is known of them
+	if(!unloadGap) {
+		printf("[%s] No head unload observed within %s, the unload timer was not found and nothing is saved.\n",
+			   formatCurrentTime(NULL,0),formatSeconds(lastGood,NULL,0));
+		fflush(stdout);
+		return -1;
+	}
+
+	printf("[%s] Head unload timer: %s. Touch interval: %s.\n",formatCurrentTime(NULL,0),
+		   formatSeconds(lastGood,NULL,0),formatSeconds(calibratedInterval(lastGood),intervalStr,32));
+	fflush(stdout);
+
+	return saveCalibratedTimer(config->stateDir,serial,lastGood);
+
+failed:
+	fprintf(stderr,"Calibration of '%s' failed.\n",config->disk);
+	closeProbeDevice(&dev);
+	return -1;
+}
@@ -0,0 +1,32 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Calibration of the drive's head unload timer.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALIBRATE_H
+#define CALIBRATE_H
+
+#include "wdantiparkd.h"
+
+int wdAntiParkCalibrate(struct wdAntiParkConfig *config);
+int loadCalibratedTimer(const char *stateDir,const char *serial);
+int calibratedInterval(int unloadTimer);
+
+#endif
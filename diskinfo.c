@@ -0,0 +1,199 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Helpers for reading disk attributes from /sys/block.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include "diskinfo.h"
+
+/*
+ Reads /sys/block/<disk>/<attr> into buffer with trailing whitespace removed.
+ Returns the length of the value, or -errno.
+ */
+int readDiskAttribute(const char *disk,const char *attr,char *buffer,int max)
+{
+	char path[256];
+	int fd, len;
+
+	snprintf(path,256,"/sys/block/%s/%s",disk,attr);
+	path[255] = 0;
+
+	fd = open(path,O_RDONLY);
+	if(fd < 0) return -errno;
+	len = read(fd,buffer,max - 1);
+	close(fd);
+	if(len < 0) return -errno;
+
+	buffer[len] = 0;
+	while(len > 0 && isspace((unsigned char)buffer[len - 1])) buffer[--len] = 0;
+	return len;
+}
+
+/*
+ Copies src into serial, dropping leading/trailing blanks and replacing
+ inner whitespace or unprintables with '_' so the result is a single token.
+ */
+static int sanitizeSerial(const char *src,int len,char *serial,int max)
+{
+	int i, n = 0;
+
+	while(len > 0 && (isspace((unsigned char)*src) || !*src)) { src++; len--; }
+	while(len > 0 && (isspace((unsigned char)src[len - 1]) || !src[len - 1])) len--;
+
+	for(i = 0; i < len && n < max - 1; i++) {
+		unsigned char c = src[i];
+		serial[n++] = (isgraph(c)) ? c : '_';
+	}
+	serial[n] = 0;
+	return n;
+}
+
+/*
+ Reads an identifier that is unique for the drive. Tries the serial attributes
+ exposed by virtio/nvme first, then the SCSI unit serial number VPD page
+ (what libata reports for SATA drives) and finally the WWID.
+ Returns the length of the serial, or -errno.
+ */
+int readDiskSerial(const char *disk,char *serial,int max)
+{
+	static const char *attrs[] = { "device/serial", "serial", NULL };
+	char buffer[256];
+	int len, i;
+
+	for(i = 0; attrs[i]; i++) {
+		len = readDiskAttribute(disk,attrs[i],buffer,256);
+		if(len > 0 && sanitizeSerial(buffer,len,serial,max) > 0) return strlen(serial);
+	}
+
+	// VPD page 0x80: 4 byte header, byte 3 holds the serial length
+	len = readDiskAttribute(disk,"device/vpd_pg80",buffer,256);
+	if(len > 4) {
+		int serialLen = (unsigned char)buffer[3];
+		if(serialLen > len - 4) serialLen = len - 4;
+		if(sanitizeSerial(buffer + 4,serialLen,serial,max) > 0) return strlen(serial);
+	}
+
+	len = readDiskAttribute(disk,"device/wwid",buffer,256);
+	if(len > 0 && sanitizeSerial(buffer,len,serial,max) > 0) return strlen(serial);
+
+	serial[0] = 0;
+	return -ENOENT;
+}
+
+/*
+ Identifies the host adapter the disk hangs off, as the sysfs path of the
+ controller. Everything below the first ata/host/usb/virtio component of
+ the device path belongs to the adapter, so disks behind the same
+ controller or port multiplier share an identifier.
+ Returns the length of the identifier, or -errno.
+ */
+int readDiskAdapter(const char *disk,char *adapter,int max)
+{
+	static const char *prefixes[] = { "ata", "host", "usb", "virtio", "port-", "end_device-", NULL };
+	char path[256], *resolved, *component;
+	int i;
+
+	snprintf(path,256,"/sys/block/%s/device",disk);
+	path[255] = 0;
+
+	resolved = realpath(path,NULL);
+	if(!resolved) return -errno;
+
+	for(component = strchr(resolved + 1,'/'); component; component = strchr(component + 1,'/')) {
+		for(i = 0; prefixes[i]; i++) {
+			int len = strlen(prefixes[i]);
+			if(!strncmp(component + 1,prefixes[i],len) && isdigit((unsigned char)component[1 + len])) break;
+		}
+		if(prefixes[i]) break;
+	}
+
+	// no known bus component, the parent of the device is the best guess
+	if(!component) component = strrchr(resolved,'/');
+	if(component) *component = 0;
+
+	strncpy(adapter,resolved,max);
+	adapter[max - 1] = 0;
+	free(resolved);
+	return strlen(adapter);
+}
+
+/*
+ Tells what kind of device the disk is: stacked and emulated devices by
+ name, bus or the identity the hypervisor gives them, then solid state
+ and zoned disks by their queue attributes. Drive-managed SMR disks do not
+ show up as zoned, the drive profiles cover the ones that are known.
+ */
+int readDiskKind(const char *disk)
+{
+	static const char *virtualNames[] = { "loop", "ram", "zram", "nbd", "rbd", "md", "dm-", "vd", "xvd", NULL };
+	static const char *virtualIds[] = { "0x1af4", "QEMU", "VMware", "VBOX", "Virtual", "Msft", "XENVBD", NULL };
+	char value[256], path[256], *resolved;
+	int i;
+
+	// SCSI peripheral types other than direct access and RBC
+	if(readDiskAttribute(disk,"device/type",value,256) > 0 && atoi(value) != 0 && atoi(value) != 14) return DiskNotADisk;
+
+	for(i = 0; virtualNames[i]; i++) {
+		if(!strncmp(disk,virtualNames[i],strlen(virtualNames[i]))) return DiskVirtual;
+	}
+
+	snprintf(path,256,"/sys/block/%s/device",disk);
+	path[255] = 0;
+	resolved = realpath(path,NULL);
+	if(resolved) {
+		int isVirtio = strstr(resolved,"/virtio") != NULL;
+		free(resolved);
+		if(isVirtio) return DiskVirtual;
+	}
+
+	for(i = 0; virtualIds[i]; i++) {
+		if(readDiskAttribute(disk,"device/vendor",value,256) > 0 && strstr(value,virtualIds[i])) return DiskVirtual;
+		if(readDiskAttribute(disk,"device/model",value,256) > 0 && strstr(value,virtualIds[i])) return DiskVirtual;
+	}
+
+	if(readDiskAttribute(disk,"queue/rotational",value,256) > 0 && !strcmp(value,"0")) return DiskSolidState;
+	if(readDiskAttribute(disk,"queue/zoned",value,256) > 0 && strcmp(value,"none")) return DiskSmr;
+	return DiskRotational;
+}
+
+/*
+ Returns 1 while the disk is attached. Used to tell a removed disk from
+ one that only failed a request.
+ */
+int diskAttached(const char *disk)
+{
+	char path[256];
+
+	snprintf(path,256,"/sys/block/%s",disk);
+	path[255] = 0;
+	return access(path,F_OK) == 0;
+}
+
+const char *diskKindName(int kind)
+{
+	static const char *names[] = { "rotational", "SMR", "solid state", "virtual", "not a disk" };
+	return kind >= DiskRotational && kind <= DiskNotADisk ? names[kind] : "unknown";
+}
@@ -0,0 +1,43 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Helpers for reading disk attributes from /sys/block.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DISKINFO_H
+#define DISKINFO_H
+
+// the kinds from DiskSolidState on have no heads to keep loaded
+enum DiskKind
+{
+	DiskRotational,
+	DiskSmr, // zoned, writes are costly
+	DiskSolidState,
+	DiskVirtual,
+	DiskNotADisk
+};
+
+int readDiskAttribute(const char *disk,const char *attr,char *buffer,int max);
+int readDiskSerial(const char *disk,char *serial,int max);
+int readDiskAdapter(const char *disk,char *adapter,int max);
+int readDiskKind(const char *disk);
+int diskAttached(const char *disk);
+const char *diskKindName(int kind);
+
+#endif
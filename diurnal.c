@@ -0,0 +1,235 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Learns how busy the disk is in each hour of the week.
+
+	Access patterns tend to repeat daily and weekly: office hours, a
+	nightly backup, quiet weekends. For each of the 168 hours of the week
+	the share of minutes with organic I/O is kept, averaged over the past
+	weeks, and persisted per drive serial in the state directory. Hours
+	active most of the time are busy, hours without activity for weeks are
+	dead. The policy can then keep the heads loaded for longer in busy
+	hours, go straight to IDLE in dead hours, and pre-wake the disk just
+	before a busy hour starts.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "wdantiparkd.h"
+#include "diskinfo.h"
+#include "diurnal.h"
+
+// share of active minutes of a busy hour, and the most of a dead one (1/10000)
+#define BUSY_ACTIVITY 5000
+#define DEAD_ACTIVITY 200
+
+// weeks of data before an hour is trusted to be dead
+#define DEAD_WEEKS 2
+
+// minutes measured before an hour counts, so a start mid-hour is skipped
+#define MIN_MINUTES 30
+
+// minutes before a busy hour to load the heads
+#define PREWAKE_LEAD 5
+
+// weight of the newest week, in 1/WEEK_WEIGHT
+#define WEEK_WEIGHT 4
+
+static const char *weekdays[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+
+static int currentBucket(int *minuteOfHour)
+{
+	time_t now = time(NULL);
+	struct tm local;
+
+	localtime_r(&now,&local);
+	if(minuteOfHour) *minuteOfHour = local.tm_min;
+	return local.tm_wday * 24 + local.tm_hour;
+}
+
+static enum HourClass bucketClass(const struct diurnal *diurnal,int bucket)
+{
+	if(!diurnal->weeks[bucket]) return HourNormal;
+	if(diurnal->activity[bucket] >= BUSY_ACTIVITY) return HourBusy;
+	if(diurnal->weeks[bucket] >= DEAD_WEEKS && diurnal->activity[bucket] <= DEAD_ACTIVITY) return HourDead;
+	return HourNormal;
+}
+
+static int saveSchedule(struct diurnal *diurnal)
+{
+	char buffer[HOURS_PER_WEEK * 12 + 64];
+	int len = 0, i;
+
+	if(diurnal->fd < 0) return -EBADF;
+
+	// a line per weekday, activity:weeks for each hour
+	len += snprintf(buffer + len,sizeof(buffer) - len,"# wdantiparkd hourly activity (1/10000:weeks), Sunday first\n");
+	for(i = 0; i < HOURS_PER_WEEK; i++) {
+		len += snprintf(buffer + len,sizeof(buffer) - len,"%u:%u%c",diurnal->activity[i],diurnal->weeks[i],i % 24 == 23 ? '\n' : ' ');
+	}
+	if(pwrite(diurnal->fd,buffer,len,0) != len || ftruncate(diurnal->fd,len) < 0) return -errno;
+	return 0;
+}
+
+/*
+ Opens the learned schedule of the disk, creating it on first use. Must be
+ called before dropping privileges, the file stays open.
+ Returns 0, or -errno.
+ */
+int diurnalOpen(struct diurnal *diurnal,const char *stateDir,const char *disk)
+{
+	char serial[128], path[256], buffer[HOURS_PER_WEEK * 12 + 64], *line, *save;
+	int len, bucket = 0;
+
+	memset(diurnal,0,sizeof(struct diurnal));
+	diurnal->bucket = -1;
+	diurnal->prewoken = -1;
+
+	if(readDiskSerial(disk,serial,128) < 0) {
+		fprintf(stderr,"Could not determine the serial of '%s', the schedule is not kept.\n",disk);
+		diurnal->fd = -1;
+		return -ENOENT;
+	}
+
+	snprintf(path,256,"%s/diurnal-%s",stateDir,serial);
+	path[255] = 0;
+	diurnal->fd = open(path,O_RDWR | O_CREAT | O_CLOEXEC,0644);
+	if(diurnal->fd < 0) {
+		fprintf(stderr,"Failed to open '%s', the schedule is not kept.\n",path);
+		return -errno;
+	}
+
+	len = pread(diurnal->fd,buffer,sizeof(buffer) - 1,0);
+	if(len <= 0) return 0;
+	buffer[len] = 0;
+
+	for(line = strtok_r(buffer,"\n",&save); line; line = strtok_r(NULL,"\n",&save)) {
+		char *entry, *entrySave;
+		if(line[0] == '#') continue;
+		for(entry = strtok_r(line," ",&entrySave); entry && bucket < HOURS_PER_WEEK; entry = strtok_r(NULL," ",&entrySave)) {
+			unsigned int activity, weeks;
+			if(sscanf(entry,"%u:%u",&activity,&weeks) != 2) continue;
+			diurnal->activity[bucket] = activity > 10000 ? 10000 : activity;
+			diurnal->weeks[bucket] = weeks > 255 ? 255 : weeks;
+			bucket++;
+		}
+	}
+	return 0;
+}
+
+static void finishHour(struct diurnal *diurnal)
+{
+	int bucket = diurnal->bucket;
+	int activity;
+
+	if(diurnal->minutes < MIN_MINUTES) return;
+
+	activity = diurnal->activeMinutes * 10000 / diurnal->minutes;
+	if(!diurnal->weeks[bucket]) diurnal->activity[bucket] = activity;
+	else diurnal->activity[bucket] += (activity - diurnal->activity[bucket]) / WEEK_WEIGHT;
+	if(diurnal->weeks[bucket] < 255) diurnal->weeks[bucket]++;
+	diurnal->unsaved = 1;
+}
+
+/*
+ Feeds the schedule with a tick. A minute is active if any of its ticks
+ saw organic I/O. A finished hour is saved once the heads are loaded, a
+ write would wake a parked disk.
+ */
+void diurnalSample(struct diurnal *diurnal,int active,int headsLoaded)
+{
+	long minute = time(NULL) / 60;
+	int bucket;
+
+	if(minute != diurnal->minute) {
+		if(diurnal->minute) {
+			diurnal->minutes++;
+			diurnal->activeMinutes += diurnal->activeMinute;
+		}
+		diurnal->minute = minute;
+		diurnal->activeMinute = 0;
+
+		bucket = currentBucket(NULL);
+		if(bucket != diurnal->bucket) {
+			if(diurnal->bucket >= 0) finishHour(diurnal);
+			diurnal->bucket = bucket;
+			diurnal->minutes = 0;
+			diurnal->activeMinutes = 0;
+		}
+	}
+	if(active) diurnal->activeMinute = 1;
+	if(diurnal->unsaved && headsLoaded) {
+		saveSchedule(diurnal);
+		diurnal->unsaved = 0;
+	}
+}
+
+/*
+ Class of the current hour. The minutes leading up to a busy hour count
+ as busy, so a pre-woken disk is not parked again right away.
+ */
+enum HourClass diurnalClass(const struct diurnal *diurnal)
+{
+	int minute, bucket = currentBucket(&minute);
+
+	if(minute >= 60 - PREWAKE_LEAD && bucketClass(diurnal,(bucket + 1) % HOURS_PER_WEEK) == HourBusy) return HourBusy;
+	return bucketClass(diurnal,bucket);
+}
+
+/*
+ Returns 1 when a busy hour is about to start and the disk was not yet
+ woken for it.
+ */
+int diurnalPrewake(const struct diurnal *diurnal)
+{
+	int minute, bucket = currentBucket(&minute), next = (bucket + 1) % HOURS_PER_WEEK;
+
+	return minute >= 60 - PREWAKE_LEAD && bucketClass(diurnal,bucket) != HourBusy &&
+		   bucketClass(diurnal,next) == HourBusy && diurnal->prewoken != next;
+}
+
+void diurnalPrewakeTaken(struct diurnal *diurnal)
+{
+	diurnal->prewoken = (currentBucket(NULL) + 1) % HOURS_PER_WEEK;
+}
+
+void diurnalReport(const struct diurnal *diurnal)
+{
+	static const char *classes[] = { "normal", "busy", "dead" };
+	int bucket = currentBucket(NULL), busy = 0, dead = 0, i;
+
+	for(i = 0; i < HOURS_PER_WEEK; i++) {
+		enum HourClass class = bucketClass(diurnal,i);
+		if(class == HourBusy) busy++;
+		else if(class == HourDead) dead++;
+	}
+	printf("[%s] Schedule - this hour (%s %02d:00): %s, %.0f%% active over %u weeks, busy hours: %d, dead hours: %d\n",formatCurrentTime(NULL,0),
+		   weekdays[bucket / 24],bucket % 24,classes[diurnalClass(diurnal)],diurnal->activity[bucket] / 100.0,diurnal->weeks[bucket],busy,dead);
+	fflush(stdout);
+}
+
+void diurnalClose(struct diurnal *diurnal)
+{
+	if(diurnal->unsaved) saveSchedule(diurnal);
+	if(diurnal->fd >= 0) close(diurnal->fd);
+}
@@ -0,0 +1,60 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Learns how busy the disk is in each hour of the week.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DIURNAL_H
+#define DIURNAL_H
+
+#define HOURS_PER_WEEK 168
+
+enum HourClass
+{
+	HourNormal,
+	HourBusy,
+	HourDead
+};
+
+struct diurnal
+{
+	int fd; // schedule file, kept open across the privilege drop
+
+	// persisted, per hour of the week
+	unsigned short activity[HOURS_PER_WEEK]; // share of active minutes, 1/10000
+	unsigned char weeks[HOURS_PER_WEEK]; // hours seen, up to 255
+
+	int bucket; // hour being measured, -1 before the first minute
+	long minute;
+	int activeMinute;
+	int minutes;
+	int activeMinutes;
+	int prewoken; // busy hour already pre-woken for
+	int unsaved; // hours finished since the schedule was written
+};
+
+int diurnalOpen(struct diurnal *diurnal,const char *stateDir,const char *disk);
+void diurnalSample(struct diurnal *diurnal,int active,int headsLoaded);
+enum HourClass diurnalClass(const struct diurnal *diurnal);
+int diurnalPrewake(const struct diurnal *diurnal);
+void diurnalPrewakeTaken(struct diurnal *diurnal);
+void diurnalReport(const struct diurnal *diurnal);
+void diurnalClose(struct diurnal *diurnal);
+
+#endif
@@ -0,0 +1,316 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Flushing of the filesystems that live on the monitored disk.
+
+	A global sync() writes back every filesystem on the machine and can wake
+	other parked disks. Instead, the block devices that sit on the disk are
+	collected: the disk, its partitions and anything stacked on them (md,
+	dm). Each filesystem mounted from one of them is flushed with syncfs().
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/fanotify.h>
+#include "wdantiparkd.h"
+#include "flush.h"
+
+static void addBlockDevice(struct blockDevices *devices,const char *name,int depth);
+
+static void addHolders(struct blockDevices *devices,const char *name,int depth)
+{
+	char path[256];
+	struct dirent *entry;
+	DIR *dir;
+
+	snprintf(path,256,"/sys/class/block/%s/holders",name);
+	path[255] = 0;
+	dir = opendir(path);
+	if(!dir) return;
+	while((entry = readdir(dir))) {
+		if(entry->d_name[0] != '.') addBlockDevice(devices,entry->d_name,depth + 1);
+	}
+	closedir(dir);
+}
+
+static void addBlockDevice(struct blockDevices *devices,const char *name,int depth)
+{
+	char path[256], dev[16];
+	int fd, len, i;
+
+	if(depth > 8 || devices->count >= MAX_DEVICES) return;
+	for(i = 0; i < devices->count; i++) {
+		if(!strcmp(devices->name[i],name)) return;
+	}
+
+	snprintf(path,256,"/sys/class/block/%s/dev",name);
+	path[255] = 0;
+	fd = open(path,O_RDONLY);
+	if(fd < 0) return;
+	len = read(fd,dev,15);
+	close(fd);
+	if(len <= 0) return;
+	dev[len] = 0;
+	dev[strcspn(dev,"\n")] = 0;
+
+	strncpy(devices->name[devices->count],name,32);
+	devices->name[devices->count][31] = 0;
+	strcpy(devices->dev[devices->count],dev);
+	devices->count++;
+
+	addHolders(devices,name,depth);
+}
+
+/*
+ Collects the block devices whose data lives on disk: the disk itself, its
+ partitions and the md/dm devices stacked on them.
+ */
+void collectBlockDevices(const char *disk,struct blockDevices *devices)
+{
+	char path[256];
+	struct dirent *entry;
+	DIR *dir;
+
+	devices->count = 0;
+	addBlockDevice(devices,disk,0);
+
+	// partitions are subdirectories of the disk
+	snprintf(path,256,"/sys/block/%s",disk);
+	path[255] = 0;
+	dir = opendir(path);
+	if(!dir) return;
+	while((entry = readdir(dir))) {
+		if(!strncmp(entry->d_name,disk,strlen(disk)) && entry->d_name[strlen(disk)])
+			addBlockDevice(devices,entry->d_name,1);
+	}
+	closedir(dir);
+}
+
+// undo the octal escapes of spaces and friends in mountinfo
+static void unescapeMountPath(char *path)
+{
+	char *in = path, *out = path;
+	while(*in) {
+		if(in[0] == '\\' && in[1] >= '0' && in[1] <= '3' && in[2] >= '0' && in[2] <= '7' && in[3] >= '0' && in[3] <= '7') {
+			*out++ = (in[1] - '0') * 64 + (in[2] - '0') * 8 + (in[3] - '0');
+			in += 4;
+		} else *out++ = *in++;
+	}
+	*out = 0;
+}
+
+/*
+ Does the mount belong to one of the devices? Filesystems like btrfs report
+ an anonymous MAJ:MIN, so the mount source is checked as well.
+ */
+static int isMountOnDevices(struct blockDevices *devices,const char *dev,const char *source)
+{
+	char *resolved = NULL;
+	const char *name = NULL;
+	int i;
+
+	for(i = 0; i < devices->count; i++) {
+		if(!strcmp(devices->dev[i],dev)) return 1;
+	}
+
+	if(strncmp(source,"/dev/",5)) return 0;
+	resolved = realpath(source,NULL);
+	name = strrchr(resolved ? resolved : source,'/') + 1;
+	for(i = 0; i < devices->count; i++) {
+		if(!strcmp(devices->name[i],name)) break;
+	}
+	free(resolved);
+	return i < devices->count;
+}
+
+/*
+ Lists one mount point for every filesystem that lives on disk.
+ Returns the number of filesystems, or -errno if the mount table is unreadable.
+ */
+int listDiskMounts(const char *disk,struct diskMounts *mounts)
+{
+	struct blockDevices devices;
+	char line[1024], dev[MAX_FILESYSTEMS][16];
+	FILE *mountInfo;
+
+	collectBlockDevices(disk,&devices);
+	mounts->count = 0;
+	mounts->tooLong = 0;
+
+	mountInfo = fopen("/proc/self/mountinfo","r");
+	if(!mountInfo) return -errno;
+
+	// id parent MAJ:MIN root mount-point options [optional...] - type source super-options
+	while(fgets(line,1024,mountInfo) && mounts->count < MAX_FILESYSTEMS) {
+		char mountDev[16], mountPoint[512], *separator, source[256];
+		int i;
+
+		if(sscanf(line,"%*d %*d %15s %*s %511s",mountDev,mountPoint) != 2) continue;
+		separator = strstr(line," - ");
+		if(!separator || sscanf(separator + 3,"%*s %255s",source) != 1) continue;
+		if(!isMountOnDevices(&devices,mountDev,source)) continue;
+
+		// bind mounts share the superblock, list once
+		for(i = 0; i < mounts->count; i++) {
+			if(!strcmp(dev[i],mountDev)) break;
+		}
+		if(i < mounts->count) continue;
+
+		unescapeMountPath(mountPoint);
+		if(strlen(mountPoint) >= sizeof(mounts->path[0])) {
+			mounts->tooLong++;
+			continue;
+		}
+		strcpy(dev[mounts->count],mountDev);
+		strcpy(mounts->path[mounts->count],mountPoint);
+		mounts->count++;
+	}
+	fclose(mountInfo);
+
+	return mounts->count;
+}
+
+/*
+ Collects the st_dev of each filesystem on disk.
+ Returns the number found, or -errno.
+ */
+int listDiskFilesystems(const char *disk,dev_t *devs,int max)
+{
+	struct diskMounts mounts;
+	struct stat st;
+	int count = 0, i, result;
+
+	result = listDiskMounts(disk,&mounts);
+	if(result < 0) return result;
+	for(i = 0; i < mounts.count && count < max; i++) {
+		if(stat(mounts.path[i],&st) == 0 && !isOnFilesystems(st.st_dev,devs,count)) devs[count++] = st.st_dev;
+	}
+	return count;
+}
+
+int isOnFilesystems(dev_t dev,const dev_t *devs,int count)
+{
+	int i;
+	for(i = 0; i < count; i++) {
+		if(devs[i] == dev) return 1;
+	}
+	return 0;
+}
+
+/*
+ Copies the paths of the newline separated list that are on a filesystem
+ of disk to own, so a disk only walks its own trees. Each path left out
+ is warned about, with the option it came from.
+ */
+void filterDiskPaths(const char *disk,const char *option,const char *paths,char *own,int max)
+{
+	dev_t devs[MAX_FILESYSTEMS];
+	int count = listDiskFilesystems(disk,devs,MAX_FILESYSTEMS), len = 0;
+
+	own[0] = 0;
+	while(*paths) {
+		int pathLen = strcspn(paths,"\n");
+		char path[512];
+		struct stat st;
+
+		if(pathLen >= 512 || len + pathLen + 2 > max) {
+			fprintf(stderr,"Warning: %s path '%.*s' does not fit, %s leaves it out.\n",option,pathLen < 64 ? pathLen : 64,paths,disk);
+		} else {
+			memcpy(path,paths,pathLen);
+			path[pathLen] = 0;
+			if(stat(path,&st) < 0) {
+				fprintf(stderr,"Warning: %s path '%s' cannot be read, %s leaves it out.\n",option,path,disk);
+			} else if(!isOnFilesystems(st.st_dev,devs,count)) {
+				fprintf(stderr,"Warning: %s path '%s' is not on %s, left to its own disk.\n",option,path,disk);
+			} else {
+				if(len) own[len++] = '\n';
+				strcpy(own + len,path);
+				len += pathLen;
+			}
+		}
+		paths += pathLen;
+		if(*paths) paths++;
+	}
+}
+
+/*
+ Marks the mounts of the disk's filesystems for the events in mask, at most
+ every MOUNT_MARK_INTERVAL seconds, so filesystems mounted later are watched
+ as well. Marks already there are left as they are. Failures are only
+ reported the first time, with what the marks are for.
+ */
+void markDiskMounts(int fanotifyFd,const char *disk,unsigned int mask,const char *what,long long *lastMark)
+{
+	struct diskMounts mounts;
+	long long now = monotonicTimeMs();
+	int report = !*lastMark, i;
+
+	if(*lastMark && now - *lastMark < MOUNT_MARK_INTERVAL * 1000LL) return;
+	*lastMark = now;
+
+	if(listDiskMounts(disk,&mounts) < 0) return;
+	for(i = 0; i < mounts.count; i++) {
+		if(fanotify_mark(fanotifyFd,FAN_MARK_ADD | FAN_MARK_MOUNT,mask,AT_FDCWD,mounts.path[i]) < 0 && report)
+			fprintf(stderr,"Failed to watch '%s' for %s.\n",mounts.path[i],what);
+	}
+}
+
+/*
+ Flushes the dirty data of the filesystems on disk, or of all filesystems
+ when globalSync is set. Mount points too long to open are skipped and
+ reported once per disk through tooLongReported.
+ Returns the number of filesystems flushed.
+ */
+int flushDisk(const char *disk,int globalSync,int *tooLongReported)
+{
+	struct diskMounts mounts;
+	int i;
+
+	if(globalSync) {
+		sync();
+		return 1;
+	}
+
+	if(listDiskMounts(disk,&mounts) < 0) {
+		fprintf(stderr,"Could not read mount table, syncing all filesystems.\n");
+		sync();
+		return 1;
+	}
+	// one long path does not turn every flush into a global sync
+	if(mounts.tooLong && !*tooLongReported) {
+		fprintf(stderr,"A mount point on %s is too long to sync on its own, it is left to the kernel's writeback.\n",disk);
+		*tooLongReported = 1;
+	}
+
+	for(i = 0; i < mounts.count; i++) {
+		int fd = open(mounts.path[i],O_RDONLY | O_DIRECTORY);
+		if(fd < 0) continue;
+		if(syncfs(fd) < 0)
+			fprintf(stderr,"Failed to sync filesystem at '%s'.\n",mounts.path[i]);
+		close(fd);
+	}
+
+	return mounts.count;
+}
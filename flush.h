@@ -0,0 +1,57 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Flushing of the filesystems that live on the monitored disk.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FLUSH_H
+#define FLUSH_H
+
+#include <sys/types.h>
+
+#define MAX_DEVICES 64
+
+struct blockDevices
+{
+	int count;
+	char name[MAX_DEVICES][32];
+	char dev[MAX_DEVICES][16]; // MAJ:MIN
+};
+
+#define MAX_FILESYSTEMS 64
+
+// seconds between looks for filesystems mounted since they were marked
+#define MOUNT_MARK_INTERVAL 60
+
+struct diskMounts
+{
+	int count;
+	char path[MAX_FILESYSTEMS][256];
+	int tooLong; // mounts left out, their path does not fit
+};
+
+void collectBlockDevices(const char *disk,struct blockDevices *devices);
+int listDiskMounts(const char *disk,struct diskMounts *mounts);
+int listDiskFilesystems(const char *disk,dev_t *devs,int max);
+int isOnFilesystems(dev_t dev,const dev_t *devs,int count);
+void filterDiskPaths(const char *disk,const char *option,const char *paths,char *own,int max);
+void markDiskMounts(int fanotifyFd,const char *disk,unsigned int mask,const char *what,long long *lastMark);
+int flushDisk(const char *disk,int globalSync,int *tooLongReported);
+
+#endif
@@ -0,0 +1,201 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Learned distribution of the idle gaps between bursts of disk I/O.
+
+	Every quiet gap between two bursts of organic I/O is put into a
+	histogram with log spaced bins, whose counts decay with each new gap
+	so the model follows the workload. The ANTI-PARK timeout is a ski
+	rental problem: every second spent waiting costs touches (rent), and
+	parking costs a load cycle (buy) if the gap turns out longer than the
+	timeout. The break-even point is the longest timeout (-A), which is
+	taken as worth one load cycle. The timeout chosen is the one with the
+	lowest expected cost under the histogram, among timeouts from a quarter
+	of the break-even point B up to B. A timeout t costs at most 1 + B/t
+	times what the best choice in hindsight would have on any gap, so when
+	the workload stops matching the model the cost stays within 5 times
+	the optimum, against 2 for the plain break-even rule.
+
+	The cycles and touches of the chosen timeouts on the real gaps are
+	counted, along with what the model expected, and with the doubling
+	rule run in the shadow on the same gaps for comparison.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "gapmodel.h"
+
+// weight kept by the older gaps each time a gap is added
+#define GAP_DECAY 0.99
+
+// effective gaps needed before the model is trusted
+#define GAP_MIN_SAMPLES 20.0
+
+// shortest timeout as a fraction of the break-even point, bounds the cost
+#define GAP_MIN_TIMEOUT_DIVISOR 4
+
+static int gapBin(double gap)
+{
+	int bin = gap <= 1.0 ? 0 : (int)(4.0 * log2(gap));
+	return bin < GAP_BINS ? bin : GAP_BINS - 1;
+}
+
+// upper edge of the bin
+static double binEdge(int bin)
+{
+	return pow(2.0,(bin + 1) / 4.0);
+}
+
+// geometric middle of the bin, the gap it stands for
+static double binGap(int bin)
+{
+	return pow(2.0,(bin + 0.5) / 4.0);
+}
+
+void gapModelInit(struct gapModel *model,const struct wdAntiParkConfig *config)
+{
+	memset(model,0,sizeof(struct gapModel));
+	model->interval = config->interval;
+	model->breakEven = config->antiParkTimeoutMax;
+	model->timeout = config->antiParkTimeout;
+	model->shadowBase = config->antiParkTimeout;
+	model->shadowTimeout = config->antiParkTimeout;
+	model->shadowParkedTimeout = config->parkedTimeout;
+}
+
+/*
+ Probability under the model that a gap lasts longer than timeout
+ */
+static double probabilityLonger(const struct gapModel *model,double timeout)
+{
+	double longer = 0.0;
+	int bin;
+
+	if(model->total <= 0.0) return 0.0;
+	for(bin = gapBin(timeout); bin < GAP_BINS; bin++) {
+		if(binGap(bin) > timeout) longer += model->bins[bin];
+	}
+	return longer / model->total;
+}
+
+/*
+ Expected cost of a timeout in touches per gap
+ */
+static double expectedCost(const struct gapModel *model,double timeout)
+{
+	double cost = 0.0, cycleCost = (double)model->breakEven / model->interval;
+	int bin;
+
+	for(bin = 0; bin < GAP_BINS; bin++) {
+		double gap = binGap(bin);
+		if(!model->bins[bin]) continue;
+		if(gap <= timeout) cost += model->bins[bin] * gap / model->interval;
+		else cost += model->bins[bin] * (timeout / model->interval + cycleCost);
+	}
+	return cost / model->total;
+}
+
+static void recordGap(struct gapModel *model,double gap)
+{
+	int bin;
+
+	// what the current timeout does with this gap
+	model->expectedCycles += probabilityLonger(model,model->timeout);
+	if(gap > model->timeout) {
+		model->cycles++;
+		model->touches += (double)model->timeout / model->interval;
+	} else {
+		model->touches += gap / model->interval;
+	}
+
+	// and the doubling rule: PARKED cut short doubles, IDLE resets
+	if(gap > model->shadowTimeout) {
+		model->shadowCycles++;
+		model->shadowTouches += (double)model->shadowTimeout / model->interval;
+		if(gap - model->shadowTimeout <= model->shadowParkedTimeout) {
+			model->shadowTimeout *= 2;
+			if(model->shadowTimeout > model->breakEven) model->shadowTimeout = model->breakEven;
+		} else {
+			model->shadowTimeout = model->shadowBase;
+		}
+	} else {
+		model->shadowTouches += gap / model->interval;
+	}
+
+	for(bin = 0; bin < GAP_BINS; bin++) model->bins[bin] *= GAP_DECAY;
+	model->total = model->total * GAP_DECAY + 1.0;
+	model->bins[gapBin(gap)] += 1.0;
+	model->gaps++;
+}
+
+/*
+ Feeds the model with a tick. A gap ends when activity follows at least
+ one quiet tick.
+ */
+void gapModelSample(struct gapModel *model,long long now,int active,int tickMs)
+{
+	if(!active) return;
+	if(model->lastActivity && now - model->lastActivity > tickMs * 3 / 2)
+		recordGap(model,(now - model->lastActivity) / 1000.0);
+	model->lastActivity = now;
+}
+
+/*
+ Chooses the ANTI-PARK timeout with the lowest expected cost, from a
+ quarter of the break-even point up to it. Until enough gaps are seen, the
+ current one is kept.
+ */
+int gapModelTimeout(struct gapModel *model)
+{
+	double bestCost, timeout, cost;
+	int bin, best, shortest;
+
+	if(model->total < GAP_MIN_SAMPLES) return model->timeout;
+
+	shortest = model->breakEven / GAP_MIN_TIMEOUT_DIVISOR;
+	if(shortest < model->interval) shortest = model->interval;
+
+	best = model->breakEven;
+	bestCost = expectedCost(model,best);
+	if(shortest < best && (cost = expectedCost(model,shortest)) < bestCost) {
+		bestCost = cost;
+		best = shortest;
+	}
+	for(bin = 0; bin < GAP_BINS; bin++) {
+		timeout = binEdge(bin);
+		if(timeout <= shortest) continue;
+		if(timeout >= model->breakEven) break;
+		cost = expectedCost(model,timeout);
+		if(cost < bestCost) {
+			bestCost = cost;
+			best = (int)ceil(timeout);
+		}
+	}
+	model->timeout = best;
+	return best;
+}
+
+void gapModelReport(const struct gapModel *model)
+{
+	printf("[%s] Idle gaps - seen: %lu, timeout: %s, cycles expected: %.1f, realised: %lu, doubling rule: %lu, ",formatCurrentTime(NULL,0),
+		   model->gaps,formatSeconds(model->timeout,NULL,0),model->expectedCycles,model->cycles,model->shadowCycles);
+	printf("touches: %.0f, doubling rule: %.0f\n",model->touches,model->shadowTouches);
+	fflush(stdout);
+}
@@ -0,0 +1,60 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Learned distribution of the idle gaps between bursts of disk I/O.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GAPMODEL_H
+#define GAPMODEL_H
+
+#include "wdantiparkd.h"
+
+// quarter octaves from 1s, the last bin holds everything above ~15h
+#define GAP_BINS 64
+
+struct gapModel
+{
+	double bins[GAP_BINS]; // decayed counts
+	double total;
+	long long lastActivity;
+	unsigned long gaps;
+
+	int interval; // seconds per touch
+	int breakEven; // seconds of touches worth one load cycle
+	int timeout; // current choice
+
+	// outcome of the chosen timeouts on the gaps seen
+	double expectedCycles;
+	unsigned long cycles;
+	double touches;
+
+	// the doubling rule run on the same gaps, for comparison
+	int shadowTimeout;
+	int shadowBase;
+	int shadowParkedTimeout;
+	unsigned long shadowCycles;
+	double shadowTouches;
+};
+
+void gapModelInit(struct gapModel *model,const struct wdAntiParkConfig *config);
+void gapModelSample(struct gapModel *model,long long now,int active,int tickMs);
+int gapModelTimeout(struct gapModel *model);
+void gapModelReport(const struct gapModel *model);
+
+#endif
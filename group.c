@@ -0,0 +1,210 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Disk groups (RAID members) which are woken together.
+
+	Siblings of the monitored disk are the other members of any md or dm
+	device stacked on top of it, plus the members of groups configured
+	with --array. A read on a sibling means the array is being accessed,
+	so the monitored disk is moved to ANTI-PARK right away instead of
+	waiting to be hit itself. Only reads count: writes are fanned out to
+	every member anyway. The daemon's own reads of a sibling it manages,
+	its read touches and the hot-set, warmer and prefetch reads, are taken
+	out of the count, or the members would keep waking each other.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "wdantiparkd.h"
+#include "group.h"
+
+#define MAX_LEAVES 64
+
+struct leafDisks
+{
+	int count;
+	char disk[MAX_LEAVES][16];
+};
+
+static void addDisk(char (*disks)[16],int *count,int max,const char *disk)
+{
+	int i;
+	for(i = 0; i < *count; i++) {
+		if(!strcmp(disks[i],disk)) return;
+	}
+	if(*count >= max) return;
+	strncpy(disks[*count],disk,16);
+	disks[*count][15] = 0;
+	(*count)++;
+}
+
+/*
+ Maps a partition to the disk it lives on, whole disks map to themselves.
+ Returns 0, or -1 if the disk's name does not fit.
+ */
+static int parentDisk(const char *name,char *disk,int max)
+{
+	char path[320], *resolved, *slash;
+	int len;
+
+	// a directory entry is at most 255 characters, the paths fit
+	snprintf(path,320,"/sys/class/block/%s/partition",name);
+	len = snprintf(disk,max,"%s",name);
+	if(access(path,F_OK) < 0) return len < max ? 0 : -1;
+
+	snprintf(path,320,"/sys/class/block/%s/..",name);
+	resolved = realpath(path,NULL);
+	if(!resolved) return len < max ? 0 : -1;
+	slash = strrchr(resolved,'/');
+	if(slash) len = snprintf(disk,max,"%s",slash + 1);
+	free(resolved);
+	return len < max ? 0 : -1;
+}
+
+/*
+ Collects the disks at the bottom of a stack of md/dm devices
+ */
+static void collectLeafDisks(const char *dev,struct leafDisks *leaves,int depth)
+{
+	char path[256];
+	struct dirent *entry;
+	DIR *dir;
+
+	snprintf(path,256,"/sys/class/block/%s/slaves",dev);
+	path[255] = 0;
+	dir = opendir(path);
+	if(!dir) return;
+
+	while((entry = readdir(dir))) {
+		char disk[16], slaves[320];
+		DIR *slaveDir;
+		int stacked = 0;
+
+		if(entry->d_name[0] == '.') continue;
+
+		snprintf(slaves,320,"/sys/class/block/%s/slaves",entry->d_name);
+		slaveDir = opendir(slaves);
+		if(slaveDir) {
+			struct dirent *slave;
+			while((slave = readdir(slaveDir))) {
+				if(slave->d_name[0] != '.') stacked = 1;
+			}
+			closedir(slaveDir);
+		}
+
+		if(stacked && depth < 8) {
+			collectLeafDisks(entry->d_name,leaves,depth + 1);
+		} else {
+			if(parentDisk(entry->d_name,disk,16) == 0) addDisk(leaves->disk,&leaves->count,MAX_LEAVES,disk);
+		}
+	}
+	closedir(dir);
+}
+
+static void addSiblingsFrom(const char *disk,struct leafDisks *members,struct diskSiblings *siblings)
+{
+	int i;
+	for(i = 0; i < members->count; i++) {
+		if(!strcmp(members->disk[i],disk)) break;
+	}
+	if(i == members->count) return;
+
+	for(i = 0; i < members->count; i++) {
+		if(strcmp(members->disk[i],disk)) addDisk(siblings->disk,&siblings->count,MAX_SIBLINGS,members->disk[i]);
+	}
+}
+
+/*
+ Finds the disks that belong to the same groups as disk. groups holds the
+ configured groups, separated by spaces, with members separated by commas.
+ Returns the number of siblings.
+ */
+int findDiskSiblings(const char *disk,const char *groups,int autoDetect,struct diskSiblings *siblings)
+{
+	struct leafDisks members;
+	char groupList[256], *group, *member, *groupSave, *memberSave;
+	int i;
+
+	siblings->count = 0;
+
+	if(autoDetect) {
+		struct dirent *entry;
+		DIR *dir = opendir("/sys/block");
+		if(dir) {
+			while((entry = readdir(dir))) {
+				if(strncmp(entry->d_name,"md",2) && strncmp(entry->d_name,"dm-",3)) continue;
+				members.count = 0;
+				collectLeafDisks(entry->d_name,&members,0);
+				addSiblingsFrom(disk,&members,siblings);
+			}
+			closedir(dir);
+		}
+	}
+
+	strncpy(groupList,groups,256);
+	groupList[255] = 0;
+	for(group = strtok_r(groupList," ",&groupSave); group; group = strtok_r(NULL," ",&groupSave)) {
+		members.count = 0;
+		for(member = strtok_r(group,",",&memberSave); member; member = strtok_r(NULL,",",&memberSave))
+			addDisk(members.disk,&members.count,MAX_LEAVES,member);
+		addSiblingsFrom(disk,&members,siblings);
+	}
+
+	// start counting from now
+	for(i = 0; i < siblings->count; i++) {
+		unsigned long writeSectorCount;
+		if(readDiskSectors(siblings->disk[i],&siblings->lastReadSectorCount[i],&writeSectorCount) < 0)
+			siblings->lastReadSectorCount[i] = 0;
+	}
+	return siblings->count;
+}
+
+/*
+ Checks the siblings for reads since the last call.
+ Returns the name of a sibling that was read, or NULL.
+ */
+const char *checkForSiblingReads(struct diskSiblings *siblings)
+{
+	const char *reader = NULL;
+	int i;
+
+	for(i = 0; i < siblings->count; i++) {
+		unsigned long readSectorCount, writeSectorCount;
+		if(readDiskSectors(siblings->disk[i],&readSectorCount,&writeSectorCount) < 0) continue;
+		if(readSectorCount != siblings->lastReadSectorCount[i] && !reader) reader = siblings->disk[i];
+		siblings->lastReadSectorCount[i] = readSectorCount;
+	}
+	return reader;
+}
+
+/*
+ Takes the read count of disk as its new baseline, if it is a sibling, so
+ reads the daemon made itself are not taken for use of the array.
+ */
+void resyncSiblingReads(struct diskSiblings *siblings,const char *disk,unsigned long readSectorCount)
+{
+	int i;
+
+	for(i = 0; i < siblings->count; i++) {
+		if(!strcmp(siblings->disk[i],disk)) siblings->lastReadSectorCount[i] = readSectorCount;
+	}
+}
@@ -0,0 +1,39 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Disk groups (RAID members) which are woken together.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GROUP_H
+#define GROUP_H
+
+#define MAX_SIBLINGS 32
+
+struct diskSiblings
+{
+	int count;
+	char disk[MAX_SIBLINGS][16];
+	unsigned long lastReadSectorCount[MAX_SIBLINGS];
+};
+
+int findDiskSiblings(const char *disk,const char *groups,int autoDetect,struct diskSiblings *siblings);
+const char *checkForSiblingReads(struct diskSiblings *siblings);
+void resyncSiblingReads(struct diskSiblings *siblings,const char *disk,unsigned long readSectorCount);
+
+#endif
@@ -0,0 +1,164 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Disks coming and going, from the kernel's uevents.
+
+	With --match the disks are not named up front but picked by their
+	serial or WWN, so the daemon follows the drives across reboots, bay
+	changes and USB enclosures. The kernel announces every block device added or
+	removed on a NETLINK_KOBJECT_UEVENT socket. Its /sys/block entry exists
+	by the time the add event arrives, so the serial and WWN are read from
+	there without waiting for udev.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <poll.h>
+#include <fnmatch.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include "diskinfo.h"
+#include "hotplug.h"
+
+/*
+ Subscribes to the kernel's uevents. Must be called before dropping
+ privileges.
+ Returns 0, or -errno.
+ */
+int hotplugOpen(struct hotplug *hotplug,const char *pattern)
+{
+	struct sockaddr_nl addr;
+
+	memset(hotplug,0,sizeof(struct hotplug));
+	strncpy(hotplug->pattern,pattern,128);
+	hotplug->pattern[127] = 0;
+
+	hotplug->fd = socket(AF_NETLINK,SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,NETLINK_KOBJECT_UEVENT);
+	if(hotplug->fd < 0) {
+		fprintf(stderr,"Failed to open the uevent socket.\n");
+		return -errno;
+	}
+
+	memset(&addr,0,sizeof(struct sockaddr_nl));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1; // kernel events, not udev's
+	if(bind(hotplug->fd,(struct sockaddr *)&addr,sizeof(struct sockaddr_nl)) < 0) {
+		int error = errno;
+		fprintf(stderr,"Failed to subscribe to uevents (root required).\n");
+		close(hotplug->fd);
+		hotplug->fd = -1;
+		return -error;
+	}
+	return 0;
+}
+
+/*
+ Returns 1 if the serial or the WWN of the disk matches the pattern.
+ */
+int diskMatches(const char *disk,const char *pattern)
+{
+	char value[128];
+
+	if(readDiskSerial(disk,value,128) >= 0 && !fnmatch(pattern,value,0)) return 1;
+	if(readDiskAttribute(disk,"device/wwid",value,128) > 0 && !fnmatch(pattern,value,0)) return 1;
+	if(readDiskAttribute(disk,"wwid",value,128) > 0 && !fnmatch(pattern,value,0)) return 1;
+	return 0;
+}
+
+/*
+ Looks for attached disks matching the pattern.
+ Returns the number of disks, up to max, with their names in disks.
+ */
+int findMatchingDisks(const char *pattern,char disks[][16],int max)
+{
+	struct dirent *entry;
+	DIR *dir = opendir("/sys/block");
+	int found = 0;
+
+	if(!dir) return 0;
+	while(found < max && (entry = readdir(dir))) {
+		if(entry->d_name[0] == '.' || strlen(entry->d_name) >= 16) continue;
+		if(diskMatches(entry->d_name,pattern)) strcpy(disks[found++],entry->d_name);
+	}
+	closedir(dir);
+	return found;
+}
+
+/*
+ Reads the next whole-disk add or remove event, without blocking. Other
+ uevents are skipped.
+ Returns 1 with the event filled in, 0 if there is none.
+ */
+int hotplugNext(struct hotplug *hotplug,struct hotplugEvent *event)
+{
+	char buffer[4096];
+	int len;
+
+	while((len = recv(hotplug->fd,buffer,4095,0)) > 0) {
+		const char *action = "", *subsystem = "", *devtype = "", *devname = "";
+		char *key;
+
+		// "action@devpath" then NUL separated KEY=value pairs
+		buffer[len] = 0;
+		for(key = buffer + strlen(buffer) + 1; key < buffer + len; key += strlen(key) + 1) {
+			if(!strncmp(key,"ACTION=",7)) action = key + 7;
+			else if(!strncmp(key,"SUBSYSTEM=",10)) subsystem = key + 10;
+			else if(!strncmp(key,"DEVTYPE=",8)) devtype = key + 8;
+			else if(!strncmp(key,"DEVNAME=",8)) devname = key + 8;
+		}
+		if(strcmp(subsystem,"block") || strcmp(devtype,"disk")) continue;
+		if(!strncmp(devname,"/dev/",5)) devname += 5;
+		if(!devname[0] || strlen(devname) >= 16) continue;
+
+		if(!strcmp(action,"add")) event->action = HotplugAdd;
+		else if(!strcmp(action,"remove")) event->action = HotplugRemove;
+		else continue;
+		strcpy(event->disk,devname);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ Sleeps until a uevent arrives or the timeout in ms passes. Returns early
+ on signals.
+ Returns 1 if there are events to read, 0 otherwise.
+ */
+int hotplugWait(struct hotplug *hotplug,long long timeoutMs)
+{
+	struct pollfd pfd;
+
+	pfd.fd = hotplug->fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if(timeoutMs < 0) timeoutMs = 0;
+	if(timeoutMs > 3600000) timeoutMs = 3600000;
+	return poll(&pfd,1,(int)timeoutMs) > 0;
+}
+
+void hotplugClose(struct hotplug *hotplug)
+{
+	if(hotplug->fd >= 0) close(hotplug->fd);
+	hotplug->fd = -1;
+}
@@ -0,0 +1,52 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Disks coming and going, from the kernel's uevents.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+enum HotplugAction
+{
+	HotplugAdd,
+	HotplugRemove
+};
+
+struct hotplugEvent
+{
+	int action;
+	char disk[16];
+};
+
+struct hotplug
+{
+	int fd; // NETLINK_KOBJECT_UEVENT socket
+	char pattern[128]; // serial or WWN of the disks to manage
+};
+
+int hotplugOpen(struct hotplug *hotplug,const char *pattern);
+int diskMatches(const char *disk,const char *pattern);
+int findMatchingDisks(const char *pattern,char disks[][16],int max);
+int hotplugNext(struct hotplug *hotplug,struct hotplugEvent *event);
+int hotplugWait(struct hotplug *hotplug,long long timeoutMs);
+void hotplugClose(struct hotplug *hotplug);
+
+#endif
@@ -0,0 +1,384 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Hot-set of files kept in the page cache so reads don't wake the disk.
+
+	Files enter the hot-set either from the --hotset globs, or by being
+	opened right when a read woke the disk from PARKED or IDLE, more than
+	once. Only files on the disk's own filesystems are taken. The opens are
+	seen through fanotify marks on the disk's mounts.
+	Hot files are read in and mlocked while the heads are loaded anyway
+	(ANTI-PARK). Without mlock, a POSIX_FADV_WILLNEED refresh is repeated
+	every few minutes in ANTI-PARK instead. The set is bounded by a memory
+	budget with LRU eviction: a file only takes the place of files used
+	less recently, otherwise it waits. An open of a pinned file while the
+	disk stays parked counts as a wake avoided.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/fanotify.h>
+#include "wdantiparkd.h"
+#include "flush.h"
+#include "hotset.h"
+
+// seconds between WILLNEED refreshes and glob rescans
+#define HOTSET_REFRESH 300
+
+// bytes read in per tick, so pinning never stalls the loop for long, larger
+// files are read in over several ticks
+#define PIN_BYTES_PER_TICK (16LL << 20)
+
+// wakes a learned file has to cause before it is pinned
+#define HOTSET_MIN_WAKES 2
+
+// budgets of the hot-sets of all disks, the mlock limit covers them all
+static long long mlockBudget = 0;
+
+static int openNoAtime(const char *path)
+{
+	int fd = open(path,O_RDONLY | O_NOATIME | O_CLOEXEC);
+	if(fd < 0 && errno == EPERM) fd = open(path,O_RDONLY | O_CLOEXEC);
+	return fd;
+}
+
+static struct hotFile *findHotFile(struct hotSet *hotset,const char *path)
+{
+	int i;
+	for(i = 0; i < hotset->count; i++) {
+		if(!strcmp(hotset->files[i].path,path)) return &hotset->files[i];
+	}
+	return NULL;
+}
+
+static void unpinFile(struct hotSet *hotset,struct hotFile *file)
+{
+	if(file->state == HotPending) return;
+	if(file->map) munmap(file->map,file->size);
+	file->map = NULL;
+	hotset->pinnedBytes -= file->size;
+	file->pinned = 0;
+	file->state = HotPending;
+}
+
+static void removeHotFile(struct hotSet *hotset,struct hotFile *file)
+{
+	unpinFile(hotset,file);
+	*file = hotset->files[--hotset->count];
+}
+
+static struct hotFile *leastRecentlyUsed(struct hotSet *hotset,struct hotFile *except,int pinnedOnly)
+{
+	struct hotFile *lru = NULL;
+	int i;
+	for(i = 0; i < hotset->count; i++) {
+		struct hotFile *file = &hotset->files[i];
+		if(file == except || (pinnedOnly && file->state == HotPending)) continue;
+		if(!lru || file->lastUsed < lru->lastUsed) lru = file;
+	}
+	return lru;
+}
+
+static struct hotFile *addHotFile(struct hotSet *hotset,const char *path)
+{
+	struct hotFile *file = findHotFile(hotset,path);
+	struct stat st;
+
+	if(file) return file;
+	if(stat(path,&st) < 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > hotset->budget) return NULL;
+	if(!isOnFilesystems(st.st_dev,hotset->devs,hotset->devCount)) return NULL;
+
+	if(hotset->count == MAX_HOT_FILES) removeHotFile(hotset,leastRecentlyUsed(hotset,NULL,0));
+
+	file = &hotset->files[hotset->count++];
+	memset(file,0,sizeof(struct hotFile));
+	strncpy(file->path,path,256);
+	file->path[255] = 0;
+	file->state = HotPending;
+	file->lastUsed = monotonicTimeMs();
+	return file;
+}
+
+/*
+ Makes room for the file and maps it, its size counts as pinned from here
+ on. Nothing is read in yet.
+ Returns 0, or -errno.
+ */
+static int startPinning(struct hotSet *hotset,struct hotFile *file)
+{
+	struct stat st;
+	long long evictable = 0;
+	int fd, i;
+
+	fd = openNoAtime(file->path);
+	if(fd < 0) return -errno;
+	if(fstat(fd,&st) < 0 || st.st_size <= 0 || st.st_size > hotset->budget) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	// room is only made from pinned files used less recently than this one
+	for(i = 0; i < hotset->count; i++) {
+		struct hotFile *other = &hotset->files[i];
+		if(other != file && other->state != HotPending && other->lastUsed < file->lastUsed) evictable += other->size;
+	}
+	if(hotset->pinnedBytes - evictable + st.st_size > hotset->budget) {
+		close(fd);
+		return -ENOMEM;
+	}
+	while(hotset->pinnedBytes + st.st_size > hotset->budget) unpinFile(hotset,leastRecentlyUsed(hotset,file,1));
+
+	file->size = st.st_size;
+	file->mtime = st.st_mtime;
+	file->map = NULL;
+	file->pinned = 0;
+
+	if(hotset->useMlock) {
+		void *map = mmap(NULL,file->size,PROT_READ,MAP_SHARED,fd,0);
+		if(map != MAP_FAILED) file->map = map;
+	}
+	close(fd);
+
+	file->state = HotPinning;
+	hotset->pinnedBytes += file->size;
+	return 0;
+}
+
+/*
+ Reads the next chunk of at most max bytes of the file in, mlocked or
+ with WILLNEED, and marks it pinned once all of it is.
+ Returns the number of bytes read in, or -errno.
+ */
+static long long pinChunk(struct hotSet *hotset,struct hotFile *file,long long max)
+{
+	long long len = file->size - file->pinned;
+	long pageSize = sysconf(_SC_PAGESIZE);
+
+	// chunks end on a page, except the last one
+	if(len > max) len = max & ~(long long)(pageSize - 1);
+	if(len <= 0) return 0;
+
+	if(file->map && mlock((char *)file->map + file->pinned,len) < 0) {
+		fprintf(stderr,"Failed to mlock hot-set file, falling back to WILLNEED refreshes.\n");
+		munmap(file->map,file->size);
+		file->map = NULL;
+		hotset->useMlock = 0;
+	}
+	if(!file->map) {
+		int fd = openNoAtime(file->path);
+		if(fd < 0) return -errno;
+		posix_fadvise(fd,file->pinned,len,POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+
+	file->pinned += len;
+	if(file->pinned >= file->size) {
+		file->state = HotPinned;
+		file->lastRefresh = monotonicTimeMs();
+	}
+	return len;
+}
+
+static void expandGlobs(struct hotSet *hotset)
+{
+	char globs[512], *pattern, *save;
+
+	// filesystems mounted since are picked up with the globs
+	hotset->devCount = listDiskFilesystems(hotset->disk,hotset->devs,MAX_FILESYSTEMS);
+	if(hotset->devCount < 0) hotset->devCount = 0;
+
+	strncpy(globs,hotset->globs,512);
+	globs[511] = 0;
+	for(pattern = strtok_r(globs,"\n",&save); pattern; pattern = strtok_r(NULL,"\n",&save)) {
+		glob_t matches;
+		size_t i;
+		if(glob(pattern,0,NULL,&matches)) continue;
+		for(i = 0; i < matches.gl_pathc; i++) {
+			struct hotFile *file = addHotFile(hotset,matches.gl_pathv[i]);
+			if(file) file->listed = 1;
+		}
+		globfree(&matches);
+	}
+	hotset->lastGlob = monotonicTimeMs();
+}
+
+/*
+ Sets up the hot-set. Must be called with root privileges: fanotify needs
+ CAP_SYS_ADMIN, and the mlock limit is raised by the budget here.
+ Returns NULL when there is nothing to do.
+ */
+struct hotSet *hotsetOpen(const char *disk,const char *globs,int learn,int budgetMb,int useMlock)
+{
+	struct hotSet *hotset;
+
+	if(!learn && !globs[0]) return NULL;
+
+	hotset = calloc(1,sizeof(struct hotSet));
+	if(!hotset) return NULL;
+	hotset->fanotifyFd = -1;
+	hotset->budget = (long long)budgetMb << 20;
+	hotset->useMlock = useMlock;
+	strncpy(hotset->globs,globs,512);
+	hotset->globs[511] = 0;
+	strncpy(hotset->disk,disk,16);
+	hotset->disk[15] = 0;
+	hotset->devCount = listDiskFilesystems(disk,hotset->devs,MAX_FILESYSTEMS);
+	if(hotset->devCount < 0) hotset->devCount = 0;
+
+	if(useMlock) {
+		struct rlimit limit;
+		hotset->mlockRaised = hotset->budget;
+		mlockBudget += hotset->mlockRaised;
+		limit.rlim_cur = limit.rlim_max = mlockBudget + (1 << 20);
+		setrlimit(RLIMIT_MEMLOCK,&limit);
+	}
+
+	if(learn) {
+		hotset->fanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_NONBLOCK | FAN_CLOEXEC,O_RDONLY | O_LARGEFILE | O_NOATIME);
+		if(hotset->fanotifyFd < 0) fprintf(stderr,"Failed to set up fanotify, hot-set learning disabled (root required).\n");
+		else markDiskMounts(hotset->fanotifyFd,disk,FAN_OPEN,"the hot-set",&hotset->lastMark);
+	}
+
+	return hotset;
+}
+
+/*
+ Collects the files opened since the previous tick. Opens of pinned files
+ while the disk stayed parked are reads the hot-set kept off the platter.
+ */
+void hotsetPoll(struct hotSet *hotset,int headsParked)
+{
+	char buffer[4096];
+	ssize_t len;
+	pid_t self = getpid();
+
+	hotset->tickOpenCount = 0;
+	if(hotset->fanotifyFd < 0) return;
+	markDiskMounts(hotset->fanotifyFd,hotset->disk,FAN_OPEN,"the hot-set",&hotset->lastMark);
+
+	while((len = read(hotset->fanotifyFd,buffer,sizeof(buffer))) > 0) {
+		struct fanotify_event_metadata *event = (struct fanotify_event_metadata *)buffer;
+
+		for(; FAN_EVENT_OK(event,len); event = FAN_EVENT_NEXT(event,len)) {
+			char link[64], path[256];
+			struct hotFile *file;
+			int pathLen;
+
+			if(event->fd < 0) continue;
+			if(event->pid == self) {
+				close(event->fd);
+				continue;
+			}
+
+			snprintf(link,64,"/proc/self/fd/%d",event->fd);
+			pathLen = readlink(link,path,255);
+			close(event->fd);
+			if(pathLen <= 0) continue;
+			path[pathLen] = 0;
+
+			if(hotset->tickOpenCount < MAX_TICK_OPENS) strcpy(hotset->tickOpens[hotset->tickOpenCount++],path);
+
+			file = findHotFile(hotset,path);
+			if(file) {
+				file->lastUsed = monotonicTimeMs();
+				if(headsParked && file->state == HotPinned) hotset->wakesAvoided++;
+			}
+		}
+	}
+}
+
+/*
+ A read just woke the disk, the files opened during this tick are to blame
+ */
+void hotsetLearnWake(struct hotSet *hotset)
+{
+	int i, learned = 0;
+
+	for(i = 0; i < hotset->tickOpenCount; i++) {
+		struct hotFile *file = addHotFile(hotset,hotset->tickOpens[i]);
+		if(!file) continue;
+		file->wakes++;
+		file->lastUsed = monotonicTimeMs();
+		learned = 1;
+	}
+	if(learned) hotset->wakesLearned++;
+}
+
+/*
+ Reads pending files in and refreshes the WILLNEED ones. Only called while
+ the heads are loaded, as this reads from the disk.
+ Returns the number of bytes read in.
+ */
+long long hotsetMaintain(struct hotSet *hotset)
+{
+	long long now = monotonicTimeMs(), budget = PIN_BYTES_PER_TICK;
+	int i;
+
+	if(hotset->globs[0] && (!hotset->lastGlob || now - hotset->lastGlob >= HOTSET_REFRESH * 1000LL)) expandGlobs(hotset);
+
+	for(i = 0; i < hotset->count && budget > 0; i++) {
+		struct hotFile *file = &hotset->files[i];
+		long long result;
+
+		if(file->state == HotPending && !file->listed && file->wakes < HOTSET_MIN_WAKES) continue;
+		if(file->state == HotPinned) {
+			struct stat st;
+			if(now - file->lastRefresh < HOTSET_REFRESH * 1000LL) continue;
+
+			// changed files are read in again, mlocked ones only then
+			if(stat(file->path,&st) < 0) {
+				removeHotFile(hotset,file);
+				i--;
+				continue;
+			}
+			if(file->map && st.st_size == file->size && st.st_mtime == file->mtime) {
+				file->lastRefresh = now;
+				continue;
+			}
+			unpinFile(hotset,file);
+		}
+
+		// a file too large for one tick resumes where it left off
+		result = file->state == HotPending ? startPinning(hotset,file) : 0;
+		if(result == 0) result = pinChunk(hotset,file,budget);
+		if(result == -ENOENT || result == -EINVAL) {
+			removeHotFile(hotset,file);
+			i--;
+		} else if(result > 0) budget -= result;
+	}
+	return PIN_BYTES_PER_TICK - budget;
+}
+
+void hotsetClose(struct hotSet *hotset)
+{
+	int i;
+	if(!hotset) return;
+	for(i = 0; i < hotset->count; i++) unpinFile(hotset,&hotset->files[i]);
+	mlockBudget -= hotset->mlockRaised;
+	if(hotset->fanotifyFd >= 0) close(hotset->fanotifyFd);
+	free(hotset);
+}
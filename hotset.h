@@ -0,0 +1,87 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Hot-set of files kept in the page cache so reads don't wake the disk.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HOTSET_H
+#define HOTSET_H
+
+#include <sys/types.h>
+#include <time.h>
+#include "flush.h"
+
+#define MAX_HOT_FILES 256
+#define MAX_TICK_OPENS 64
+
+enum HotFileState
+{
+	HotPending, // waits for the heads to be loaded to be read in
+	HotPinning, // read in a chunk per tick, its size already counts as pinned
+	HotPinned
+};
+
+struct hotFile
+{
+	char path[256];
+	off_t size;
+	off_t pinned; // bytes read in so far while HotPinning
+	time_t mtime;
+	long long lastUsed;
+	long long lastRefresh;
+	unsigned int wakes;
+	int listed; // matched by the --hotset globs, pinned without wakes
+	enum HotFileState state;
+	void *map; // mlocked mapping, NULL when kept by WILLNEED refreshes
+};
+
+struct hotSet
+{
+	int fanotifyFd;
+	int useMlock;
+	long long budget;
+	long long mlockRaised; // added to the mlock limit of the process
+	long long pinnedBytes;
+	long long lastGlob;
+	char globs[512];
+
+	// filesystems of the disk, files elsewhere are left to their own disk
+	char disk[16];
+	int devCount;
+	dev_t devs[MAX_FILESYSTEMS];
+	long long lastMark;
+
+	int count;
+	struct hotFile files[MAX_HOT_FILES];
+
+	// files opened since the previous tick, the suspects of a wake
+	int tickOpenCount;
+	char tickOpens[MAX_TICK_OPENS][256];
+
+	unsigned long wakesLearned;
+	unsigned long wakesAvoided;
+};
+
+struct hotSet *hotsetOpen(const char *disk,const char *globs,int learn,int budgetMb,int useMlock);
+void hotsetPoll(struct hotSet *hotset,int headsParked);
+void hotsetLearnWake(struct hotSet *hotset);
+long long hotsetMaintain(struct hotSet *hotset);
+void hotsetClose(struct hotSet *hotset);
+
+#endif
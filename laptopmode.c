@@ -0,0 +1,237 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Control of the kernel's laptop-mode write buffering.
+
+	While the heads are parked, writes are held in RAM for up to maxAge
+	seconds. While the daemon keeps the heads loaded, the original
+	writeback timing is used so dirty data goes out as the admin set it.
+	The original values are kept in the state directory while they are
+	taken over, so a daemon that was killed still finds them on the next
+	start, and they are put back on shutdown.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "laptopmode.h"
+
+// laptop-mode-tools uses 2, the seconds to wait after a read before flushing
+#define LAPTOP_MODE 2
+
+// room for dirty data while buffering, in percent of memory
+#define BUFFERED_DIRTY_RATIO 60
+#define BUFFERED_DIRTY_BACKGROUND_RATIO 50
+
+#define LAPTOP_MODE_FILE "laptop-mode"
+
+/*
+ Reads /proc/sys/vm/<name>. Returns the value, or -errno.
+ */
+long readVmValue(const char *name)
+{
+	char path[128], value[32];
+	int fd, len;
+
+	snprintf(path,128,"/proc/sys/vm/%s",name);
+	path[127] = 0;
+	fd = open(path,O_RDONLY);
+	if(fd < 0) return -errno;
+	len = read(fd,value,31);
+	close(fd);
+	if(len <= 0) return -EIO;
+	value[len] = 0;
+	return strtol(value,NULL,10);
+}
+
+int writeVmValue(const char *name,long value)
+{
+	char path[128], buffer[32];
+	int fd, len;
+
+	snprintf(path,128,"/proc/sys/vm/%s",name);
+	path[127] = 0;
+	fd = open(path,O_WRONLY);
+	if(fd < 0) return -errno;
+	len = snprintf(buffer,32,"%ld\n",value);
+	if(write(fd,buffer,len) != len) {
+		close(fd);
+		return -errno;
+	}
+	close(fd);
+	return 0;
+}
+
+int readLaptopMode(struct laptopModeSettings *settings)
+{
+	settings->laptopMode = readVmValue("laptop_mode");
+	settings->dirtyExpire = readVmValue("dirty_expire_centisecs");
+	settings->dirtyWriteback = readVmValue("dirty_writeback_centisecs");
+	settings->dirtyRatio = readVmValue("dirty_ratio");
+	settings->dirtyBytes = readVmValue("dirty_bytes");
+	settings->dirtyBackgroundRatio = readVmValue("dirty_background_ratio");
+	settings->dirtyBackgroundBytes = readVmValue("dirty_background_bytes");
+
+	if(settings->laptopMode < 0 || settings->dirtyExpire < 0 || settings->dirtyWriteback < 0 || settings->dirtyRatio < 0 ||
+		settings->dirtyBytes < 0 || settings->dirtyBackgroundRatio < 0 || settings->dirtyBackgroundBytes < 0)
+		return -ENOENT;
+	return 0;
+}
+
+/*
+ The kernel keeps either the ratio or the bytes of a dirty limit, writing
+ one clears the other. Writes the one in use.
+ */
+static int writeDirtyLimit(const char *ratioName,const char *bytesName,long ratio,long bytes)
+{
+	return bytes > 0 ? writeVmValue(bytesName,bytes) : writeVmValue(ratioName,ratio);
+}
+
+/*
+ Writes the settings in an order that never leaves a window where the
+ kernel flushes early: when buffering is switched on, room and timers are
+ raised before laptop_mode is set, and when it is switched off,
+ laptop_mode is cleared first. Returns 0, or -errno from the first failure.
+ */
+int writeLaptopMode(const struct laptopModeSettings *settings)
+{
+	int result = 0;
+
+	if(settings->laptopMode) {
+		if(!result) result = writeDirtyLimit("dirty_ratio","dirty_bytes",settings->dirtyRatio,settings->dirtyBytes);
+		if(!result) result = writeDirtyLimit("dirty_background_ratio","dirty_background_bytes",settings->dirtyBackgroundRatio,settings->dirtyBackgroundBytes);
+		if(!result) result = writeVmValue("dirty_expire_centisecs",settings->dirtyExpire);
+		if(!result) result = writeVmValue("dirty_writeback_centisecs",settings->dirtyWriteback);
+		if(!result) result = writeVmValue("laptop_mode",settings->laptopMode);
+	} else {
+		if(!result) result = writeVmValue("laptop_mode",settings->laptopMode);
+		if(!result) result = writeVmValue("dirty_writeback_centisecs",settings->dirtyWriteback);
+		if(!result) result = writeVmValue("dirty_expire_centisecs",settings->dirtyExpire);
+		if(!result) result = writeDirtyLimit("dirty_background_ratio","dirty_background_bytes",settings->dirtyBackgroundRatio,settings->dirtyBackgroundBytes);
+		if(!result) result = writeDirtyLimit("dirty_ratio","dirty_bytes",settings->dirtyRatio,settings->dirtyBytes);
+	}
+	return result;
+}
+
+/*
+ Settings for PARKED and IDLE: hold writes for up to maxAge seconds. Both
+ dirty limits are raised, or background writeback would start long before
+ the age is reached. Limits the admin set in bytes are replaced by ratios.
+ */
+void bufferedLaptopMode(const struct laptopModeSettings *original,int maxAge,struct laptopModeSettings *settings)
+{
+	settings->laptopMode = LAPTOP_MODE;
+	settings->dirtyExpire = maxAge * 100L;
+	settings->dirtyWriteback = maxAge * 100L;
+	settings->dirtyRatio = original->dirtyRatio > BUFFERED_DIRTY_RATIO ? original->dirtyRatio : BUFFERED_DIRTY_RATIO;
+	settings->dirtyBytes = 0;
+	settings->dirtyBackgroundRatio = original->dirtyBackgroundRatio > BUFFERED_DIRTY_BACKGROUND_RATIO ? original->dirtyBackgroundRatio : BUFFERED_DIRTY_BACKGROUND_RATIO;
+	if(settings->dirtyBackgroundRatio >= settings->dirtyRatio) settings->dirtyBackgroundRatio = settings->dirtyRatio - 1;
+	settings->dirtyBackgroundBytes = 0;
+}
+
+/*
+ Settings for ANTI-PARK: write back as the original settings would
+ */
+void promptLaptopMode(const struct laptopModeSettings *original,struct laptopModeSettings *settings)
+{
+	settings->laptopMode = 0;
+	settings->dirtyExpire = original->dirtyExpire;
+	settings->dirtyWriteback = original->dirtyWriteback;
+	settings->dirtyRatio = original->dirtyRatio;
+	settings->dirtyBytes = original->dirtyBytes;
+	settings->dirtyBackgroundRatio = original->dirtyBackgroundRatio;
+	settings->dirtyBackgroundBytes = original->dirtyBackgroundBytes;
+}
+
+/*
+ Saves the original settings before they are taken over.
+ Returns 0, or -errno.
+ */
+int saveLaptopMode(const char *stateDir,const struct laptopModeSettings *settings)
+{
+	char path[256], tmpPath[260];
+	FILE *out;
+
+	snprintf(path,256,"%s/" LAPTOP_MODE_FILE,stateDir);
+	path[255] = 0;
+	snprintf(tmpPath,260,"%s.tmp",path);
+
+	out = fopen(tmpPath,"w");
+	if(!out) return -errno;
+	fprintf(out,"# wdantiparkd original laptop mode (laptop_mode dirty_expire_centisecs dirty_writeback_centisecs dirty_ratio dirty_bytes dirty_background_ratio dirty_background_bytes)\n");
+	fprintf(out,"%ld %ld %ld %ld %ld %ld %ld\n",settings->laptopMode,settings->dirtyExpire,settings->dirtyWriteback,settings->dirtyRatio,
+		settings->dirtyBytes,settings->dirtyBackgroundRatio,settings->dirtyBackgroundBytes);
+	if(fclose(out) || rename(tmpPath,path) < 0) {
+		unlink(tmpPath);
+		return -errno;
+	}
+	return 0;
+}
+
+/*
+ Reads the original settings left behind by a daemon which did not get
+ to restore them. Limits missing from the files of older versions are
+ kept from settings. Returns 0, or -ENOENT if there are none.
+ */
+int loadLaptopMode(const char *stateDir,struct laptopModeSettings *settings)
+{
+	char path[256], line[256];
+	struct laptopModeSettings saved;
+	int result = -ENOENT;
+	FILE *in;
+
+	snprintf(path,256,"%s/" LAPTOP_MODE_FILE,stateDir);
+	path[255] = 0;
+
+	in = fopen(path,"r");
+	if(!in) return -ENOENT;
+	while(fgets(line,256,in)) {
+		int count;
+
+		if(line[0] == '#') continue;
+		// files of older versions have no byte or background limits, which they left alone
+		saved = *settings;
+		count = sscanf(line,"%ld %ld %ld %ld %ld %ld %ld",&saved.laptopMode,&saved.dirtyExpire,&saved.dirtyWriteback,&saved.dirtyRatio,
+			&saved.dirtyBytes,&saved.dirtyBackgroundRatio,&saved.dirtyBackgroundBytes);
+		if(count == 4) saved.dirtyBytes = 0;
+		if((count == 4 || count == 7) && saved.laptopMode >= 0 && saved.dirtyExpire >= 0 && saved.dirtyWriteback >= 0 && saved.dirtyRatio >= 0 &&
+			saved.dirtyBytes >= 0 && saved.dirtyBackgroundRatio >= 0 && saved.dirtyBackgroundBytes >= 0) {
+			*settings = saved;
+			result = 0;
+		}
+	}
+	fclose(in);
+	return result;
+}
+
+/*
+ Drops the saved settings once they are restored
+ */
+void forgetLaptopMode(const char *stateDir)
+{
+	char path[256];
+
+	snprintf(path,256,"%s/" LAPTOP_MODE_FILE,stateDir);
+	path[255] = 0;
+	unlink(path);
+}
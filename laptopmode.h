@@ -0,0 +1,47 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Control of the kernel's laptop-mode write buffering.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LAPTOPMODE_H
+#define LAPTOPMODE_H
+
+struct laptopModeSettings
+{
+	long laptopMode;
+	long dirtyExpire; // centisecs
+	long dirtyWriteback; // centisecs
+	long dirtyRatio; // percent, or 0 when dirtyBytes is set
+	long dirtyBytes;
+	long dirtyBackgroundRatio; // percent, or 0 when dirtyBackgroundBytes is set
+	long dirtyBackgroundBytes;
+};
+
+long readVmValue(const char *name);
+int writeVmValue(const char *name,long value);
+int readLaptopMode(struct laptopModeSettings *settings);
+int writeLaptopMode(const struct laptopModeSettings *settings);
+void bufferedLaptopMode(const struct laptopModeSettings *original,int maxAge,struct laptopModeSettings *settings);
+void promptLaptopMode(const struct laptopModeSettings *original,struct laptopModeSettings *settings);
+int saveLaptopMode(const char *stateDir,const struct laptopModeSettings *settings);
+int loadLaptopMode(const char *stateDir,struct laptopModeSettings *settings);
+void forgetLaptopMode(const char *stateDir);
+
+#endif
@@ -0,0 +1,413 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	State machine policy, compiled from a text description.
+
+	The states of the daemon, what each does on every tick and the rules
+	for moving between them are read from a policy file (--policy) and
+	compiled into a table at startup. On every tick the main loop collects
+	the facts of the tick as a bit mask, and the first transition of the
+	current state whose conditions are all set is taken. The built-in
+	ANTIPARK/PARKED/IDLE policy is itself written in this language, with
+	the timeouts from the command line filled in; --print-policy shows it
+	as a starting point for custom policies.
+
+	Syntax, one declaration per line, '#' starts a comment:
+
+	  state NAME [touch] [maintain] [preempt] [buffer] [extend] [standby]
+	             [flush=SEC] [poll=SEC] [timeout=SEC[:MAX]]
+	             [absorb=KB[:BUDGET]]
+	  FROM -> TO when COND[+COND...] [drain] [cycle] [backoff] [reset]
+	             [predict] [learn] [stats]
+
+	COND is one of activity, quiet, read, timeout and maxtimeout (the
+	state's timeout has run past its maximum), and with --diurnal the class
+	of the hour (normal, busy, dead) or prewake. Without --diurnal every
+	hour is normal. In a state with absorb, writes of up to KB without
+	reads are not activity, until BUDGET kB were absorbed since the heads
+	were last loaded. A standby state spins the disk down on entry, and
+	transitions into one also need the spindown condition, which holds
+	while the spin-up budget allows it. asleep holds while the drive
+	reports standby, which needs --power-poll. The first state is the
+	initial one, and states must be declared before they are used.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include "policy.h"
+
+#define MAX_POLICY_SIZE 8192
+
+struct keyword
+{
+	const char *name;
+	unsigned int bit;
+};
+
+static const struct keyword stateFlags[] = {
+	{ "touch", StateTouch },
+	{ "maintain", StateMaintain },
+	{ "preempt", StatePreempt },
+	{ "buffer", StateBuffer },
+	{ "extend", StateExtend },
+	{ "standby", StateStandby },
+	{ NULL, 0 }
+};
+
+static const struct keyword conditions[] = {
+	{ "activity", CondActivity },
+	{ "quiet", CondQuiet },
+	{ "read", CondRead },
+	{ "timeout", CondTimeout },
+	{ "maxtimeout", CondMaxTimeout },
+	{ "normal", CondNormal },
+	{ "busy", CondBusy },
+	{ "dead", CondDead },
+	{ "prewake", CondPrewake },
+	{ "spindown", CondSpindown },
+	{ "asleep", CondAsleep },
+	{ NULL, 0 }
+};
+
+static const struct keyword actions[] = {
+	{ "drain", ActionDrain },
+	{ "cycle", ActionCycle },
+	{ "backoff", ActionBackoff },
+	{ "reset", ActionReset },
+	{ "learn", ActionLearn },
+	{ "stats", ActionStats },
+	{ "predict", ActionPredict },
+	{ NULL, 0 }
+};
+
+static const char *builtinPolicyFormat =
+	"# built-in policy, from the command line options\n"
+	"state antipark touch maintain extend flush=30 timeout=%d:%d\n"
+	"state parked buffer preempt%s timeout=%d\n"
+	"state idle buffer preempt%s\n"
+	"antipark -> parked when timeout drain cycle\n"
+	"parked -> antipark when activity learn %s\n"
+	"parked -> idle when timeout%s\n"
+	"idle -> antipark when activity learn %s stats\n";
+
+// appended with --standby, after IDLE times out
+static const char *standbyPolicyFormat =
+	"state standby buffer standby\n"
+	"idle -> standby when timeout+spindown drain\n"
+	"standby -> antipark when activity learn %s stats\n"
+	"%s";
+
+// the same, with the hour classes of the learned schedule
+static const char *diurnalPolicyFormat =
+	"# built-in policy with the learned schedule, from the command line options\n"
+	"state antipark touch maintain extend flush=30 timeout=%d:%d\n"
+	"state parked buffer preempt%s timeout=%d\n"
+	"state idle buffer preempt%s\n"
+	"antipark -> parked when maxtimeout+busy drain cycle\n"
+	"antipark -> idle when timeout+dead drain cycle\n"
+	"antipark -> parked when timeout+normal drain cycle\n"
+	"parked -> antipark when activity learn %s\n"
+	"parked -> antipark when prewake\n"
+	"parked -> idle when dead\n"
+	"parked -> idle when timeout%s\n"
+	"idle -> antipark when activity learn %s stats\n"
+	"idle -> antipark when prewake reset\n";
+
+static unsigned int lookupKeyword(const struct keyword *keywords,const char *name)
+{
+	int i;
+	for(i = 0; keywords[i].name; i++) {
+		if(!strcmp(keywords[i].name,name)) return keywords[i].bit;
+	}
+	return 0;
+}
+
+static int findState(const struct policy *policy,const char *name)
+{
+	int i;
+	for(i = 0; i < policy->stateCount; i++) {
+		if(!strcmp(policy->states[i].name,name)) return i;
+	}
+	return -1;
+}
+
+static int parseSeconds(const char *value,int *seconds)
+{
+	char *end;
+	long result = strtol(value,&end,10);
+	if(end == value || result < 1 || result > 86400) return -1;
+	*seconds = result;
+	return end - value;
+}
+
+static int parseKb(const char *value,int *kb)
+{
+	char *end;
+	long result = strtol(value,&end,10);
+	if(end == value || result < 1 || result > 1048576) return -1;
+	*kb = result;
+	return end - value;
+}
+
+static int parseState(struct policy *policy,char *save,const char *source,int line)
+{
+	struct policyState *state;
+	char *token = strtok_r(NULL," \t",&save);
+	int i;
+
+	if(!token || strlen(token) >= sizeof(state->name)) {
+		fprintf(stderr,"%s:%d: Missing or too long state name.\n",source,line);
+		return -EINVAL;
+	}
+	if(findState(policy,token) >= 0) {
+		fprintf(stderr,"%s:%d: State '%s' declared twice.\n",source,line,token);
+		return -EINVAL;
+	}
+	if(policy->stateCount == MAX_POLICY_STATES) {
+		fprintf(stderr,"%s:%d: Too many states.\n",source,line);
+		return -EINVAL;
+	}
+
+	state = &policy->states[policy->stateCount++];
+	memset(state,0,sizeof(struct policyState));
+	strcpy(state->name,token);
+	for(i = 0; token[i]; i++) state->label[i] = toupper((unsigned char)token[i]);
+
+	while((token = strtok_r(NULL," \t",&save))) {
+		unsigned int flag = lookupKeyword(stateFlags,token);
+		int len;
+
+		if(flag) {
+			state->flags |= flag;
+		} else if(!strncmp(token,"flush=",6)) {
+			if(parseSeconds(token + 6,&state->flush) < 0) goto invalid;
+		} else if(!strncmp(token,"poll=",5)) {
+			if(parseSeconds(token + 5,&state->poll) < 0) goto invalid;
+		} else if(!strncmp(token,"absorb=",7)) {
+			len = parseKb(token + 7,&state->absorb);
+			if(len < 0) goto invalid;
+			state->absorbBudget = state->absorb;
+			if(token[7 + len] == ':' && parseKb(token + 8 + len,&state->absorbBudget) < 0) goto invalid;
+			if(state->absorbBudget < state->absorb) goto invalid;
+		} else if(!strncmp(token,"timeout=",8)) {
+			len = parseSeconds(token + 8,&state->timeout);
+			if(len < 0) goto invalid;
+			state->timeoutMax = state->timeout;
+			if(token[8 + len] == ':' && parseSeconds(token + 9 + len,&state->timeoutMax) < 0) goto invalid;
+			if(state->timeoutMax < state->timeout) goto invalid;
+		} else {
+			goto invalid;
+		}
+	}
+	return 0;
+
+invalid:
+	fprintf(stderr,"%s:%d: Invalid state option '%s'.\n",source,line,token);
+	return -EINVAL;
+}
+
+static int parseTransition(struct policy *policy,const char *fromName,char *save,const char *source,int line)
+{
+	struct policyTransition *transition;
+	char *token, *cond, *condSave;
+
+	if(policy->transitionCount == MAX_POLICY_TRANSITIONS) {
+		fprintf(stderr,"%s:%d: Too many transitions.\n",source,line);
+		return -EINVAL;
+	}
+	transition = &policy->transitions[policy->transitionCount];
+	memset(transition,0,sizeof(struct policyTransition));
+
+	transition->from = findState(policy,fromName);
+	token = strtok_r(NULL," \t",&save);
+	if(!token || strcmp(token,"->")) {
+		fprintf(stderr,"%s:%d: Expected 'state' or '->'.\n",source,line);
+		return -EINVAL;
+	}
+	token = strtok_r(NULL," \t",&save);
+	transition->to = token ? findState(policy,token) : -1;
+	if(transition->from < 0 || transition->to < 0) {
+		fprintf(stderr,"%s:%d: Transition between undeclared states.\n",source,line);
+		return -EINVAL;
+	}
+
+	token = strtok_r(NULL," \t",&save);
+	if(!token || strcmp(token,"when") || !(token = strtok_r(NULL," \t",&save))) {
+		fprintf(stderr,"%s:%d: Expected 'when' and a condition.\n",source,line);
+		return -EINVAL;
+	}
+	for(cond = strtok_r(token,"+",&condSave); cond; cond = strtok_r(NULL,"+",&condSave)) {
+		unsigned int bit = lookupKeyword(conditions,cond);
+		if(!bit) {
+			fprintf(stderr,"%s:%d: Unknown condition '%s'.\n",source,line,cond);
+			return -EINVAL;
+		}
+		transition->conditions |= bit;
+	}
+	if((transition->conditions & (CondTimeout | CondMaxTimeout)) && !policy->states[transition->from].timeout) {
+		fprintf(stderr,"%s:%d: State '%s' has no timeout.\n",source,line,fromName);
+		return -EINVAL;
+	}
+	
+	// spindowns are always rationed
+	if((policy->states[transition->to].flags & StateStandby) && !(policy->states[transition->from].flags & StateStandby))
+		transition->conditions |= CondSpindown;
+
+	while((token = strtok_r(NULL," \t",&save))) {
+		unsigned int bit = lookupKeyword(actions,token);
+		if(!bit) {
+			fprintf(stderr,"%s:%d: Unknown action '%s'.\n",source,line,token);
+			return -EINVAL;
+		}
+		transition->actions |= bit;
+	}
+
+	policy->transitionCount++;
+	return 0;
+}
+
+/*
+ Compiles the policy text. Transitions are grouped by their state, in the
+ order they were given, so a tick only looks at the current state's.
+ Returns 0, or -EINVAL with the error reported.
+ */
+int compilePolicy(const char *text,const char *source,struct policy *policy)
+{
+	char *copy, *lineText, *lineSave;
+	int line = 0, result = 0, i, j;
+
+	memset(policy,0,sizeof(struct policy));
+	strncpy(policy->source,source,128);
+	policy->source[127] = 0;
+
+	copy = strdup(text);
+	if(!copy) return -ENOMEM;
+
+	for(lineText = strtok_r(copy,"\n",&lineSave); lineText && !result; lineText = strtok_r(NULL,"\n",&lineSave)) {
+		char *comment = strchr(lineText,'#'), *token, *save;
+
+		line++;
+		if(comment) *comment = 0;
+		token = strtok_r(lineText," \t\r",&save);
+		if(!token) continue;
+
+		if(!strcmp(token,"state")) result = parseState(policy,save,source,line);
+		else result = parseTransition(policy,token,save,source,line);
+	}
+	free(copy);
+	if(result) return result;
+
+	if(!policy->stateCount) {
+		fprintf(stderr,"%s: No states declared.\n",source);
+		return -EINVAL;
+	}
+
+	// group the transitions by state, keeping their order
+	for(i = 1; i < policy->transitionCount; i++) {
+		struct policyTransition transition = policy->transitions[i];
+		for(j = i; j > 0 && policy->transitions[j - 1].from > transition.from; j--) policy->transitions[j] = policy->transitions[j - 1];
+		policy->transitions[j] = transition;
+	}
+	for(i = 0; i < policy->transitionCount; i++) {
+		struct policyState *state = &policy->states[policy->transitions[i].from];
+		if(!state->transitionCount) state->firstTransition = i;
+		state->transitionCount++;
+	}
+	return 0;
+}
+
+int loadPolicy(const char *path,struct policy *policy)
+{
+	char *text;
+	FILE *in;
+	size_t len;
+	int result;
+
+	in = fopen(path,"r");
+	if(!in) {
+		fprintf(stderr,"Failed to open policy '%s'.\n",path);
+		return -errno;
+	}
+	text = malloc(MAX_POLICY_SIZE);
+	if(!text) {
+		fclose(in);
+		return -ENOMEM;
+	}
+	len = fread(text,1,MAX_POLICY_SIZE - 1,in);
+	fclose(in);
+	text[len] = 0;
+
+	result = compilePolicy(text,path,policy);
+	free(text);
+	return result;
+}
+
+int formatBuiltinPolicy(const struct wdAntiParkConfig *config,char *buffer,int max)
+{
+	char absorb[64] = "", idle[96];
+	int len;
+
+	if(config->absorbWrites) snprintf(absorb,64," absorb=%d:%d",config->absorbWrites,config->absorbBudget);
+	snprintf(idle,96,config->standbyTimeout ? "%s timeout=%d" : "%s",absorb,config->standbyTimeout);
+	len = snprintf(buffer,max,config->diurnal ? diurnalPolicyFormat : builtinPolicyFormat,config->antiParkTimeout,config->antiParkTimeoutMax,
+				   absorb,config->parkedTimeout,idle,config->predictiveTimeout ? "predict" : "backoff",
+				   config->syncBeforeIdle ? " drain cycle" : "",config->predictiveTimeout ? "predict" : "reset");
+	if(config->standbyTimeout && len >= 0 && len < max) {
+		len += snprintf(buffer + len,max - len,standbyPolicyFormat,config->predictiveTimeout ? "predict" : "reset",
+						config->diurnal ? "standby -> antipark when prewake reset\n" : "");
+	}
+	return len;
+}
+
+int builtinPolicy(const struct wdAntiParkConfig *config,struct policy *policy)
+{
+	char text[2048];
+	formatBuiltinPolicy(config,text,2048);
+	return compilePolicy(text,"built-in",policy);
+}
+
+/*
+ Returns 1 if any state of the policy has the flag.
+ */
+int policyHasFlag(const struct policy *policy,unsigned int flag)
+{
+	int i;
+	for(i = 0; i < policy->stateCount; i++) {
+		if(policy->states[i].flags & flag) return 1;
+	}
+	return 0;
+}
+
+/*
+ Returns the first transition out of state whose conditions all hold, or
+ NULL to stay.
+ */
+const struct policyTransition *matchTransition(const struct policy *policy,int state,unsigned int conditions)
+{
+	const struct policyTransition *transition = policy->transitions + policy->states[state].firstTransition;
+	const struct policyTransition *end = transition + policy->states[state].transitionCount;
+
+	for(; transition < end; transition++) {
+		if(!(transition->conditions & ~conditions)) return transition;
+	}
+	return NULL;
+}
@@ -0,0 +1,109 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	State machine policy, compiled from a text description.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "wdantiparkd.h"
+
+#define MAX_POLICY_STATES 8
+#define MAX_POLICY_TRANSITIONS 32
+
+// what a state does on every tick
+enum PolicyStateFlag
+{
+	StateTouch = 1, // keep the heads loaded by touching the disk
+	StateMaintain = 2, // heads loaded, fill and refresh the caches
+	StatePreempt = 4, // flush ahead of kernel writeback
+	StateBuffer = 8, // buffer writes in RAM (laptop mode)
+	StateExtend = 16, // reads restart the state's timeout
+	StateStandby = 32 // spin the disk down on entry
+};
+
+// facts about the current tick, a transition needs all of its own
+enum PolicyCondition
+{
+	CondActivity = 1, // organic I/O, or a read on an array sibling
+	CondQuiet = 2, // no activity
+	CondRead = 4,
+	CondTimeout = 8, // the state's timeout expired
+	CondMaxTimeout = 16, // the state's longest timeout expired
+	CondNormal = 32, // class of the hour in the learned schedule
+	CondBusy = 64,
+	CondDead = 128,
+	CondPrewake = 256, // a busy hour is about to start
+	CondSpindown = 512, // the spin-up budget allows a spindown
+	CondAsleep = 1024 // the drive reports standby, with --power-poll
+};
+
+// done when a transition is taken
+enum PolicyAction
+{
+	ActionDrain = 1, // flush and wait for the writeback to drain
+	ActionCycle = 2, // count a load cycle
+	ActionBackoff = 4, // double the timeout of the new state
+	ActionReset = 8, // reset the timeout of the new state
+	ActionLearn = 16, // learn the files that woke the disk
+	ActionStats = 32, // report the stats
+	ActionPredict = 64 // timeout of the new state from the idle-gap model
+};
+
+struct policyTransition
+{
+	int from;
+	int to;
+	unsigned int conditions;
+	unsigned int actions;
+};
+
+struct policyState
+{
+	char name[16];
+	char label[16]; // name in upper case, for the log
+	unsigned int flags;
+	int flush; // seconds between periodic flushes, 0 for none
+	int poll; // seconds between ticks, 0 for the default
+	int timeout;
+	int timeoutMax;
+	int absorb; // largest write in kB that does not count as activity, 0 for none
+	int absorbBudget; // kB absorbed until the heads are loaded again
+	int firstTransition;
+	int transitionCount;
+};
+
+struct policy
+{
+	char source[128];
+	int stateCount;
+	struct policyState states[MAX_POLICY_STATES];
+	int transitionCount;
+	struct policyTransition transitions[MAX_POLICY_TRANSITIONS];
+};
+
+int compilePolicy(const char *text,const char *source,struct policy *policy);
+int loadPolicy(const char *path,struct policy *policy);
+int formatBuiltinPolicy(const struct wdAntiParkConfig *config,char *buffer,int max);
+int builtinPolicy(const struct wdAntiParkConfig *config,struct policy *policy);
+int policyHasFlag(const struct policy *policy,unsigned int flag);
+const struct policyTransition *matchTransition(const struct policy *policy,int state,unsigned int conditions);
+
+#endif
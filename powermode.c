@@ -0,0 +1,88 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Polling of the drive's power mode with CHECK POWER MODE.
+
+	The I/O counters only show what the daemon and others asked of the
+	disk, not what the drive did about it. A drive may have been spun down
+	by its own standby timer or by someone running hdparm -y. CHECK POWER
+	MODE is the one command a drive answers without spinning up, so it is
+	polled every few seconds. A touch on a drive found in standby would
+	only spin it up again, so touches are skipped while it sleeps, and the
+	policy sees the asleep condition. The time spent in each mode is kept
+	for the stats.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "wdantiparkd.h"
+#include "powermode.h"
+
+void powerInit(struct powerMonitor *power,struct ataDevice *ata,int interval)
+{
+	memset(power,0,sizeof(struct powerMonitor));
+	power->ata = ata;
+	power->interval = interval;
+	power->mode = -1;
+}
+
+/*
+ Polls the power mode once the interval has passed, or right away with
+ force. Polling stops for good if the drive does not answer.
+ Returns the last known AtaPowerMode, or -1 if unknown.
+ */
+int powerPoll(struct powerMonitor *power,int force,int verbose)
+{
+	long long now = monotonicTimeMs();
+	int mode;
+
+	if(!power->interval) return -1;
+	if(!force && power->lastPoll && now - power->lastPoll < power->interval * 1000LL) return power->mode;
+
+	mode = ataCheckPowerMode(power->ata);
+	if(mode < 0) {
+		fprintf(stderr,"%s does not report its power mode through %s, polling stopped.\n",power->ata->disk,ataBackendName(power->ata->backend));
+		power->interval = 0;
+		power->mode = -1;
+		return -1;
+	}
+
+	if(power->mode >= 0) power->modeTime[power->mode] += now - power->lastPoll;
+	if(mode != power->mode) {
+		if(mode == PowerStandby && power->mode >= 0) power->spindownsSeen++;
+		if(verbose) {
+			printf("[%s] %s reports power mode %s.\n",formatCurrentTime(NULL,0),power->ata->disk,ataPowerModeName(mode));
+			fflush(stdout);
+		}
+	}
+	power->mode = mode;
+	power->lastPoll = now;
+	power->polls++;
+	return mode;
+}
+
+void powerReport(const struct powerMonitor *power)
+{
+	long long total = power->modeTime[PowerStandby] + power->modeTime[PowerIdle] + power->modeTime[PowerActive];
+
+	if(total < 1) total = 1;
+	printf("[%s] Power - mode: %s, polls: %lu, standby: %lld%%, idle: %lld%%, active: %lld%%, spindowns seen: %lu, touches skipped: %lu\n",
+		   formatCurrentTime(NULL,0),ataPowerModeName(power->mode),power->polls,power->modeTime[PowerStandby] * 100 / total,
+		   power->modeTime[PowerIdle] * 100 / total,power->modeTime[PowerActive] * 100 / total,power->spindownsSeen,power->touchesSkipped);
+}
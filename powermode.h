@@ -0,0 +1,46 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Polling of the drive's power mode with CHECK POWER MODE.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POWERMODE_H
+#define POWERMODE_H
+
+#include "ata.h"
+
+struct powerMonitor
+{
+	struct ataDevice *ata;
+	int interval; // seconds between polls, 0 once polling failed
+	int mode; // AtaPowerMode, -1 before the first poll
+	long long lastPoll;
+	long long modeTime[PowerActive + 1]; // ms in each mode
+
+	unsigned long polls;
+	unsigned long spindownsSeen; // by the daemon or anyone else
+	unsigned long touchesSkipped;
+};
+
+void powerInit(struct powerMonitor *power,struct ataDevice *ata,int interval);
+int powerPoll(struct powerMonitor *power,int force,int verbose);
+void powerReport(const struct powerMonitor *power);
+
+#endif
@@ -0,0 +1,396 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Learns what is read after a wake and reads it ahead on the next one.
+
+	When a read wakes the disk, it is usually followed by a predictable set
+	of further reads, such as a media scan or a backup agent going through
+	its catalogue. The files opened within --prefetch seconds of a wake are
+	recorded as a sequence, keyed by the first file opened. On a later wake
+	by the same file, the rest of the sequence is read ahead right away in
+	one POSIX_FADV_WILLNEED burst, sorted by physical location (FIEMAP) so
+	the disk serves it in one sweep. The disk is then done quickly and can
+	park again, instead of being kept awake by a trickle of reads.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/fanotify.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#include "wdantiparkd.h"
+#include "flush.h"
+#include "prefetch.h"
+
+/*
+ Keeps path once in the pool of the prefetcher, however many sequences list
+ it. Returns its index with one more reference, or -1 when the pool is full.
+ */
+static int internPath(struct prefetcher *prefetcher,const char *path)
+{
+	int i, slot = -1;
+
+	for(i = 0; i < prefetcher->pathCount; i++) {
+		if(!prefetcher->paths[i]) {
+			if(slot < 0) slot = i;
+		} else if(!strcmp(prefetcher->paths[i],path)) {
+			prefetcher->pathRefs[i]++;
+			return i;
+		}
+	}
+	if(slot < 0) {
+		if(prefetcher->pathCount == MAX_PREFETCH_PATHS) return -1;
+		slot = prefetcher->pathCount++;
+	}
+	prefetcher->paths[slot] = strdup(path);
+	if(!prefetcher->paths[slot]) return -1;
+	prefetcher->pathRefs[slot] = 1;
+	return slot;
+}
+
+// index of path in the pool, -1 if nothing lists it
+static int findPath(struct prefetcher *prefetcher,const char *path)
+{
+	int i;
+	for(i = 0; i < prefetcher->pathCount; i++) {
+		if(prefetcher->paths[i] && !strcmp(prefetcher->paths[i],path)) return i;
+	}
+	return -1;
+}
+
+static void releasePath(struct prefetcher *prefetcher,int path)
+{
+	if(path < 0 || --prefetcher->pathRefs[path]) return;
+	free(prefetcher->paths[path]);
+	prefetcher->paths[path] = NULL;
+}
+
+static void releaseSequence(struct prefetcher *prefetcher,struct prefetchSequence *sequence)
+{
+	int i;
+	releasePath(prefetcher,sequence->trigger);
+	for(i = 0; i < sequence->count; i++) releasePath(prefetcher,sequence->files[i]);
+	sequence->trigger = -1;
+	sequence->count = 0;
+}
+
+static int hasFile(const struct prefetchSequence *sequence,int path)
+{
+	int i;
+	if(path < 0) return 0;
+	for(i = 0; i < sequence->count; i++) {
+		if(sequence->files[i] == path) return 1;
+	}
+	return 0;
+}
+
+static struct prefetchSequence *findSequence(struct prefetcher *prefetcher,int trigger)
+{
+	int i;
+	if(trigger < 0) return NULL;
+	for(i = 0; i < prefetcher->count; i++) {
+		if(prefetcher->sequences[i].trigger == trigger) return &prefetcher->sequences[i];
+	}
+	return NULL;
+}
+
+/*
+ Physical byte offset of the start of the file on the disk, 0 if the
+ filesystem can't tell.
+ */
+static unsigned long long physicalOffset(int fd)
+{
+	struct {
+		struct fiemap map;
+		struct fiemap_extent extent;
+	} request;
+
+	memset(&request,0,sizeof(request));
+	request.map.fm_length = FIEMAP_MAX_OFFSET;
+	request.map.fm_extent_count = 1;
+	if(ioctl(fd,FS_IOC_FIEMAP,&request.map) < 0 || !request.map.fm_mapped_extents) return 0;
+	return request.extent.fe_physical;
+}
+
+static int compareOffsets(const void *a,const void *b)
+{
+	const struct prefetchFile *fileA = a, *fileB = b;
+	if(fileA->physical < fileB->physical) return -1;
+	return fileA->physical > fileB->physical;
+}
+
+static int openNoAtime(const char *path)
+{
+	int fd = open(path,O_RDONLY | O_NOATIME | O_CLOEXEC);
+	if(fd < 0 && errno == EPERM) fd = open(path,O_RDONLY | O_CLOEXEC);
+	return fd;
+}
+
+// drops what is left of the burst
+static void releaseBurst(struct prefetcher *prefetcher)
+{
+	int i;
+	for(i = prefetcher->burstLocated ? prefetcher->burstNext : 0; i < prefetcher->burstCount; i++) releasePath(prefetcher,prefetcher->burst[i].path);
+	prefetcher->burstCount = 0;
+	prefetcher->burstNext = 0;
+	prefetcher->burstLocated = 0;
+}
+
+/*
+ Queues the files of the sequence for reading ahead, replacing the burst of
+ an earlier wake. Returns the number of files queued.
+ */
+static int startBurst(struct prefetcher *prefetcher,const struct prefetchSequence *sequence)
+{
+	int i;
+
+	releaseBurst(prefetcher);
+	prefetcher->burstBudget = prefetcher->budget;
+	for(i = 0; i < sequence->count; i++) {
+		if(sequence->files[i] == sequence->trigger) continue;
+		prefetcher->pathRefs[sequence->files[i]]++;
+		prefetcher->burst[prefetcher->burstCount].path = sequence->files[i];
+		prefetcher->burst[prefetcher->burstCount].physical = 0;
+		prefetcher->burstCount++;
+	}
+	return prefetcher->burstCount;
+}
+
+/*
+ Goes on with the burst for up to max files: each is located on the disk
+ first, then all are read ahead in disk order, up to the budget.
+ Returns the number of files read ahead.
+ */
+static int readAhead(struct prefetcher *prefetcher,int max)
+{
+	int issued = 0;
+
+	for(; max > 0 && prefetcher->burstNext < prefetcher->burstCount; max--) {
+		struct prefetchFile *file = &prefetcher->burst[prefetcher->burstNext++];
+		int fd = file->path < 0 ? -1 : openNoAtime(prefetcher->paths[file->path]);
+
+		if(!prefetcher->burstLocated) {
+			if(fd >= 0) file->physical = physicalOffset(fd);
+			else {
+				releasePath(prefetcher,file->path);
+				file->path = -1;
+			}
+			if(prefetcher->burstNext == prefetcher->burstCount) {
+				qsort(prefetcher->burst,prefetcher->burstCount,sizeof(struct prefetchFile),compareOffsets);
+				prefetcher->burstLocated = 1;
+				prefetcher->burstNext = 0;
+			}
+		} else {
+			struct stat st;
+			if(fd >= 0 && fstat(fd,&st) == 0 && S_ISREG(st.st_mode)) {
+				off_t len = st.st_size < prefetcher->burstBudget ? st.st_size : prefetcher->burstBudget;
+				if(posix_fadvise(fd,0,len,POSIX_FADV_WILLNEED) == 0) {
+					prefetcher->burstBudget -= len;
+					issued++;
+				}
+			}
+			releasePath(prefetcher,file->path);
+		}
+		if(fd >= 0) close(fd);
+	}
+
+	if(prefetcher->burstLocated && (prefetcher->burstNext == prefetcher->burstCount || prefetcher->burstBudget <= 0)) releaseBurst(prefetcher);
+	prefetcher->filesPrefetched += issued;
+	return issued;
+}
+
+/*
+ Keeps the recorded sequence, replacing the one of the same trigger, or
+ the least recently used one when all slots are taken.
+ */
+static void storeRecording(struct prefetcher *prefetcher)
+{
+	struct prefetchSequence *sequence;
+	unsigned long uses = 0;
+	int i;
+
+	prefetcher->recordUntil = 0;
+	prefetcher->prefetched = -1;
+	if(prefetcher->recording.count < 2) {
+		releaseSequence(prefetcher,&prefetcher->recording);
+		return;
+	}
+
+	sequence = findSequence(prefetcher,prefetcher->recording.trigger);
+	if(sequence) {
+		uses = sequence->uses;
+		releaseSequence(prefetcher,sequence);
+	} else if(prefetcher->count < MAX_SEQUENCES) sequence = &prefetcher->sequences[prefetcher->count++];
+	else {
+		sequence = &prefetcher->sequences[0];
+		for(i = 1; i < prefetcher->count; i++) {
+			if(prefetcher->sequences[i].lastUsed < sequence->lastUsed) sequence = &prefetcher->sequences[i];
+		}
+		releaseSequence(prefetcher,sequence);
+	}
+
+	// the sequence takes over the references of the recording
+	*sequence = prefetcher->recording;
+	sequence->uses = uses;
+	sequence->lastUsed = monotonicTimeMs();
+	prefetcher->recording.trigger = -1;
+	prefetcher->recording.count = 0;
+}
+
+struct prefetcher *prefetchOpen(const char *disk,int window,int budgetMb)
+{
+	struct prefetcher *prefetcher;
+
+	if(!window) return NULL;
+
+	prefetcher = calloc(1,sizeof(struct prefetcher));
+	if(!prefetcher) return NULL;
+	prefetcher->window = window;
+	prefetcher->budget = (long long)budgetMb << 20;
+	prefetcher->prefetched = -1;
+	prefetcher->recording.trigger = -1;
+	strncpy(prefetcher->disk,disk,16);
+	prefetcher->disk[15] = 0;
+
+	prefetcher->fanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_NONBLOCK | FAN_CLOEXEC,O_RDONLY | O_LARGEFILE | O_NOATIME);
+	if(prefetcher->fanotifyFd < 0) {
+		fprintf(stderr,"Failed to set up fanotify, prefetch disabled (root required).\n");
+		free(prefetcher);
+		return NULL;
+	}
+
+	markDiskMounts(prefetcher->fanotifyFd,disk,FAN_OPEN,"prefetch",&prefetcher->lastMark);
+	return prefetcher;
+}
+
+/*
+ Goes on with the burst of the last wake, collects the files opened since
+ the previous tick, and adds them to the sequence being recorded.
+ */
+void prefetchPoll(struct prefetcher *prefetcher)
+{
+	char buffer[4096];
+	ssize_t len;
+	pid_t self = getpid();
+	int i;
+
+	if(prefetcher->burstCount) readAhead(prefetcher,PREFETCH_FILES_PER_TICK);
+
+	prefetcher->tickOpenCount = 0;
+	markDiskMounts(prefetcher->fanotifyFd,prefetcher->disk,FAN_OPEN,"prefetch",&prefetcher->lastMark);
+	while((len = read(prefetcher->fanotifyFd,buffer,sizeof(buffer))) > 0) {
+		struct fanotify_event_metadata *event = (struct fanotify_event_metadata *)buffer;
+
+		for(; FAN_EVENT_OK(event,len); event = FAN_EVENT_NEXT(event,len)) {
+			char link[64], path[256];
+			int pathLen;
+
+			if(event->fd < 0) continue;
+			if(event->pid == self) {
+				close(event->fd);
+				continue;
+			}
+
+			snprintf(link,64,"/proc/self/fd/%d",event->fd);
+			pathLen = readlink(link,path,255);
+			close(event->fd);
+			if(pathLen <= 0) continue;
+			path[pathLen] = 0;
+
+			for(i = 0; i < prefetcher->tickOpenCount; i++) {
+				if(!strcmp(prefetcher->tickOpens[i],path)) break;
+			}
+			if(i == prefetcher->tickOpenCount && prefetcher->tickOpenCount < MAX_PREFETCH_TICK_OPENS)
+				strcpy(prefetcher->tickOpens[prefetcher->tickOpenCount++],path);
+		}
+	}
+
+	if(!prefetcher->recordUntil) return;
+
+	for(i = 0; i < prefetcher->tickOpenCount; i++) {
+		struct prefetchSequence *recording = &prefetcher->recording;
+		int path;
+
+		if(hasFile(recording,findPath(prefetcher,prefetcher->tickOpens[i])) || recording->count == MAX_SEQUENCE_FILES) continue;
+		path = internPath(prefetcher,prefetcher->tickOpens[i]);
+		if(path < 0) continue;
+		recording->files[recording->count++] = path;
+
+		// a file read ahead on this wake that was then really opened
+		if(prefetcher->prefetched >= 0 && hasFile(&prefetcher->sequences[prefetcher->prefetched],path))
+			prefetcher->hits++;
+	}
+	if(monotonicTimeMs() >= prefetcher->recordUntil) storeRecording(prefetcher);
+}
+
+/*
+ A read just woke the disk: reads ahead what followed the same trigger
+ before, and starts recording what follows this time.
+ */
+void prefetchWake(struct prefetcher *prefetcher,int verbose)
+{
+	struct prefetchSequence *sequence = NULL;
+	int i;
+
+	prefetcher->wakes++;
+	if(prefetcher->recordUntil) storeRecording(prefetcher);
+	if(!prefetcher->tickOpenCount) return;
+
+	for(i = 0; i < prefetcher->tickOpenCount && !sequence; i++) sequence = findSequence(prefetcher,findPath(prefetcher,prefetcher->tickOpens[i]));
+
+	prefetcher->recording.trigger = sequence ? sequence->trigger : internPath(prefetcher,prefetcher->tickOpens[0]);
+	if(sequence) prefetcher->pathRefs[sequence->trigger]++;
+	for(i = 0; i < prefetcher->tickOpenCount; i++) {
+		int path = internPath(prefetcher,prefetcher->tickOpens[i]);
+		if(path >= 0) prefetcher->recording.files[prefetcher->recording.count++] = path;
+	}
+	prefetcher->recordUntil = monotonicTimeMs() + prefetcher->window * 1000LL;
+
+	if(sequence) {
+		int files = startBurst(prefetcher,sequence);
+
+		// the rest is read ahead over the next ticks
+		readAhead(prefetcher,PREFETCH_FILES_PER_TICK);
+		sequence->uses++;
+		sequence->lastUsed = monotonicTimeMs();
+		prefetcher->prefetched = sequence - prefetcher->sequences;
+		prefetcher->bursts++;
+
+		if(verbose) {
+			printf("[%s] Reading ahead %d files that followed %s before.\n",formatCurrentTime(NULL,0),files,prefetcher->paths[sequence->trigger]);
+			fflush(stdout);
+		}
+	}
+}
+
+void prefetchClose(struct prefetcher *prefetcher)
+{
+	int i;
+
+	if(!prefetcher) return;
+	for(i = 0; i < prefetcher->pathCount; i++) free(prefetcher->paths[i]);
+	close(prefetcher->fanotifyFd);
+	free(prefetcher);
+}
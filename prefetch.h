@@ -0,0 +1,94 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Learns what is read after a wake and reads it ahead on the next one.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#define MAX_SEQUENCES 32
+#define MAX_SEQUENCE_FILES 64
+#define MAX_PREFETCH_TICK_OPENS 64
+
+// the sequences, the recording and the burst each list a path at most once
+#define MAX_PREFETCH_PATHS ((MAX_SEQUENCES + 2) * MAX_SEQUENCE_FILES)
+
+// files located or read ahead per tick, a burst goes on over the next ticks
+#define PREFETCH_FILES_PER_TICK 16
+
+// files read within the window after a wake that started with trigger,
+// as indexes into the path pool of the prefetcher
+struct prefetchSequence
+{
+	int trigger;
+	int count;
+	int files[MAX_SEQUENCE_FILES];
+	unsigned long uses;
+	long long lastUsed;
+};
+
+struct prefetchFile
+{
+	int path;
+	unsigned long long physical;
+};
+
+struct prefetcher
+{
+	int fanotifyFd;
+	char disk[16];
+	long long lastMark;
+	int window; // seconds recorded after a wake
+	long long budget; // bytes read ahead per wake
+
+	int tickOpenCount;
+	char tickOpens[MAX_PREFETCH_TICK_OPENS][256];
+
+	long long recordUntil; // 0 when not recording
+	struct prefetchSequence recording;
+	int prefetched; // sequence read ahead on this wake, -1 for none
+
+	// the read-ahead of the last wake, located first, then issued in disk order
+	int burstCount;
+	int burstNext;
+	int burstLocated;
+	long long burstBudget;
+	struct prefetchFile burst[MAX_SEQUENCE_FILES];
+
+	unsigned long wakes;
+	unsigned long bursts;
+	unsigned long filesPrefetched;
+	unsigned long hits;
+
+	int count;
+	struct prefetchSequence sequences[MAX_SEQUENCES];
+
+	// each path kept once, freed when nothing lists it anymore
+	int pathCount;
+	char *paths[MAX_PREFETCH_PATHS];
+	int pathRefs[MAX_PREFETCH_PATHS];
+};
+
+struct prefetcher *prefetchOpen(const char *disk,int window,int budgetMb);
+void prefetchPoll(struct prefetcher *prefetcher);
+void prefetchWake(struct prefetcher *prefetcher,int verbose);
+void prefetchClose(struct prefetcher *prefetcher);
+
+#endif
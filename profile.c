@@ -0,0 +1,212 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Settings per drive model, built in or from a drop-in file.
+
+	Drive families differ in their head unload timer, load cycle rating
+	and in how well they take writes. A profile is picked for the disk at
+	startup by its vendor, model and firmware from /sys/block, and fills
+	in the touch interval, timeouts, touch engine and cycle rating, unless
+	they were given on the command line. A calibrated interval still wins
+	over the profile's. Profiles from the drop-in file (--profiles) are
+	tried before the built-in ones, one per line:
+
+	  NAME [vendor=GLOB] [model=GLOB] [firmware=GLOB] [interval=SEC]
+	       [timeout=SEC[:MAX]] [parked=SEC] [touch=write|read] [rating=N]
+
+	A GLOB with spaces is put in double quotes, '#' starts a comment.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include "diskinfo.h"
+#include "touch.h"
+#include "profile.h"
+
+// WD idle3 timers are 8s on desktop drives and 300s on Reds out of the box
+static const struct driveProfile builtinProfiles[] = {
+	{ "wd-green", "", "WDC WD*EADS*", "", 7, 0, 0, 0, TouchWrite, 300000 },
+	{ "wd-green", "", "WDC WD*EARS*", "", 7, 0, 0, 0, TouchWrite, 300000 },
+	{ "wd-green", "", "WDC WD*EARX*", "", 7, 0, 0, 0, TouchWrite, 300000 },
+	{ "wd-green", "", "WDC WD*EZRX*", "", 7, 0, 0, 0, TouchWrite, 300000 },
+	{ "wd-blue", "", "WDC WD*EZRZ*", "", 7, 0, 0, 0, TouchWrite, 300000 },
+	{ "wd-blue-smr", "", "WDC WD*EZAZ*", "", 7, 0, 0, 0, TouchRead, 300000 },
+	{ "wd-red", "", "WDC WD*EFRX*", "", 270, 600, 1800, 900, TouchWrite, 600000 },
+	{ "wd-red-smr", "", "WDC WD*EFAX*", "", 270, 600, 1800, 900, TouchRead, 600000 },
+	{ "hgst-ultrastar", "", "HGST HU[SH]*", "", 0, 0, 0, 0, -1, 600000 },
+	{ "seagate-smr", "", "ST*DM004*", "", 0, 0, 0, 0, TouchRead, 0 },
+	{ "seagate-smr", "", "ST8000AS0002*", "", 0, 0, 0, 0, TouchRead, 0 },
+	{ "", "", "", "", 0, 0, 0, 0, -1, 0 }
+};
+
+struct driveIdentity
+{
+	char vendor[64];
+	char model[64];
+	char firmware[64];
+};
+
+static int matchesPattern(const char *pattern,const char *value)
+{
+	return !pattern[0] || !fnmatch(pattern,value,0);
+}
+
+static int matchesDrive(const struct driveProfile *profile,const struct driveIdentity *id)
+{
+	return matchesPattern(profile->vendor,id->vendor) && matchesPattern(profile->model,id->model) && matchesPattern(profile->firmware,id->firmware);
+}
+
+/*
+ Splits off the next token at blanks, keeping blanks inside double quotes
+ and dropping the quotes. Returns NULL at the end of the line.
+ */
+static char *nextToken(char **line)
+{
+	char *in = *line, *out, *token;
+	int quoted = 0;
+
+	while(*in == ' ' || *in == '\t') in++;
+	if(!*in) return NULL;
+
+	token = out = in;
+	for(; *in && (quoted || (*in != ' ' && *in != '\t')); in++) {
+		if(*in == '"') quoted = !quoted;
+		else *out++ = *in;
+	}
+	if(*in) in++;
+	*out = 0;
+	*line = in;
+	return token;
+}
+
+static int copyPattern(char *pattern,int max,const char *value)
+{
+	if((int)strlen(value) >= max) return -1;
+	strcpy(pattern,value);
+	return 0;
+}
+
+static int parseProfile(char *line,struct driveProfile *profile)
+{
+	char *token = nextToken(&line), *end;
+
+	memset(profile,0,sizeof(struct driveProfile));
+	profile->touchEngine = -1;
+	if(copyPattern(profile->name,32,token) < 0) return -1;
+
+	while((token = nextToken(&line))) {
+		if(!strncmp(token,"vendor=",7)) {
+			if(copyPattern(profile->vendor,32,token + 7) < 0) return -1;
+		} else if(!strncmp(token,"model=",6)) {
+			if(copyPattern(profile->model,64,token + 6) < 0) return -1;
+		} else if(!strncmp(token,"firmware=",9)) {
+			if(copyPattern(profile->firmware,32,token + 9) < 0) return -1;
+		} else if(!strncmp(token,"interval=",9)) {
+			profile->interval = strtol(token + 9,&end,10);
+			if(*end || profile->interval < 1 || profile->interval > 3600) return -1;
+		} else if(!strncmp(token,"timeout=",8)) {
+			profile->antiParkTimeout = strtol(token + 8,&end,10);
+			profile->antiParkTimeoutMax = profile->antiParkTimeout;
+			if(*end == ':') profile->antiParkTimeoutMax = strtol(end + 1,&end,10);
+			if(*end || profile->antiParkTimeout < 1 || profile->antiParkTimeoutMax < profile->antiParkTimeout) return -1;
+		} else if(!strncmp(token,"parked=",7)) {
+			profile->parkedTimeout = strtol(token + 7,&end,10);
+			if(*end || profile->parkedTimeout < 1) return -1;
+		} else if(!strncmp(token,"touch=",6)) {
+			profile->touchEngine = parseTouchEngine(token + 6);
+			if(profile->touchEngine < 0) return -1;
+		} else if(!strncmp(token,"rating=",7)) {
+			profile->cycleRating = strtol(token + 7,&end,10);
+			if(*end || profile->cycleRating < 1) return -1;
+		} else {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ Looks the drive up in the drop-in file at path, then in the built-in
+ profiles. A missing file is not an error.
+ Returns 1 with the profile filled in, 0 if none matches, -EINVAL if the
+ file has errors.
+ */
+int findDriveProfile(const char *disk,const char *path,struct driveProfile *profile)
+{
+	struct driveIdentity id;
+	char line[512];
+	FILE *in;
+	int i;
+
+	if(readDiskAttribute(disk,"device/vendor",id.vendor,64) < 0) id.vendor[0] = 0;
+	if(readDiskAttribute(disk,"device/model",id.model,64) < 0) id.model[0] = 0;
+	if(readDiskAttribute(disk,"device/rev",id.firmware,64) < 0 && readDiskAttribute(disk,"device/firmware_rev",id.firmware,64) < 0) id.firmware[0] = 0;
+
+	in = path[0] ? fopen(path,"r") : NULL;
+	if(in) {
+		int lineNumber = 0, found = 0;
+		while(!found && fgets(line,512,in)) {
+			char *comment = strchr(line,'#'), *end;
+
+			lineNumber++;
+			if(comment) *comment = 0;
+			for(end = line + strlen(line); end > line && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'); end--) end[-1] = 0;
+			if(!line[0] || line[strspn(line," \t")] == 0) continue;
+
+			if(parseProfile(line,profile) < 0) {
+				fprintf(stderr,"%s:%d: Invalid drive profile.\n",path,lineNumber);
+				fclose(in);
+				return -EINVAL;
+			}
+			found = matchesDrive(profile,&id);
+		}
+		fclose(in);
+		if(found) return 1;
+	}
+
+	for(i = 0; builtinProfiles[i].name[0]; i++) {
+		if(matchesDrive(&builtinProfiles[i],&id)) {
+			*profile = builtinProfiles[i];
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ Takes the profile's settings, except those given on the command line.
+ */
+void applyDriveProfile(const struct driveProfile *profile,struct wdAntiParkConfig *config)
+{
+	if(profile->interval && !config->intervalSet) config->interval = profile->interval;
+	if(profile->antiParkTimeout && !config->antiParkTimeoutSet) config->antiParkTimeout = profile->antiParkTimeout;
+	if(profile->antiParkTimeoutMax && !config->antiParkTimeoutMaxSet) config->antiParkTimeoutMax = profile->antiParkTimeoutMax;
+	if(profile->parkedTimeout && !config->parkedTimeoutSet) config->parkedTimeout = profile->parkedTimeout;
+	
+	// one ANTI-PARK timeout from the command line, the other from the profile
+	if(config->antiParkTimeoutMax < config->antiParkTimeout) {
+		if(config->antiParkTimeoutSet && !config->antiParkTimeoutMaxSet) config->antiParkTimeoutMax = config->antiParkTimeout;
+		else if(config->antiParkTimeoutMaxSet && !config->antiParkTimeoutSet) config->antiParkTimeout = config->antiParkTimeoutMax;
+	}
+	if(profile->touchEngine >= 0 && !config->touchEngineSet) config->touchEngine = profile->touchEngine;
+	if(profile->cycleRating && !config->cycleRatingSet) config->cycleRating = profile->cycleRating;
+}
@@ -0,0 +1,47 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Settings per drive model, built in or from a drop-in file.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "wdantiparkd.h"
+
+// a setting of 0, or -1 for the touch engine, is left alone
+struct driveProfile
+{
+	char name[32];
+	char vendor[32]; // patterns, empty matches any
+	char model[64];
+	char firmware[32];
+	int interval;
+	int antiParkTimeout;
+	int antiParkTimeoutMax;
+	int parkedTimeout;
+	int touchEngine;
+	long cycleRating;
+};
+
+int findDriveProfile(const char *disk,const char *path,struct driveProfile *profile);
+void applyDriveProfile(const struct driveProfile *profile,struct wdAntiParkConfig *config);
+
+#endif
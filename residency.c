@@ -0,0 +1,317 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Page cache residency of the watched directory trees.
+
+	The trees given with --residency are walked a few entries per tick, and
+	for every regular file the number of pages in the page cache is
+	measured with cachestat(), or with mmap and mincore on kernels older
+	than 6.5. Neither reads the file. cachestat also counts pages that were
+	evicted recently; with mincore, pages lost since the previous pass are
+	counted instead. The walk reads directory metadata, so it only runs
+	while the heads are loaded (ANTI-PARK).
+
+	Files that are losing pages are the likely cause of the next wake. The
+	worst of them are kept open and sampled every tick, which is safe
+	while parked as no path lookup is involved.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "wdantiparkd.h"
+#include "residency.h"
+
+#ifndef __NR_cachestat
+#define __NR_cachestat 451
+#endif
+
+// seconds between the start of two passes over the trees
+#define RESIDENCY_PASS_INTERVAL 60
+
+// mincore works on mappings of this size at a time
+#define MINCORE_WINDOW (64L << 20)
+
+struct cachestatRange
+{
+	uint64_t off;
+	uint64_t len;
+};
+
+struct cachestatResult
+{
+	uint64_t nrCache;
+	uint64_t nrDirty;
+	uint64_t nrWriteback;
+	uint64_t nrEvicted;
+	uint64_t nrRecentlyEvicted;
+};
+
+static long countResidentPages(struct residency *residency,int fd,off_t size)
+{
+	static unsigned char vec[MINCORE_WINDOW / 4096];
+	long cached = 0;
+	off_t offset;
+
+	for(offset = 0; offset < size; offset += MINCORE_WINDOW) {
+		size_t len = size - offset < MINCORE_WINDOW ? size - offset : MINCORE_WINDOW;
+		size_t pages = (len + residency->pageSize - 1) / residency->pageSize, i;
+		void *map = mmap(NULL,len,PROT_READ,MAP_SHARED,fd,offset);
+
+		if(map == MAP_FAILED) return -errno;
+		if(mincore(map,len,vec) < 0) {
+			munmap(map,len);
+			return -errno;
+		}
+		for(i = 0; i < pages; i++) cached += vec[i] & 1;
+		munmap(map,len);
+	}
+	return cached;
+}
+
+/*
+ Measures the cached pages of the file, and where the kernel can tell, the
+ pages recently evicted from it (-1 otherwise).
+ Returns 0, or -errno.
+ */
+static int measureFile(struct residency *residency,int fd,off_t size,unsigned long *cached,long *recentlyEvicted)
+{
+	long result;
+
+	*recentlyEvicted = -1;
+	if(residency->useCachestat) {
+		struct cachestatRange range = { 0, 0 };
+		struct cachestatResult stat;
+
+		if(syscall(__NR_cachestat,fd,&range,&stat,0) == 0) {
+			*cached = stat.nrCache;
+			*recentlyEvicted = stat.nrRecentlyEvicted;
+			return 0;
+		}
+		if(errno != ENOSYS) return -errno;
+		residency->useCachestat = 0;
+	}
+
+	result = countResidentPages(residency,fd,size);
+	if(result < 0) return result;
+	*cached = result;
+	return 0;
+}
+
+static struct residencyFile *lookupFile(struct residency *residency,dev_t dev,ino_t ino)
+{
+	unsigned long hash = ((unsigned long)dev * 31 + (unsigned long)ino) % RESIDENCY_TABLE_SIZE;
+	int probe;
+
+	for(probe = 0; probe < 16; probe++) {
+		struct residencyFile *file = &residency->table[(hash + probe) % RESIDENCY_TABLE_SIZE];
+		if(!file->ino || (file->dev == dev && file->ino == ino)) return file;
+	}
+	return NULL;
+}
+
+/*
+ Tracks the file as a wake candidate if it lost more pages than the least
+ worrying candidate.
+ */
+static void considerCandidate(struct residency *residency,const char *path,int dirFd,const char *name,off_t size,
+							  unsigned long pages,unsigned long cached,unsigned long evicted)
+{
+	struct wakeCandidate *slot = NULL;
+	int i, fd;
+
+	for(i = 0; i < residency->candidateCount; i++) {
+		if(!strcmp(residency->candidates[i].path,path)) {
+			slot = &residency->candidates[i];
+			slot->pages = pages;
+			slot->cached = cached;
+			slot->evicted = evicted;
+			return;
+		}
+	}
+
+	if(residency->candidateCount < MAX_WAKE_CANDIDATES) {
+		slot = &residency->candidates[residency->candidateCount++];
+	} else {
+		for(i = 0; i < residency->candidateCount; i++) {
+			if(!slot || residency->candidates[i].evicted < slot->evicted) slot = &residency->candidates[i];
+		}
+		if(slot->evicted >= evicted) return;
+		close(slot->fd);
+	}
+
+	fd = openat(dirFd,name,O_RDONLY | O_NOATIME | O_CLOEXEC);
+	if(fd < 0 && errno == EPERM) fd = openat(dirFd,name,O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		*slot = residency->candidates[--residency->candidateCount];
+		return;
+	}
+
+	strncpy(slot->path,path,256);
+	slot->path[255] = 0;
+	slot->fd = fd;
+	slot->size = size;
+	slot->pages = pages;
+	slot->cached = cached;
+	slot->evicted = evicted;
+	slot->lastEvicted = monotonicTimeMs();
+}
+
+struct residency *residencyOpen(const char *dirs)
+{
+	struct residency *residency;
+
+	if(!dirs[0]) return NULL;
+
+	residency = calloc(1,sizeof(struct residency));
+	if(!residency) return NULL;
+	treeWalkInit(&residency->walk,dirs);
+	residency->useCachestat = 1;
+	residency->pageSize = sysconf(_SC_PAGESIZE);
+	return residency;
+}
+
+/*
+ Measures up to maxEntries entries of the watched trees. Reads directory
+ metadata, so only call while the heads are loaded.
+ Returns the number of entries visited.
+ */
+int residencyScan(struct residency *residency,int maxEntries)
+{
+	struct treeWalkEntry entry;
+	int visited = 0;
+
+	// the walk is between passes
+	if(residency->walk.depth < 0 && !residency->walk.nextRoot && residency->lastPass &&
+	   monotonicTimeMs() - residency->lastPass < RESIDENCY_PASS_INTERVAL * 1000LL) return 0;
+
+	while(visited < maxEntries) {
+		struct residencyFile *file;
+		unsigned long pages, cached, evicted;
+		long recentlyEvicted;
+		struct stat st;
+		int fd;
+
+		if(!treeWalkNext(&residency->walk,&entry)) {
+			residency->last = residency->pass;
+			residency->lastPass = monotonicTimeMs();
+			memset(&residency->pass,0,sizeof(struct residencyTotals));
+			break;
+		}
+		visited++;
+		if(entry.type != DT_REG) continue;
+
+		fd = openat(entry.dirFd,entry.name,O_RDONLY | O_NOATIME | O_NOFOLLOW | O_CLOEXEC);
+		if(fd < 0 && errno == EPERM) fd = openat(entry.dirFd,entry.name,O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+		if(fd < 0) continue;
+		if(fstat(fd,&st) < 0 || st.st_size <= 0 || measureFile(residency,fd,st.st_size,&cached,&recentlyEvicted) < 0) {
+			close(fd);
+			continue;
+		}
+		close(fd);
+
+		// without cachestat, pages lost since the previous pass count as evicted
+		pages = (st.st_size + residency->pageSize - 1) / residency->pageSize;
+		file = lookupFile(residency,st.st_dev,st.st_ino);
+		if(recentlyEvicted >= 0) evicted = recentlyEvicted;
+		else evicted = (file && file->ino && file->cached > cached) ? file->cached - cached : 0;
+		if(file) {
+			file->dev = st.st_dev;
+			file->ino = st.st_ino;
+			file->cached = cached;
+		}
+
+		residency->pass.files++;
+		residency->pass.pages += pages;
+		residency->pass.cached += cached;
+		residency->pass.evicted += evicted;
+
+		if(evicted && cached < pages) considerCandidate(residency,residency->walk.path,entry.dirFd,entry.name,st.st_size,pages,cached,evicted);
+	}
+	return visited;
+}
+
+/*
+ Samples the wake candidates through their open descriptors, which never
+ touches the disk. Returns the number of candidates that lost pages.
+ */
+int residencySampleCandidates(struct residency *residency)
+{
+	int i, losing = 0;
+
+	for(i = 0; i < residency->candidateCount; i++) {
+		struct wakeCandidate *candidate = &residency->candidates[i];
+		unsigned long cached;
+		long recentlyEvicted;
+
+		if(measureFile(residency,candidate->fd,candidate->size,&cached,&recentlyEvicted) < 0) continue;
+		if(cached < candidate->cached) {
+			candidate->evicted += candidate->cached - cached;
+			candidate->lastEvicted = monotonicTimeMs();
+			losing++;
+		}
+		candidate->cached = cached;
+	}
+	return losing;
+}
+
+void residencyReport(struct residency *residency)
+{
+	struct residencyTotals *totals = residency->lastPass ? &residency->last : &residency->pass;
+	unsigned long pageKb = residency->pageSize >> 10;
+	int i;
+
+	printf("[%s] Page cache - files: %lu, resident: %.1f%% of %lu kB, recently evicted: %lu kB (%s)\n",formatCurrentTime(NULL,0),
+		   totals->files,totals->pages ? totals->cached * 100.0 / totals->pages : 0.0,totals->pages * pageKb,
+		   totals->evicted * pageKb,residency->useCachestat ? "cachestat" : "mincore");
+
+	// most pages lost first
+	for(i = 0; i < residency->candidateCount; i++) {
+		int j;
+		for(j = i + 1; j < residency->candidateCount; j++) {
+			if(residency->candidates[j].evicted > residency->candidates[i].evicted) {
+				struct wakeCandidate swap = residency->candidates[i];
+				residency->candidates[i] = residency->candidates[j];
+				residency->candidates[j] = swap;
+			}
+		}
+		if(i < 3) {
+			struct wakeCandidate *candidate = &residency->candidates[i];
+			printf("[%s]  likely next wake: %s (%.0f%% resident, %lu kB evicted)\n",formatCurrentTime(NULL,0),candidate->path,
+				   candidate->pages ? candidate->cached * 100.0 / candidate->pages : 0.0,candidate->evicted * pageKb);
+		}
+	}
+	fflush(stdout);
+}
+
+void residencyClose(struct residency *residency)
+{
+	int i;
+	if(!residency) return;
+	for(i = 0; i < residency->candidateCount; i++) close(residency->candidates[i].fd);
+	treeWalkClose(&residency->walk);
+	free(residency);
+}
@@ -0,0 +1,83 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Page cache residency of the watched directory trees.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <sys/types.h>
+#include "treewalk.h"
+
+#define RESIDENCY_TABLE_SIZE 4096
+#define MAX_WAKE_CANDIDATES 8
+#define RESIDENCY_ENTRIES_PER_TICK 256
+
+// cached pages of a file as of the previous pass
+struct residencyFile
+{
+	dev_t dev;
+	ino_t ino;
+	unsigned long cached;
+};
+
+// files losing pages, likely to be read from the platter next
+struct wakeCandidate
+{
+	char path[256];
+	int fd;
+	off_t size;
+	unsigned long pages;
+	unsigned long cached;
+	unsigned long evicted;
+	long long lastEvicted;
+};
+
+struct residencyTotals
+{
+	unsigned long files;
+	unsigned long pages;
+	unsigned long cached;
+	unsigned long evicted; // recently evicted pages
+};
+
+struct residency
+{
+	struct treeWalk walk;
+	int useCachestat;
+	long pageSize;
+
+	struct residencyTotals pass; // pass in progress
+	struct residencyTotals last; // last complete pass
+	long long lastPass;
+
+	struct residencyFile table[RESIDENCY_TABLE_SIZE];
+
+	int candidateCount;
+	struct wakeCandidate candidates[MAX_WAKE_CANDIDATES];
+};
+
+struct residency *residencyOpen(const char *dirs);
+int residencyScan(struct residency *residency,int maxEntries);
+int residencySampleCandidates(struct residency *residency);
+void residencyReport(struct residency *residency);
+void residencyClose(struct residency *residency);
+
+#endif
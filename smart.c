@@ -0,0 +1,158 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Load and start/stop cycles read back from the drive's SMART attributes.
+
+	The llc count of the main loop is an estimate. The drive's own count is
+	attribute 193 (Load_Cycle_Count), with 4 (Start_Stop_Count) for
+	spindowns. Both are read with SMART READ DATA, only in states that
+	touch the disk, so reading them never wakes it: periodically, right
+	before the heads are let go, and on the first tick after they were
+	loaded again. Cycles between the last two count against the state the
+	heads parked in, cycles while touching against the touching state. The
+	latter should stay at zero, anything else means the touch interval is
+	too long. Every reading is appended with its timestamp to
+	smart-<serial> in the state directory.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "wdantiparkd.h"
+#include "diskinfo.h"
+#include "smart.h"
+
+/*
+ Opens the readings log of the disk. Must be called before dropping
+ privileges, the file stays open.
+ Returns 0, or -errno if the readings are not kept.
+ */
+int smartOpen(struct smartLog *smart,struct ataDevice *ata,const char *stateDir,const char *disk,int interval)
+{
+	char serial[128], path[256];
+
+	memset(smart,0,sizeof(struct smartLog));
+	smart->ata = ata;
+	smart->interval = interval;
+	smart->excursion = -1;
+	smart->fd = -1;
+
+	if(readDiskSerial(disk,serial,128) < 0) {
+		fprintf(stderr,"Could not determine the serial of '%s', SMART readings are not kept.\n",disk);
+		return -ENOENT;
+	}
+
+	snprintf(path,256,"%s/smart-%s",stateDir,serial);
+	path[255] = 0;
+	smart->fd = open(path,O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,0644);
+	if(smart->fd < 0) {
+		fprintf(stderr,"Failed to open '%s', SMART readings are not kept.\n",path);
+		return -errno;
+	}
+	return 0;
+}
+
+/*
+ Reads the counters, and counts the cycles since the previous reading
+ against the given state.
+ */
+static void readCounters(struct smartLog *smart,const struct policy *policy,int state,int verbose)
+{
+	unsigned char data[512];
+	unsigned long long loadCycles, startStops = 0;
+	time_t now = time(NULL);
+
+	smart->lastRead = monotonicTimeMs();
+	if(ataSmartReadData(smart->ata,data) < 0 || ataSmartAttribute(data,SMART_LOAD_CYCLE_COUNT,&loadCycles) < 0) {
+		fprintf(stderr,"%s does not report its load cycles through %s, SMART readings stopped.\n",smart->ata->disk,ataBackendName(smart->ata->backend));
+		smart->interval = 0;
+		return;
+	}
+	ataSmartAttribute(data,SMART_START_STOP_COUNT,&startStops);
+
+	if(!smart->readings) {
+		smart->firstTime = now;
+		smart->firstLoadCycles = loadCycles;
+		smart->firstStartStops = startStops;
+	} else if(loadCycles > smart->loadCycles) {
+		smart->stateCycles[state] += loadCycles - smart->loadCycles;
+		if(verbose && (policy->states[state].flags & StateTouch)) {
+			printf("[%s] Drive counted %llu load cycles in %s, the touch interval is too long.\n",formatCurrentTime(NULL,0),
+				   loadCycles - smart->loadCycles,policy->states[state].label);
+			fflush(stdout);
+		}
+	}
+	smart->readings++;
+	smart->lastTime = now;
+	smart->loadCycles = loadCycles;
+	smart->startStops = startStops;
+
+	if(smart->fd >= 0) {
+		char line[128];
+		int len = snprintf(line,128,"%ld %llu %llu %s\n",(long)now,loadCycles,startStops,policy->states[state].name);
+		if(write(smart->fd,line,len) != len) fprintf(stderr,"Failed to log SMART reading.\n");
+	}
+}
+
+/*
+ Called on every tick of a state that touches the disk.
+ */
+void smartPoll(struct smartLog *smart,const struct policy *policy,int state,int verbose)
+{
+	if(!smart->interval) return;
+	if(smart->excursion >= 0) {
+		readCounters(smart,policy,smart->excursion,verbose);
+		smart->excursion = -1;
+	} else if(!smart->readings || monotonicTimeMs() - smart->lastRead >= smart->interval * 1000LL) {
+		readCounters(smart,policy,state,verbose);
+	}
+}
+
+/*
+ Called while the heads are still loaded, right before leaving a touching
+ state for one that is not.
+ */
+void smartLeave(struct smartLog *smart,const struct policy *policy,int state,int next,int verbose)
+{
+	if(!smart->interval) return;
+	readCounters(smart,policy,state,verbose);
+	smart->excursion = next;
+}
+
+void smartReport(const struct smartLog *smart,const struct policy *policy)
+{
+	double hours = (smart->lastTime - smart->firstTime) / 3600.0;
+	int i;
+
+	if(!smart->readings) return;
+	printf("[%s] SMART - load cycles: %llu (+%llu, %.2g/hr), start/stop: %llu (+%llu), by state:",formatCurrentTime(NULL,0),
+		   smart->loadCycles,smart->loadCycles - smart->firstLoadCycles,
+		   hours > 0 ? (smart->loadCycles - smart->firstLoadCycles) / hours : 0.0,
+		   smart->startStops,smart->startStops - smart->firstStartStops);
+	for(i = 0; i < policy->stateCount; i++) printf(" %s %llu",policy->states[i].label,smart->stateCycles[i]);
+	printf("\n");
+}
+
+void smartClose(struct smartLog *smart)
+{
+	if(smart->fd >= 0) close(smart->fd);
+	smart->fd = -1;
+}
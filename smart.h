@@ -0,0 +1,56 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Load and start/stop cycles read back from the drive's SMART attributes.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SMART_H
+#define SMART_H
+
+#include <time.h>
+#include "ata.h"
+#include "policy.h"
+
+struct smartLog
+{
+	struct ataDevice *ata;
+	int fd; // readings, appended with timestamps
+	int interval; // seconds between readings while touching, 0 once reading failed
+	int excursion; // state the heads parked in since the last reading, -1 for none
+	long long lastRead;
+	unsigned long readings;
+
+	time_t firstTime;
+	unsigned long long firstLoadCycles;
+	unsigned long long firstStartStops;
+	time_t lastTime;
+	unsigned long long loadCycles;
+	unsigned long long startStops;
+
+	unsigned long long stateCycles[MAX_POLICY_STATES];
+};
+
+int smartOpen(struct smartLog *smart,struct ataDevice *ata,const char *stateDir,const char *disk,int interval);
+void smartPoll(struct smartLog *smart,const struct policy *policy,int state,int verbose);
+void smartLeave(struct smartLog *smart,const struct policy *policy,int state,int next,int verbose);
+void smartReport(const struct smartLog *smart,const struct policy *policy);
+void smartClose(struct smartLog *smart);
+
+#endif
@@ -0,0 +1,168 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Touch deadlines, and their staggering across disks.
+
+	Every rotational disk in the system gets a fixed phase within the touch
+	interval, and touches that follow a touch are only issued on that phase
+	of the monotonic clock. Disks behind the same host adapter are spread as
+	far apart as possible, disks on different adapters fill the slots in
+	between. The phases only depend on the topology in /sys/block, so any
+	number of daemons arrive at the same schedule without talking to each
+	other.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dirent.h>
+#include "wdantiparkd.h"
+#include "diskinfo.h"
+#include "stagger.h"
+
+struct staggerDisk
+{
+	char name[32];
+	char adapter[256];
+	int group;
+};
+
+static int compareDisks(const void *a,const void *b)
+{
+	const struct staggerDisk *x = a, *y = b;
+	int result = strcmp(x->adapter,y->adapter);
+	return result ? result : strcmp(x->name,y->name);
+}
+
+// rotational disks backed by a real device, no loop/ram/md/dm
+static int isStaggeredDisk(const char *disk)
+{
+	char path[256], value[16];
+
+	if(readDiskAttribute(disk,"queue/rotational",value,16) <= 0 || strcmp(value,"1")) return 0;
+
+	snprintf(path,256,"/sys/block/%s/device",disk);
+	path[255] = 0;
+	return access(path,F_OK) == 0;
+}
+
+/*
+ Computes the phase of the disk's touches within the interval, in ms.
+ */
+long long touchPhaseMs(const char *disk,int interval,int verbose)
+{
+	struct staggerDisk *disks = NULL;
+	struct dirent *entry;
+	DIR *dir;
+	int count = 0, capacity = 0, groups = 0, groupSize = 0, maxGroupSize = 0;
+	int i, self = -1, index = 0;
+	long long phase = 0;
+
+	dir = opendir("/sys/block");
+	if(!dir) return 0;
+	while((entry = readdir(dir))) {
+		if(entry->d_name[0] == '.') continue;
+		if(strcmp(entry->d_name,disk) && !isStaggeredDisk(entry->d_name)) continue;
+
+		if(count == capacity) {
+			struct staggerDisk *grown;
+			capacity = capacity ? capacity * 2 : 16;
+			grown = realloc(disks,capacity * sizeof(struct staggerDisk));
+			if(!grown) break;
+			disks = grown;
+		}
+		strncpy(disks[count].name,entry->d_name,32);
+		disks[count].name[31] = 0;
+		if(readDiskAdapter(entry->d_name,disks[count].adapter,256) < 0)
+			strcpy(disks[count].adapter,entry->d_name);
+		count++;
+	}
+	closedir(dir);
+
+	// number the adapters and find the largest one
+	qsort(disks,count,sizeof(struct staggerDisk),compareDisks);
+	for(i = 0; i < count; i++) {
+		if(i == 0 || strcmp(disks[i].adapter,disks[i - 1].adapter)) {
+			groups++;
+			groupSize = 0;
+		}
+		disks[i].group = groups - 1;
+		if(++groupSize > maxGroupSize) maxGroupSize = groupSize;
+		if(!strcmp(disks[i].name,disk)) {
+			self = i;
+			index = groupSize - 1;
+		}
+	}
+
+	// slot k of adapter g is k * groups + g, the same adapter is groups slots apart
+	if(self >= 0) {
+		long long slot = (long long)index * groups + disks[self].group;
+		phase = interval * 1000LL * slot / ((long long)maxGroupSize * groups);
+		if(verbose) {
+			printf("[%s] Touch phase: %lld ms (slot %lld of %d, %d disks on %d adapters).\n",formatCurrentTime(NULL,0),
+				   phase,slot,maxGroupSize * groups,count,groups);
+			fflush(stdout);
+		}
+	}
+
+	free(disks);
+	return phase;
+}
+
+/*
+ Moves a touch deadline back onto the latest slot of the disk's phase that
+ does not come after it. The slot is less than an interval earlier, so the
+ heads are still touched before they unload.
+ */
+long long alignTouchDeadline(long long deadline,long long phase,int interval)
+{
+	long long period = interval * 1000LL, offset;
+
+	if(period <= 0) return deadline;
+	offset = (deadline - phase) % period;
+	if(offset < 0) offset += period;
+	return deadline - offset;
+}
+
+/*
+ Returns when the disk is due for its next touch, an interval after it was
+ last touched or saw organic I/O. Touches that follow a touch are put on
+ the disk's phase, a negative phase for none. After organic I/O the
+ deadline is left alone, moving it earlier could touch a disk in use.
+ */
+long long touchDeadline(long long lastTouch,long long lastOrganicIo,int interval,long long phase)
+{
+	if(lastOrganicIo >= lastTouch) return lastOrganicIo + interval * 1000LL;
+	if(phase < 0) return lastTouch + interval * 1000LL;
+	return alignTouchDeadline(lastTouch + interval * 1000LL,phase,interval);
+}
+
+/*
+ Seconds between polls of a disk touched every interval. I/O is only seen
+ at the poll after it and taken to have happened at the one before, so
+ polling has to be well within the interval or a busy disk would still be
+ due for a touch on every poll.
+ */
+int touchPollInterval(int pollInterval,int interval)
+{
+	int tick = interval / 2;
+	if(pollInterval < tick) tick = pollInterval;
+	return tick > 0 ? tick : 1;
+}
@@ -0,0 +1,31 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Staggering of touch deadlines across disks.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STAGGER_H
+#define STAGGER_H
+
+long long touchPhaseMs(const char *disk,int interval,int verbose);
+long long alignTouchDeadline(long long deadline,long long phase,int interval);
+long long touchDeadline(long long lastTouch,long long lastOrganicIo,int interval,long long phase);
+int touchPollInterval(int pollInterval,int interval);
+
+#endif
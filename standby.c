@@ -0,0 +1,107 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Spindown of the disk in the STANDBY state, within a spin-up budget.
+
+	Entering a state with the standby flag issues ATA STANDBY IMMEDIATE,
+	so the spindown follows the daemon's own idea of idleness instead of a
+	separate hdparm -S timer. Every spindown is paid for with a spin-up
+	and a start/stop cycle, which drives are rated for far fewer of than
+	load cycles. Spindowns are therefore kept a minimum time apart, and
+	refused while the spin-ups of the last 24 hours have used up the daily
+	budget. The policy sees this as the spindown condition.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "wdantiparkd.h"
+#include "standby.h"
+
+#define DAY_MS 86400000LL
+
+void standbyInit(struct standby *standby,struct ataDevice *ata,int minInterval,int budget)
+{
+	memset(standby,0,sizeof(struct standby));
+	standby->ata = ata;
+	standby->minInterval = minInterval;
+	standby->budget = budget < MAX_SPINUP_BUDGET ? budget : MAX_SPINUP_BUDGET;
+}
+
+static int spinupsToday(const struct standby *standby)
+{
+	long long now = monotonicTimeMs();
+	int i, count = 0;
+
+	for(i = 0; i < MAX_SPINUP_BUDGET; i++) {
+		if(standby->spinupTimes[i] && now - standby->spinupTimes[i] < DAY_MS) count++;
+	}
+	return count;
+}
+
+/*
+ Returns 1 if the disk may be spun down now.
+ */
+int standbyAllowed(const struct standby *standby)
+{
+	if(standby->lastSpindown && monotonicTimeMs() - standby->lastSpindown < standby->minInterval * 1000LL) return 0;
+	return spinupsToday(standby) < standby->budget;
+}
+
+/*
+ Spins the disk down. Dirty data should be written back first, or the
+ next writeback spins it right up again.
+ Returns 0, or -errno.
+ */
+int standbyEnter(struct standby *standby,int verbose)
+{
+	int result = ataStandbyImmediate(standby->ata);
+
+	if(result < 0) {
+		standby->failures++;
+		fprintf(stderr,"Failed to spin down %s through %s.\n",standby->ata->disk,ataBackendName(standby->ata->backend));
+		return result;
+	}
+
+	standby->spunDown = 1;
+	standby->lastSpindown = monotonicTimeMs();
+	standby->spindowns++;
+	if(verbose) {
+		printf("[%s] Spun down %s, %d of %d spin-ups used today.\n",formatCurrentTime(NULL,0),standby->ata->disk,spinupsToday(standby),standby->budget);
+		fflush(stdout);
+	}
+	return 0;
+}
+
+/*
+ The disk was woken from standby, if it was spun down.
+ */
+void standbySpinup(struct standby *standby)
+{
+	if(!standby->spunDown) return;
+	standby->spunDown = 0;
+	standby->spinupTimes[standby->nextSpinup] = monotonicTimeMs();
+	standby->nextSpinup = (standby->nextSpinup + 1) % MAX_SPINUP_BUDGET;
+	standby->spinups++;
+}
+
+void standbyReport(const struct standby *standby)
+{
+	printf("[%s] Standby - spindowns: %lu, spin-ups: %lu (%d of %d today), failed: %lu\n",formatCurrentTime(NULL,0),
+		   standby->spindowns,standby->spinups,spinupsToday(standby),standby->budget,standby->failures);
+}
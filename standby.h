@@ -0,0 +1,53 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Spindown of the disk in the STANDBY state, within a spin-up budget.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STANDBY_H
+#define STANDBY_H
+
+#include "ata.h"
+
+// most spin-ups a day that can be budgeted
+#define MAX_SPINUP_BUDGET 256
+
+struct standby
+{
+	struct ataDevice *ata;
+	int minInterval; // seconds between spindowns
+	int budget; // spin-ups a day
+
+	int spunDown;
+	long long lastSpindown;
+	long long spinupTimes[MAX_SPINUP_BUDGET]; // ring of the latest spin-ups
+	int nextSpinup;
+
+	unsigned long spindowns;
+	unsigned long spinups;
+	unsigned long failures;
+};
+
+void standbyInit(struct standby *standby,struct ataDevice *ata,int minInterval,int budget);
+int standbyAllowed(const struct standby *standby);
+int standbyEnter(struct standby *standby,int verbose);
+void standbySpinup(struct standby *standby);
+void standbyReport(const struct standby *standby);
+
+#endif
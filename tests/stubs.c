@@ -0,0 +1,70 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	What the modules take from wdantiparkd.c, for the tests. The clock and
+	the disk's I/O counters are set by the tests, so the mock drive and the
+	timers can be run through hours in no time.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "wdantiparkd.h"
+#include "test.h"
+
+int testFailures = 0;
+long long testClockMs = 1000000;
+unsigned long testReadSectors = 0;
+unsigned long testWriteSectors = 0;
+
+int terminateProgram = 0;
+
+const char *formatSeconds(time_t secs,char *buffer,int max)
+{
+	static char format[32];
+	if(!buffer) {
+		buffer = format;
+		max = 32;
+	}
+	snprintf(buffer,max,"%lds",(long)secs);
+	return buffer;
+}
+
+const char *formatCurrentTime(char *buffer,int max)
+{
+	static char format[32];
+	if(!buffer) {
+		buffer = format;
+		max = 32;
+	}
+	snprintf(buffer,max,"%lld ms",testClockMs);
+	return buffer;
+}
+
+long long monotonicTimeMs(void)
+{
+	return testClockMs;
+}
+
+int readDiskSectors(const char *disk,unsigned long *readSectorCount,unsigned long *writeSectorCount)
+{
+	*readSectorCount = testReadSectors;
+	*writeSectorCount = testWriteSectors;
+	return 0;
+}
@@ -0,0 +1,45 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Checks shared by the tests run by make check.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+extern int testFailures;
+
+// the clock and I/O counters the modules see, set by the tests
+extern long long testClockMs;
+extern unsigned long testReadSectors;
+extern unsigned long testWriteSectors;
+
+#define CHECK(cond) do { \
+	if(!(cond)) { \
+		fprintf(stderr,"%s:%d: check failed: %s\n",__FILE__,__LINE__,#cond); \
+		testFailures++; \
+	} \
+} while(0)
+
+#define TEST_RESULT() (testFailures ? 1 : 0)
+
+#endif
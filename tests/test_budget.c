@@ -0,0 +1,150 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Load cycle budget: the timeouts are scaled up while cycles run over
+	the daily target and down while they run under, and the counters
+	survive a restart. They are only saved while the heads are loaded.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "diskinfo.h"
+#include "budget.h"
+#include "test.h"
+
+static char stateDir[64];
+
+int readDiskSerial(const char *disk,char *buffer,int max)
+{
+	snprintf(buffer,max,"TEST-%s",disk);
+	return strlen(buffer);
+}
+
+// a day of cycles at perDay, fed hourly
+static void runDay(struct cycleBudget *budget,unsigned long *llc,double perDay,int headsLoaded)
+{
+	double due = 0;
+	int hour;
+
+	for(hour = 0; hour < 24; hour++) {
+		due += perDay / 24;
+		while(due >= 1) {
+			(*llc)++;
+			due--;
+		}
+		testClockMs += 3600000;
+		budgetUpdate(budget,*llc,0,headsLoaded);
+	}
+}
+
+static void testOverBudget(void)
+{
+	struct cycleBudget budget;
+	unsigned long llc = 0;
+
+	CHECK(budgetOpen(&budget,stateDir,"sdover",164,300000) == 0);
+	runDay(&budget,&llc,500,1);
+	CHECK(budget.cycles == llc);
+	CHECK(budget.scale > 1.5);
+	CHECK(budgetTimeout(&budget,60) > 90);
+	budgetClose(&budget);
+}
+
+static void testUnderBudget(void)
+{
+	struct cycleBudget budget;
+	unsigned long llc = 0;
+
+	CHECK(budgetOpen(&budget,stateDir,"sdunder",164,300000) == 0);
+	runDay(&budget,&llc,0,1);
+	CHECK(budget.scale < 0.5);
+	CHECK(budget.scale >= 0.25);
+	CHECK(budgetTimeout(&budget,60) < 30);
+	budgetClose(&budget);
+}
+
+static void testRestart(void)
+{
+	struct cycleBudget budget;
+	unsigned long llc = 0, cycles;
+	double scale;
+	char path[128];
+
+	CHECK(budgetOpen(&budget,stateDir,"sdkept",164,300000) == 0);
+	runDay(&budget,&llc,300,1);
+	cycles = budget.cycles;
+	scale = budget.scale;
+	budgetClose(&budget);
+
+	// the daemon's own count starts over, the drive's does not
+	CHECK(budgetOpen(&budget,stateDir,"sdkept",164,300000) == 0);
+	CHECK(budget.cycles == cycles);
+	CHECK(budget.scale > scale - 0.001 && budget.scale < scale + 0.001);
+	budgetUpdate(&budget,2,0,1);
+	CHECK(budget.cycles == cycles + 2);
+	budgetClose(&budget);
+
+	snprintf(path,128,"%s/cycles-TEST-sdkept",stateDir);
+	unlink(path);
+}
+
+static void testParked(void)
+{
+	struct cycleBudget budget;
+	unsigned long llc = 0;
+	long long opened;
+	char path[128];
+
+	// a parked disk is not woken to save the counts
+	CHECK(budgetOpen(&budget,stateDir,"sdparked",164,300000) == 0);
+	opened = budget.lastSave;
+	runDay(&budget,&llc,300,0);
+	CHECK(budget.lastSave == opened);
+	budgetUpdate(&budget,llc,0,1);
+	CHECK(budget.lastSave == testClockMs);
+	budgetClose(&budget);
+
+	snprintf(path,128,"%s/cycles-TEST-sdparked",stateDir);
+	unlink(path);
+}
+
+int main(void)
+{
+	char path[128];
+
+	strcpy(stateDir,"/tmp/wdantiparkd-budget-XXXXXX");
+	if(!mkdtemp(stateDir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	testOverBudget();
+	testUnderBudget();
+	testRestart();
+	testParked();
+
+	snprintf(path,128,"%s/cycles-TEST-sdover",stateDir);
+	unlink(path);
+	snprintf(path,128,"%s/cycles-TEST-sdunder",stateDir);
+	unlink(path);
+	rmdir(stateDir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,133 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Learned schedule: hours are classed busy, dead or normal from their
+	share of active minutes and the weeks seen, and a busy hour is
+	pre-woken for once.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "diskinfo.h"
+#include "diurnal.h"
+#include "test.h"
+
+static char stateDir[64];
+
+int readDiskSerial(const char *disk,char *buffer,int max)
+{
+	snprintf(buffer,max,"TEST-%s",disk);
+	return strlen(buffer);
+}
+
+static int currentHour(int *minute)
+{
+	time_t now = time(NULL);
+	struct tm local;
+
+	localtime_r(&now,&local);
+	*minute = local.tm_min;
+	return local.tm_wday * 24 + local.tm_hour;
+}
+
+/*
+ Writes a schedule with every hour at all, and the hour after the current
+ one at next, as activity:weeks.
+ */
+static void writeSchedule(const char *all,const char *next)
+{
+	char path[128];
+	int minute, hour = (currentHour(&minute) + 1) % HOURS_PER_WEEK, i;
+	FILE *out;
+
+	snprintf(path,128,"%s/diurnal-TEST-sdz",stateDir);
+	out = fopen(path,"w");
+	CHECK(out != NULL);
+	if(!out) return;
+	fprintf(out,"# test schedule\n");
+	for(i = 0; i < HOURS_PER_WEEK; i++) fprintf(out,"%s%c",i == hour && next ? next : all,i % 24 == 23 ? '\n' : ' ');
+	fclose(out);
+}
+
+static enum HourClass classOf(const char *all)
+{
+	struct diurnal diurnal;
+	enum HourClass class;
+
+	writeSchedule(all,NULL);
+	CHECK(diurnalOpen(&diurnal,stateDir,"sdz") == 0);
+	class = diurnalClass(&diurnal);
+	diurnalClose(&diurnal);
+	return class;
+}
+
+static void testClasses(void)
+{
+	CHECK(classOf("0:0") == HourNormal);
+	CHECK(classOf("6000:1") == HourBusy);
+	CHECK(classOf("100:3") == HourDead);
+	CHECK(classOf("3000:5") == HourNormal);
+
+	// one week is not enough to call an hour dead
+	CHECK(classOf("100:1") == HourNormal);
+}
+
+static void testPrewake(void)
+{
+	struct diurnal diurnal;
+	int minute;
+
+	// only in the last minutes before the busy hour
+	writeSchedule("3000:5","6000:5");
+	CHECK(diurnalOpen(&diurnal,stateDir,"sdz") == 0);
+	currentHour(&minute);
+	CHECK(diurnalPrewake(&diurnal) == (minute >= 55));
+	diurnalPrewakeTaken(&diurnal);
+	CHECK(!diurnalPrewake(&diurnal));
+	diurnalClose(&diurnal);
+
+	// nothing to pre-wake for in a busy hour
+	writeSchedule("6000:5",NULL);
+	CHECK(diurnalOpen(&diurnal,stateDir,"sdz") == 0);
+	CHECK(!diurnalPrewake(&diurnal));
+	diurnalClose(&diurnal);
+}
+
+int main(void)
+{
+	char path[128];
+
+	strcpy(stateDir,"/tmp/wdantiparkd-diurnal-XXXXXX");
+	if(!mkdtemp(stateDir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	testClasses();
+	testPrewake();
+
+	snprintf(path,128,"%s/diurnal-TEST-sdz",stateDir);
+	unlink(path);
+	rmdir(stateDir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,98 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Per-disk paths: a disk keeps only the --warm and --residency paths on
+	its own filesystems, and drops missing paths and paths that do not fit.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "flush.h"
+#include "test.h"
+
+static char testDir[64];
+
+/*
+ Looks for the disk holding the test directory.
+ Returns 1 with its name in disk, or 0 if it is on no disk (tmpfs).
+ */
+static int findTestDisk(char *disk,int max)
+{
+	dev_t devs[MAX_FILESYSTEMS];
+	struct dirent *entry;
+	struct stat st;
+	DIR *dir;
+	int found = 0;
+
+	if(stat(testDir,&st) < 0) return 0;
+	dir = opendir("/sys/block");
+	if(!dir) return 0;
+	while(!found && (entry = readdir(dir))) {
+		if(entry->d_name[0] == '.' || (int)strlen(entry->d_name) >= max) continue;
+		if(isOnFilesystems(st.st_dev,devs,listDiskFilesystems(entry->d_name,devs,MAX_FILESYSTEMS))) {
+			strcpy(disk,entry->d_name);
+			found = 1;
+		}
+	}
+	closedir(dir);
+	return found;
+}
+
+static void testFilter(void)
+{
+	char disk[32], paths[512], own[512];
+
+	snprintf(paths,512,"%s\n%s/missing\n/proc",testDir,testDir);
+
+	// a disk that is not there has no filesystems
+	filterDiskPaths("nodisk","--warm",paths,own,512);
+	CHECK(own[0] == 0);
+
+	if(!findTestDisk(disk,32)) {
+		printf("'%s' is on no disk, skipping the filter checks.\n",testDir);
+		return;
+	}
+	filterDiskPaths(disk,"--warm",paths,own,512);
+	CHECK(!strcmp(own,testDir));
+
+	// an own list too small for the path keeps nothing
+	filterDiskPaths(disk,"--warm",paths,own,8);
+	CHECK(own[0] == 0);
+
+	snprintf(paths,512,"/proc\n%s\n%s",testDir,testDir);
+	filterDiskPaths(disk,"--warm",paths,own,512);
+	CHECK(!strncmp(own,testDir,strlen(testDir)) && own[strlen(testDir)] == '\n' && !strcmp(own + strlen(testDir) + 1,testDir));
+}
+
+int main(void)
+{
+	strcpy(testDir,"/tmp/wdantiparkd-flush-XXXXXX");
+	if(!mkdtemp(testDir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	testFilter();
+	rmdir(testDir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,119 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Idle-gap model: the timeouts it learns from known workloads.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "gapmodel.h"
+#include "test.h"
+
+static void initModel(struct gapModel *model)
+{
+	struct wdAntiParkConfig config;
+
+	memset(&config,0,sizeof(struct wdAntiParkConfig));
+	config.interval = 7;
+	config.antiParkTimeout = 60;
+	config.antiParkTimeoutMax = 300;
+	config.parkedTimeout = 300;
+	gapModelInit(model,&config);
+}
+
+// a burst of activity, then a gap of seconds, sampled every 7s
+static void feedGap(struct gapModel *model,long long *now,int seconds)
+{
+	gapModelSample(model,*now,1,7000);
+	*now += seconds * 1000LL;
+	gapModelSample(model,*now,1,7000);
+	*now += 7000;
+}
+
+static void testWarmup(void)
+{
+	struct gapModel model;
+	long long now = 1000000;
+	int i;
+
+	initModel(&model);
+	for(i = 0; i < 10; i++) feedGap(&model,&now,3600);
+	CHECK(model.gaps == 10);
+	CHECK(gapModelTimeout(&model) == 60);
+
+	// activity on consecutive ticks is no gap
+	gapModelSample(&model,now,1,7000);
+	gapModelSample(&model,now + 7000,1,7000);
+	gapModelSample(&model,now + 14000,0,7000);
+	CHECK(model.gaps == 10);
+}
+
+static void testShortGaps(void)
+{
+	struct gapModel model;
+	long long now = 1000000;
+	int i, timeout;
+
+	// the disk comes back within 40s, waiting that long beats a cycle
+	initModel(&model);
+	for(i = 0; i < 100; i++) feedGap(&model,&now,40);
+	timeout = gapModelTimeout(&model);
+	CHECK(timeout > 40 && timeout <= 300);
+	CHECK(model.cycles <= 20);
+}
+
+static void testLongGaps(void)
+{
+	struct gapModel model;
+	long long now = 1000000;
+	int i, timeout;
+
+	// the disk always stays idle for an hour, parking early is cheapest,
+	// but not before a quarter of the break-even point
+	initModel(&model);
+	for(i = 0; i < 100; i++) feedGap(&model,&now,3600);
+	timeout = gapModelTimeout(&model);
+	CHECK(timeout == 75);
+	CHECK(model.cycles == 100 && model.shadowCycles == 100);
+}
+
+static void testMixedGaps(void)
+{
+	struct gapModel model;
+	long long now = 1000000;
+	int i, timeout;
+
+	// within a quarter of the break-even point and the point itself
+	initModel(&model);
+	for(i = 0; i < 200; i++) feedGap(&model,&now,i % 2 ? 20 : 5000);
+	timeout = gapModelTimeout(&model);
+	CHECK(timeout >= 75 && timeout <= 300);
+	for(i = 0; i < 200; i++) feedGap(&model,&now,i % 3 ? 250 : 5000);
+	timeout = gapModelTimeout(&model);
+	CHECK(timeout >= 75 && timeout <= 300);
+}
+
+int main(void)
+{
+	testWarmup();
+	testShortGaps();
+	testLongGaps();
+	testMixedGaps();
+	return TEST_RESULT();
+}
@@ -0,0 +1,84 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Uevent parsing: whole-disk block add and remove events are reported
+	with the disk's name, partitions and other subsystems are skipped.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "hotplug.h"
+#include "test.h"
+
+/*
+ Sends a uevent as the kernel does: the header, then the NUL separated
+ keys, each given here separated by '|'.
+ */
+static void sendEvent(int fd,const char *header,const char *keys)
+{
+	char buffer[1024];
+	int len, i;
+
+	len = snprintf(buffer,1024,"%s%c%s",header,0,keys) + 1;
+	for(i = 0; i < len; i++) if(buffer[i] == '|') buffer[i] = 0;
+	CHECK(send(fd,buffer,len,0) == len);
+}
+
+static void testEvents(void)
+{
+	struct hotplug hotplug;
+	struct hotplugEvent event;
+	int fds[2];
+
+	CHECK(socketpair(AF_UNIX,SOCK_DGRAM | SOCK_NONBLOCK,0,fds) == 0);
+	memset(&hotplug,0,sizeof(struct hotplug));
+	hotplug.fd = fds[0];
+
+	CHECK(hotplugNext(&hotplug,&event) == 0);
+
+	sendEvent(fds[1],"add@/devices/pci0000:00/ata1/host0/target0:0:0/0:0:0:0/block/sdc","ACTION=add|DEVPATH=/devices/.../block/sdc|SUBSYSTEM=block|DEVNAME=sdc|DEVTYPE=disk|SEQNUM=1");
+	CHECK(hotplugNext(&hotplug,&event) == 1);
+	CHECK(event.action == HotplugAdd && !strcmp(event.disk,"sdc"));
+
+	// partitions, other subsystems and other actions are skipped
+	sendEvent(fds[1],"add@/devices/.../block/sdc/sdc1","ACTION=add|SUBSYSTEM=block|DEVNAME=sdc1|DEVTYPE=partition");
+	sendEvent(fds[1],"add@/devices/.../scsi_disk/0:0:0:0","ACTION=add|SUBSYSTEM=scsi_disk");
+	sendEvent(fds[1],"change@/devices/.../block/sdc","ACTION=change|SUBSYSTEM=block|DEVNAME=sdc|DEVTYPE=disk");
+	sendEvent(fds[1],"remove@/devices/.../block/sdd","ACTION=remove|SUBSYSTEM=block|DEVNAME=/dev/sdd|DEVTYPE=disk");
+	CHECK(hotplugNext(&hotplug,&event) == 1);
+	CHECK(event.action == HotplugRemove && !strcmp(event.disk,"sdd"));
+	CHECK(hotplugNext(&hotplug,&event) == 0);
+
+	// a name that does not fit is not taken
+	sendEvent(fds[1],"add@/devices/.../block/x","ACTION=add|SUBSYSTEM=block|DEVNAME=averyveryverylongname|DEVTYPE=disk");
+	CHECK(hotplugNext(&hotplug,&event) == 0);
+
+	close(fds[1]);
+	hotplugClose(&hotplug);
+}
+
+int main(void)
+{
+	testEvents();
+	return TEST_RESULT();
+}
@@ -0,0 +1,200 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Hot-set budget: files are pinned while they fit, the least recently
+	used ones make room for newer ones, nothing larger than the budget is
+	taken, and large files are pinned a chunk per tick.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "flush.h"
+#include "hotset.h"
+#include "test.h"
+
+static char testDir[64];
+
+static void writeFile(const char *name,long size)
+{
+	char path[128], block[4096];
+	int fd;
+
+	memset(block,'x',sizeof(block));
+	snprintf(path,128,"%s/%s",testDir,name);
+	fd = open(path,O_WRONLY | O_CREAT | O_TRUNC,0600);
+	CHECK(fd >= 0);
+	if(fd < 0) return;
+	for(; size > 0; size -= sizeof(block)) CHECK(write(fd,block,size < (long)sizeof(block) ? size : (long)sizeof(block)) > 0);
+	close(fd);
+}
+
+static void removeFile(const char *name)
+{
+	char path[128];
+	snprintf(path,128,"%s/%s",testDir,name);
+	unlink(path);
+}
+
+/*
+ Looks for the disk holding the test directory, as the hot-set only takes
+ files on its own disk.
+ Returns 1 with its name in disk, or 0 if it is on no disk (tmpfs).
+ */
+static int findTestDisk(char *disk,int max)
+{
+	dev_t devs[MAX_FILESYSTEMS];
+	struct dirent *entry;
+	struct stat st;
+	DIR *dir;
+	int found = 0;
+
+	if(stat(testDir,&st) < 0) return 0;
+	dir = opendir("/sys/block");
+	if(!dir) return 0;
+	while(!found && (entry = readdir(dir))) {
+		if(entry->d_name[0] == '.' || (int)strlen(entry->d_name) >= max) continue;
+		if(isOnFilesystems(st.st_dev,devs,listDiskFilesystems(entry->d_name,devs,MAX_FILESYSTEMS))) {
+			strcpy(disk,entry->d_name);
+			found = 1;
+		}
+	}
+	closedir(dir);
+	return found;
+}
+
+static struct hotFile *hotFileNamed(struct hotSet *hotset,const char *name)
+{
+	char path[128];
+	int i;
+
+	snprintf(path,128,"%s/%s",testDir,name);
+	for(i = 0; i < hotset->count; i++) {
+		if(!strcmp(hotset->files[i].path,path)) return &hotset->files[i];
+	}
+	return NULL;
+}
+
+static void testBudget(void)
+{
+	struct hotSet *hotset;
+	struct hotFile *a, *b, *c;
+	char globs[128], disk[32];
+
+	writeFile("hot-a",400 << 10);
+	writeFile("hot-b",400 << 10);
+	writeFile("hot-big",2 << 20);
+	snprintf(globs,128,"%s/hot-*",testDir);
+
+	// files of another disk are not taken
+	hotset = hotsetOpen("nodisk",globs,0,1,0);
+	CHECK(hotset != NULL);
+	if(hotset) {
+		CHECK(hotsetMaintain(hotset) == 0);
+		CHECK(hotset->count == 0);
+		hotsetClose(hotset);
+	}
+
+	if(!findTestDisk(disk,32)) {
+		printf("'%s' is on no disk, skipping the budget checks.\n",testDir);
+		removeFile("hot-a");
+		removeFile("hot-b");
+		removeFile("hot-big");
+		return;
+	}
+	hotset = hotsetOpen(disk,globs,0,1,0);
+	CHECK(hotset != NULL);
+	if(!hotset) return;
+
+	// both fit, the one over the budget is never taken
+	CHECK(hotsetMaintain(hotset) == 800 << 10);
+	CHECK(hotset->count == 2);
+	CHECK(hotset->pinnedBytes == 800 << 10);
+	CHECK(!hotFileNamed(hotset,"hot-big"));
+
+	// a was used since, so b is the one to make room for c
+	testClockMs += 10000;
+	a = hotFileNamed(hotset,"hot-a");
+	CHECK(a != NULL);
+	if(a) a->lastUsed = testClockMs;
+	writeFile("hot-c",400 << 10);
+	testClockMs += 300000;
+	hotsetMaintain(hotset);
+
+	a = hotFileNamed(hotset,"hot-a");
+	b = hotFileNamed(hotset,"hot-b");
+	c = hotFileNamed(hotset,"hot-c");
+	CHECK(a && b && c);
+	if(a && b && c) {
+		CHECK(a->state == HotPinned);
+		CHECK(b->state == HotPending);
+		CHECK(c->state == HotPinned);
+	}
+	CHECK(hotset->pinnedBytes == 800 << 10);
+
+	hotsetClose(hotset);
+	removeFile("hot-a");
+	removeFile("hot-b");
+	removeFile("hot-c");
+	removeFile("hot-big");
+}
+
+static void testChunks(void)
+{
+	struct hotSet *hotset;
+	struct hotFile *file;
+	char globs[128], disk[32];
+
+	if(!findTestDisk(disk,32)) return;
+	writeFile("large",20 << 20);
+	snprintf(globs,128,"%s/large",testDir);
+
+	// a file larger than a tick's share is read in over several ticks
+	hotset = hotsetOpen(disk,globs,0,64,1);
+	CHECK(hotset != NULL);
+	if(!hotset) return;
+	CHECK(hotsetMaintain(hotset) == 16 << 20);
+	file = hotFileNamed(hotset,"large");
+	CHECK(file && file->state == HotPinning);
+	CHECK(hotset->pinnedBytes == 20 << 20);
+	CHECK(hotsetMaintain(hotset) == 4 << 20);
+	CHECK(file && file->state == HotPinned);
+	CHECK(hotsetMaintain(hotset) == 0);
+
+	hotsetClose(hotset);
+	removeFile("large");
+}
+
+int main(void)
+{
+	strcpy(testDir,"/tmp/wdantiparkd-hotset-XXXXXX");
+	if(!mkdtemp(testDir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	testBudget();
+	testChunks();
+	rmdir(testDir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,109 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Laptop mode: the buffered and prompt settings derived from the
+	original ones, and the original settings saved for a restart.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "laptopmode.h"
+#include "test.h"
+
+static char stateDir[64];
+
+static void testSettings(void)
+{
+	struct laptopModeSettings original = { 0, 3000, 500, 20, 0, 10, 0 }, settings;
+
+	bufferedLaptopMode(&original,600,&settings);
+	CHECK(settings.laptopMode > 0);
+	CHECK(settings.dirtyExpire == 60000 && settings.dirtyWriteback == 60000);
+	CHECK(settings.dirtyRatio > original.dirtyRatio);
+	CHECK(settings.dirtyBackgroundRatio > original.dirtyBackgroundRatio && settings.dirtyBackgroundRatio < settings.dirtyRatio);
+
+	// higher ratios of the admin's are kept, limits in bytes become ratios
+	original.dirtyRatio = 80;
+	original.dirtyBackgroundRatio = 0;
+	original.dirtyBackgroundBytes = 64 << 20;
+	bufferedLaptopMode(&original,600,&settings);
+	CHECK(settings.dirtyRatio == 80);
+	CHECK(settings.dirtyBackgroundRatio > 0 && settings.dirtyBackgroundBytes == 0);
+
+	promptLaptopMode(&original,&settings);
+	CHECK(settings.laptopMode == 0);
+	CHECK(settings.dirtyExpire == 3000 && settings.dirtyWriteback == 500 && settings.dirtyRatio == 80);
+	CHECK(settings.dirtyBackgroundRatio == 0 && settings.dirtyBackgroundBytes == 64 << 20);
+}
+
+static void testSaved(void)
+{
+	struct laptopModeSettings original = { 5, 1500, 250, 0, 256 << 20, 10, 0 }, current = { 2, 60000, 60000, 60, 0, 50, 0 }, loaded;
+	char path[128];
+	FILE *out;
+
+	CHECK(loadLaptopMode(stateDir,&loaded) == -ENOENT);
+
+	CHECK(saveLaptopMode(stateDir,&original) == 0);
+	memset(&loaded,0,sizeof(loaded));
+	CHECK(loadLaptopMode(stateDir,&loaded) == 0);
+	CHECK(!memcmp(&loaded,&original,sizeof(loaded)));
+
+	forgetLaptopMode(stateDir);
+	CHECK(loadLaptopMode(stateDir,&loaded) == -ENOENT);
+
+	// older versions saved no byte or background limits
+	snprintf(path,128,"%s/laptop-mode",stateDir);
+	out = fopen(path,"w");
+	CHECK(out != NULL);
+	if(out) {
+		fprintf(out,"5 1500 250 10\n");
+		fclose(out);
+	}
+	loaded = current;
+	CHECK(loadLaptopMode(stateDir,&loaded) == 0);
+	CHECK(loaded.laptopMode == 5 && loaded.dirtyRatio == 10 && loaded.dirtyBytes == 0 && loaded.dirtyBackgroundRatio == 50);
+
+	// a damaged file is not restored
+	out = fopen(path,"w");
+	CHECK(out != NULL);
+	if(out) {
+		fprintf(out,"# damaged\n5 1500 -1 10\n2 3\n");
+		fclose(out);
+	}
+	CHECK(loadLaptopMode(stateDir,&loaded) == -ENOENT);
+	forgetLaptopMode(stateDir);
+}
+
+int main(void)
+{
+	strcpy(stateDir,"/tmp/wdantiparkd-laptopmode-XXXXXX");
+	if(!mkdtemp(stateDir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	testSettings();
+	testSaved();
+	rmdir(stateDir);
+	return TEST_RESULT();
+}
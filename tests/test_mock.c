@@ -0,0 +1,194 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	The mock drive driven through the standby, power mode and SMART code,
+	on the test clock.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <errno.h>
+#include "ata.h"
+#include "standby.h"
+#include "powermode.h"
+#include "smart.h"
+#include "policy.h"
+#include "test.h"
+
+static void diskIo(void)
+{
+	testReadSectors += 8;
+}
+
+static void advance(int seconds)
+{
+	testClockMs += seconds * 1000LL;
+}
+
+static unsigned long long smartValue(struct ataDevice *ata,int id)
+{
+	unsigned char data[512];
+	unsigned long long raw = 0;
+
+	CHECK(ataSmartReadData(ata,data) == 0);
+	CHECK(ataSmartAttribute(data,id,&raw) == 0);
+	return raw;
+}
+
+static void testHeadUnload(void)
+{
+	struct ataDevice ata;
+	struct powerMonitor power;
+
+	CHECK(ataOpen(&ata,"sdz",AtaMock,0) == 0);
+	powerInit(&power,&ata,60);
+	CHECK(powerPoll(&power,1,0) == PowerActive);
+
+	// the drive stays up while touched
+	advance(5);
+	diskIo();
+	advance(5);
+	CHECK(powerPoll(&power,1,0) == PowerActive);
+	CHECK(smartValue(&ata,SMART_LOAD_CYCLE_COUNT) == 0);
+
+	// and parks its heads when left alone, without spinning down
+	advance(10);
+	CHECK(smartValue(&ata,SMART_LOAD_CYCLE_COUNT) == 1);
+	CHECK(powerPoll(&power,1,0) == PowerActive);
+	CHECK(smartValue(&ata,SMART_START_STOP_COUNT) == 0);
+	ataClose(&ata);
+}
+
+static void testStandby(void)
+{
+	struct ataDevice ata;
+	struct powerMonitor power;
+	struct standby standby;
+
+	CHECK(ataOpen(&ata,"sdz",AtaMock,0) == 0);
+	powerInit(&power,&ata,60);
+	standbyInit(&standby,&ata,3600,2);
+	diskIo();
+	CHECK(powerPoll(&power,1,0) == PowerActive);
+
+	CHECK(standbyAllowed(&standby));
+	CHECK(standbyEnter(&standby,0) == 0);
+	CHECK(powerPoll(&power,1,0) == PowerStandby);
+	CHECK(power.spindownsSeen == 1);
+	CHECK(smartValue(&ata,SMART_START_STOP_COUNT) == 1);
+	CHECK(smartValue(&ata,SMART_LOAD_CYCLE_COUNT) == 1);
+
+	// spun up by the next access, not by the power mode polls
+	advance(600);
+	CHECK(powerPoll(&power,1,0) == PowerStandby);
+	diskIo();
+	standbySpinup(&standby);
+	CHECK(powerPoll(&power,1,0) == PowerActive);
+	CHECK(standby.spinups == 1);
+	CHECK(!standbyAllowed(&standby));
+
+	advance(3600);
+	CHECK(standbyAllowed(&standby));
+	CHECK(standbyEnter(&standby,0) == 0);
+	diskIo();
+	standbySpinup(&standby);
+
+	// two spin-ups a day are budgeted
+	advance(3600);
+	CHECK(!standbyAllowed(&standby));
+	advance(86400);
+	CHECK(standbyAllowed(&standby));
+	ataClose(&ata);
+}
+
+static void testTimer(void)
+{
+	struct ataDevice ata;
+	struct powerMonitor power;
+
+	// the drive's own standby timer, seen by the power mode polls
+	CHECK(ataOpen(&ata,"sdz",AtaMock,60) == 0);
+	powerInit(&power,&ata,30);
+	diskIo();
+	CHECK(powerPoll(&power,1,0) == PowerActive);
+	advance(30);
+	CHECK(powerPoll(&power,0,0) == PowerActive);
+	advance(10);
+	CHECK(powerPoll(&power,0,0) == PowerActive); // not polled again yet
+	advance(20);
+	CHECK(powerPoll(&power,0,0) == PowerStandby);
+	CHECK(power.spindownsSeen == 1);
+	CHECK(smartValue(&ata,SMART_START_STOP_COUNT) == 1);
+	ataClose(&ata);
+}
+
+static void testCycleAttribution(void)
+{
+	struct wdAntiParkConfig config;
+	struct ataDevice ata;
+	struct powerMonitor power;
+	struct smartLog smart;
+	struct policy policy;
+
+	memset(&config,0,sizeof(struct wdAntiParkConfig));
+	config.interval = 7;
+	config.antiParkTimeout = 60;
+	config.antiParkTimeoutMax = 300;
+	config.parkedTimeout = 300;
+	CHECK(builtinPolicy(&config,&policy) == 0);
+
+	CHECK(ataOpen(&ata,"sdz",AtaMock,0) == 0);
+	powerInit(&power,&ata,60);
+	smartOpen(&smart,&ata,"/nonexistent","sdz",600);
+	CHECK(smart.interval == 600);
+
+	// touched in ANTIPARK, no cycles
+	diskIo();
+	smartPoll(&smart,&policy,0,0);
+	advance(7);
+	diskIo();
+	smartPoll(&smart,&policy,0,0);
+	CHECK(smart.readings == 1);
+
+	// the heads park in PARKED and load again with the next access
+	smartLeave(&smart,&policy,0,1,0);
+	advance(20);
+	CHECK(powerPoll(&power,1,0) == PowerActive);
+	diskIo();
+	smartPoll(&smart,&policy,0,0);
+	CHECK(smart.stateCycles[0] == 0);
+	CHECK(smart.stateCycles[1] == 1);
+	CHECK(smart.loadCycles == 1);
+
+	// a cycle while touching is counted against ANTIPARK
+	advance(700);
+	smartPoll(&smart,&policy,0,0);
+	CHECK(smart.stateCycles[0] == 1);
+	smartClose(&smart);
+	ataClose(&ata);
+}
+
+int main(void)
+{
+	testHeadUnload();
+	testStandby();
+	testTimer();
+	testCycleAttribution();
+	return TEST_RESULT();
+}
@@ -0,0 +1,183 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Policy language: the built-in policies and the parser.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include "policy.h"
+#include "test.h"
+
+static void defaultConfig(struct wdAntiParkConfig *config)
+{
+	memset(config,0,sizeof(struct wdAntiParkConfig));
+	config->interval = 7;
+	config->antiParkTimeout = 60;
+	config->antiParkTimeoutMax = 300;
+	config->parkedTimeout = 300;
+}
+
+static void testBuiltin(void)
+{
+	struct wdAntiParkConfig config;
+	struct policy policy;
+	const struct policyTransition *transition;
+
+	defaultConfig(&config);
+	CHECK(builtinPolicy(&config,&policy) == 0);
+	CHECK(policy.stateCount == 3);
+	CHECK(!strcmp(policy.states[0].label,"ANTIPARK"));
+	CHECK(policy.states[0].flags == (StateTouch | StateMaintain | StateExtend));
+	CHECK(policy.states[0].timeout == 60 && policy.states[0].timeoutMax == 300);
+	CHECK(policy.states[0].flush == 30);
+	CHECK(policy.states[1].timeout == 300);
+	CHECK(!policyHasFlag(&policy,StateStandby));
+
+	// quiet ticks stay until the timeout
+	CHECK(matchTransition(&policy,0,CondQuiet) == NULL);
+	transition = matchTransition(&policy,0,CondQuiet | CondTimeout);
+	CHECK(transition && transition->to == 1 && transition->actions == (ActionDrain | ActionCycle));
+
+	transition = matchTransition(&policy,1,CondActivity);
+	CHECK(transition && transition->to == 0 && (transition->actions & ActionBackoff) && (transition->actions & ActionLearn));
+	transition = matchTransition(&policy,1,CondQuiet | CondTimeout);
+	CHECK(transition && transition->to == 2);
+	transition = matchTransition(&policy,2,CondActivity);
+	CHECK(transition && transition->to == 0 && (transition->actions & ActionReset) && (transition->actions & ActionStats));
+}
+
+static void testBuiltinVariants(void)
+{
+	struct wdAntiParkConfig config;
+	struct policy policy;
+	const struct policyTransition *transition;
+
+	defaultConfig(&config);
+	config.absorbWrites = 16;
+	config.absorbBudget = 4096;
+	CHECK(builtinPolicy(&config,&policy) == 0);
+	CHECK(policy.states[0].absorb == 0);
+	CHECK(policy.states[1].absorb == 16 && policy.states[1].absorbBudget == 4096);
+	CHECK(policy.states[2].absorb == 16 && policy.states[2].absorbBudget == 4096);
+
+	defaultConfig(&config);
+	config.standbyTimeout = 600;
+	CHECK(builtinPolicy(&config,&policy) == 0);
+	CHECK(policy.stateCount == 4);
+	CHECK(policyHasFlag(&policy,StateStandby));
+	CHECK(policy.states[2].timeout == 600);
+
+	// the spin-up budget decides
+	CHECK(matchTransition(&policy,2,CondQuiet | CondNormal | CondTimeout) == NULL);
+	transition = matchTransition(&policy,2,CondQuiet | CondNormal | CondTimeout | CondSpindown);
+	CHECK(transition && transition->to == 3 && (transition->actions & ActionDrain));
+	transition = matchTransition(&policy,3,CondActivity | CondNormal);
+	CHECK(transition && transition->to == 0);
+
+	defaultConfig(&config);
+	config.predictiveTimeout = 1;
+	CHECK(builtinPolicy(&config,&policy) == 0);
+	transition = matchTransition(&policy,1,CondActivity);
+	CHECK(transition && (transition->actions & ActionPredict) && !(transition->actions & ActionBackoff));
+	transition = matchTransition(&policy,2,CondActivity);
+	CHECK(transition && (transition->actions & ActionPredict) && !(transition->actions & ActionReset));
+
+	defaultConfig(&config);
+	config.diurnal = 1;
+	config.predictiveTimeout = 1;
+	CHECK(builtinPolicy(&config,&policy) == 0);
+	transition = matchTransition(&policy,0,CondQuiet | CondDead | CondTimeout);
+	CHECK(transition && transition->to == 2);
+	CHECK(matchTransition(&policy,0,CondQuiet | CondBusy | CondTimeout) == NULL);
+	transition = matchTransition(&policy,0,CondQuiet | CondBusy | CondTimeout | CondMaxTimeout);
+	CHECK(transition && transition->to == 1);
+	transition = matchTransition(&policy,1,CondActivity | CondNormal);
+	CHECK(transition && (transition->actions & ActionPredict));
+	transition = matchTransition(&policy,1,CondQuiet | CondPrewake);
+	CHECK(transition && transition->to == 0);
+}
+
+static void testParser(void)
+{
+	struct policy policy;
+	const struct policyTransition *transition;
+
+	CHECK(compilePolicy("# two states\n"
+						"state awake touch extend poll=3 flush=10 timeout=5:9   # comment\n"
+						"state nap buffer absorb=64:256 timeout=20\n"
+						"state deep standby\n"
+						"awake -> nap when quiet+timeout drain cycle\n"
+						"nap -> deep when maxtimeout\n"
+						"nap -> awake when read backoff\n"
+						"deep -> awake when activity stats\n","test",&policy) == 0);
+	CHECK(policy.stateCount == 3 && policy.transitionCount == 4);
+	CHECK(!strcmp(policy.states[1].name,"nap") && !strcmp(policy.states[1].label,"NAP"));
+	CHECK(policy.states[0].poll == 3 && policy.states[0].flush == 10);
+	CHECK(policy.states[0].timeout == 5 && policy.states[0].timeoutMax == 9);
+	CHECK(policy.states[1].absorb == 64 && policy.states[1].absorbBudget == 256);
+	CHECK(policy.states[2].flags == StateStandby);
+
+	// transitions into a standby state also need the spindown condition
+	CHECK(matchTransition(&policy,1,CondQuiet | CondMaxTimeout) == NULL);
+	transition = matchTransition(&policy,1,CondQuiet | CondMaxTimeout | CondSpindown);
+	CHECK(transition && transition->to == 2);
+
+	// in declaration order
+	transition = matchTransition(&policy,1,CondRead | CondActivity | CondMaxTimeout | CondSpindown);
+	CHECK(transition && transition->to == 2);
+	transition = matchTransition(&policy,1,CondRead | CondActivity);
+	CHECK(transition && transition->to == 0 && transition->actions == ActionBackoff);
+}
+
+static void testParserErrors(void)
+{
+	static const char *invalid[] = {
+		"state a bogus\n",
+		"state a timeout=9:5\n",
+		"state a timeout=x\n",
+		"state a absorb=0\n",
+		"state a absorb=64:16\n",
+		"state a\na -> b when quiet\n",
+		"state a\nstate b\na -> b when sometimes\n",
+		"state a\nstate b\na -> b when quiet explode\n",
+		"state a\nstate b\na -> b quiet\n",
+		"a -> a when quiet\n",
+		"",
+		NULL
+	};
+	struct policy policy;
+	int i;
+
+	for(i = 0; invalid[i]; i++) {
+		if(compilePolicy(invalid[i],"test",&policy) >= 0) {
+			fprintf(stderr,"accepted invalid policy: %s",invalid[i]);
+			testFailures++;
+		}
+	}
+}
+
+int main(void)
+{
+	testBuiltin();
+	testBuiltinVariants();
+	testParser();
+	testParserErrors();
+	return TEST_RESULT();
+}
@@ -0,0 +1,161 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Prefetch: the files opened after a wake are recorded under the first
+	one, and read ahead when the same file wakes the disk again.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "prefetch.h"
+#include "test.h"
+
+static char testDir[64];
+
+static void testPath(char *path,const char *name)
+{
+	snprintf(path,256,"%s/%s",testDir,name);
+}
+
+static void writeFile(const char *name)
+{
+	char path[256];
+	int fd;
+
+	testPath(path,name);
+	fd = open(path,O_WRONLY | O_CREAT | O_TRUNC,0600);
+	CHECK(fd >= 0);
+	if(fd < 0) return;
+	CHECK(write(fd,"data",4) == 4);
+	close(fd);
+}
+
+// as if the files were opened during the tick
+static void opened(struct prefetcher *prefetcher,const char *names[],int count)
+{
+	int i;
+	prefetcher->tickOpenCount = count;
+	for(i = 0; i < count; i++) testPath(prefetcher->tickOpens[i],names[i]);
+}
+
+static void testSequence(void)
+{
+	const char *wake[] = { "trigger", "first", "second" }, *again[] = { "trigger" }, *other[] = { "other" };
+	struct prefetcher *prefetcher;
+	int i;
+
+	prefetcher = prefetchOpen("sdz",30,16);
+	if(!prefetcher) {
+		printf("No fanotify without root, skipping.\n");
+		return;
+	}
+	for(i = 0; i < 3; i++) writeFile(wake[i]);
+
+	// the first wake only records
+	opened(prefetcher,wake,3);
+	prefetchWake(prefetcher,0);
+	CHECK(prefetcher->bursts == 0);
+	testClockMs += 31000;
+	prefetchPoll(prefetcher);
+	CHECK(prefetcher->count == 1);
+
+	// a wake by another file finds nothing to read ahead
+	opened(prefetcher,other,1);
+	prefetchWake(prefetcher,0);
+	CHECK(prefetcher->bursts == 0);
+	testClockMs += 31000;
+	prefetchPoll(prefetcher);
+
+	// the same trigger reads the rest ahead
+	opened(prefetcher,again,1);
+	prefetchWake(prefetcher,0);
+	CHECK(prefetcher->bursts == 1);
+	CHECK(prefetcher->filesPrefetched == 2);
+	CHECK(prefetcher->wakes == 3);
+
+	prefetchClose(prefetcher);
+	for(i = 0; i < 3; i++) {
+		char path[256];
+		testPath(path,wake[i]);
+		unlink(path);
+	}
+}
+
+// a long sequence is located and read ahead a slice per tick
+static void testBurst(void)
+{
+	const char *wake[21], *again[] = { "trigger" };
+	char names[21][16];
+	struct prefetcher *prefetcher;
+	int i;
+
+	prefetcher = prefetchOpen("sdz",30,16);
+	if(!prefetcher) {
+		printf("No fanotify without root, skipping.\n");
+		return;
+	}
+	CHECK(sizeof(struct prefetcher) < 64 * 1024);
+	for(i = 0; i < 21; i++) {
+		if(i) snprintf(names[i],16,"file%d",i);
+		else strcpy(names[i],"trigger");
+		wake[i] = names[i];
+		writeFile(wake[i]);
+	}
+
+	opened(prefetcher,wake,21);
+	prefetchWake(prefetcher,0);
+	testClockMs += 31000;
+	prefetchPoll(prefetcher);
+	CHECK(prefetcher->count == 1);
+
+	// 16 located on the wake, the other 4 and 12 read ahead on the next tick
+	opened(prefetcher,again,1);
+	prefetchWake(prefetcher,0);
+	CHECK(prefetcher->bursts == 1);
+	CHECK(prefetcher->filesPrefetched == 0);
+	prefetchPoll(prefetcher);
+	CHECK(prefetcher->filesPrefetched == 12);
+	prefetchPoll(prefetcher);
+	CHECK(prefetcher->filesPrefetched == 20);
+	CHECK(prefetcher->burstCount == 0);
+
+	prefetchClose(prefetcher);
+	for(i = 0; i < 21; i++) {
+		char path[256];
+		testPath(path,wake[i]);
+		unlink(path);
+	}
+}
+
+int main(void)
+{
+	strcpy(testDir,"/tmp/wdantiparkd-prefetch-XXXXXX");
+	if(!mkdtemp(testDir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	testSequence();
+	testBurst();
+	rmdir(testDir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,181 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Drive profiles: the drop-in file, the built-in table and the overrides.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "diskinfo.h"
+#include "touch.h"
+#include "profile.h"
+#include "test.h"
+
+static const char *testModel = "WDC WD40EFRX-68N32N0";
+
+int readDiskAttribute(const char *disk,const char *attr,char *buffer,int max)
+{
+	if(strcmp(attr,"device/model")) return -ENOENT;
+	snprintf(buffer,max,"%s",testModel);
+	return 0;
+}
+
+static void writeProfiles(char *path,const char *text)
+{
+	int fd;
+	strcpy(path,"/tmp/wdantiparkd-profiles-XXXXXX");
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	if(fd < 0) return;
+	CHECK(write(fd,text,strlen(text)) == (ssize_t)strlen(text));
+	close(fd);
+}
+
+static void testDropIn(void)
+{
+	struct driveProfile profile;
+	char path[64];
+
+	writeProfiles(path,"# local drives\n"
+					   "\n"
+					   "other model=\"ST* DM*\" interval=5\n"
+					   "nas model=\"WDC WD40EFRX-*\" interval=60 timeout=120:900 parked=600 touch=read rating=300000   # comment\n");
+	CHECK(findDriveProfile("sdz",path,&profile) == 1);
+	CHECK(!strcmp(profile.name,"nas"));
+	CHECK(!strcmp(profile.model,"WDC WD40EFRX-*"));
+	CHECK(profile.interval == 60);
+	CHECK(profile.antiParkTimeout == 120 && profile.antiParkTimeoutMax == 900);
+	CHECK(profile.parkedTimeout == 600);
+	CHECK(profile.touchEngine == TouchRead);
+	CHECK(profile.cycleRating == 300000);
+	unlink(path);
+
+	// no match in the file falls back to the built-in profiles
+	writeProfiles(path,"other model=\"ST*\" interval=5\n");
+	CHECK(findDriveProfile("sdz",path,&profile) == 1);
+	CHECK(!strcmp(profile.name,"wd-red"));
+	CHECK(profile.interval == 270 && profile.touchEngine == TouchWrite);
+	unlink(path);
+
+	CHECK(findDriveProfile("sdz","/nonexistent/profiles",&profile) == 1);
+	CHECK(!strcmp(profile.name,"wd-red"));
+
+	testModel = "Unknown Drive";
+	CHECK(findDriveProfile("sdz","",&profile) == 0);
+	testModel = "WDC WD40EFRX-68N32N0";
+}
+
+static void testDropInErrors(void)
+{
+	static const char *invalid[] = {
+		"nas interval=0\n",
+		"nas interval=9x\n",
+		"nas timeout=600:60\n",
+		"nas parked=-1\n",
+		"nas touch=poke\n",
+		"nas speed=fast\n",
+		"nas model=\"0123456789012345678901234567890123456789012345678901234567890123456789\"\n",
+		NULL
+	};
+	struct driveProfile profile;
+	char path[64];
+	int i;
+
+	for(i = 0; invalid[i]; i++) {
+		writeProfiles(path,invalid[i]);
+		if(findDriveProfile("sdz",path,&profile) != -EINVAL) {
+			fprintf(stderr,"accepted invalid profile: %s",invalid[i]);
+			testFailures++;
+		}
+		unlink(path);
+	}
+}
+
+static void testApply(void)
+{
+	struct driveProfile profile;
+	struct wdAntiParkConfig config;
+
+	memset(&profile,0,sizeof(struct driveProfile));
+	profile.interval = 270;
+	profile.antiParkTimeout = 600;
+	profile.antiParkTimeoutMax = 1800;
+	profile.parkedTimeout = 900;
+	profile.touchEngine = TouchRead;
+	profile.cycleRating = 600000;
+
+	memset(&config,0,sizeof(struct wdAntiParkConfig));
+	config.interval = 7;
+	config.antiParkTimeout = 60;
+	config.antiParkTimeoutMax = 300;
+	config.parkedTimeout = 300;
+	config.touchEngine = TouchWrite;
+	config.cycleRating = 300000;
+	applyDriveProfile(&profile,&config);
+	CHECK(config.interval == 270 && config.antiParkTimeout == 600 && config.antiParkTimeoutMax == 1800 && config.parkedTimeout == 900);
+	CHECK(config.touchEngine == TouchRead && config.cycleRating == 600000);
+
+	// settings given on the command line win
+	config.interval = 7;
+	config.intervalSet = 1;
+	config.touchEngine = TouchWrite;
+	config.touchEngineSet = 1;
+	config.cycleRating = 300000;
+	config.cycleRatingSet = 1;
+	applyDriveProfile(&profile,&config);
+	CHECK(config.interval == 7 && config.touchEngine == TouchWrite && config.cycleRating == 300000);
+
+	// each timeout on its own
+	config.antiParkTimeout = 120;
+	config.antiParkTimeoutSet = 1;
+	config.antiParkTimeoutMax = 300;
+	config.parkedTimeout = 300;
+	applyDriveProfile(&profile,&config);
+	CHECK(config.antiParkTimeout == 120 && config.antiParkTimeoutMax == 1800 && config.parkedTimeout == 900);
+	config.antiParkTimeout = 3000;
+	config.parkedTimeout = 60;
+	config.parkedTimeoutSet = 1;
+	applyDriveProfile(&profile,&config);
+	CHECK(config.antiParkTimeout == 3000 && config.antiParkTimeoutMax == 3000 && config.parkedTimeout == 60);
+	config.antiParkTimeoutSet = 0;
+	config.antiParkTimeoutMax = 300;
+	config.antiParkTimeoutMaxSet = 1;
+	applyDriveProfile(&profile,&config);
+	CHECK(config.antiParkTimeout == 300 && config.antiParkTimeoutMax == 300);
+
+	// unset settings of the profile are left alone
+	memset(&profile,0,sizeof(struct driveProfile));
+	profile.touchEngine = -1;
+	memset(&config,0,sizeof(struct wdAntiParkConfig));
+	config.interval = 7;
+	config.touchEngine = TouchWrite;
+	applyDriveProfile(&profile,&config);
+	CHECK(config.interval == 7 && config.touchEngine == TouchWrite);
+}
+
+int main(void)
+{
+	testDropIn();
+	testDropInErrors();
+	testApply();
+	return TEST_RESULT();
+}
@@ -0,0 +1,156 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Page cache residency: a pass over a small tree, a few entries per call,
+	counts every regular file, and a file dropped from the cache shows up
+	in the next pass.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "residency.h"
+#include "test.h"
+
+static char testDir[64];
+
+static void writeFile(const char *name,long size)
+{
+	char path[128], block[4096];
+	int fd;
+
+	memset(block,'x',sizeof(block));
+	snprintf(path,128,"%s/%s",testDir,name);
+	fd = open(path,O_WRONLY | O_CREAT | O_TRUNC,0600);
+	CHECK(fd >= 0);
+	if(fd < 0) return;
+	for(; size > 0; size -= sizeof(block)) CHECK(write(fd,block,size < (long)sizeof(block) ? size : (long)sizeof(block)) > 0);
+	fsync(fd);
+	close(fd);
+}
+
+/*
+ Drops the file from the page cache. Returns the pages still cached, as
+ some filesystems keep them no matter what.
+ */
+static long dropFile(const char *name)
+{
+	char path[128];
+	unsigned char vec[64];
+	long cached = 0, i;
+	struct stat st;
+	void *map;
+	int fd;
+
+	snprintf(path,128,"%s/%s",testDir,name);
+	fd = open(path,O_RDONLY);
+	if(fd < 0 || fstat(fd,&st) < 0) return -1;
+	posix_fadvise(fd,0,0,POSIX_FADV_DONTNEED);
+	map = mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+	if(map != MAP_FAILED) {
+		if(mincore(map,st.st_size,vec) == 0) {
+			for(i = 0; i < (st.st_size + 4095) / 4096 && i < 64; i++) cached += vec[i] & 1;
+		}
+		munmap(map,st.st_size);
+	}
+	close(fd);
+	return cached;
+}
+
+static int scanPass(struct residency *residency)
+{
+	long long lastPass = residency->lastPass;
+	int calls = 0, visited;
+
+	do {
+		visited = residencyScan(residency,2);
+		CHECK(visited <= 2);
+		calls++;
+	} while(residency->lastPass == lastPass && calls < 100);
+	return calls;
+}
+
+static void testPass(void)
+{
+	char path[128];
+	struct residency *residency;
+	long pageSize = sysconf(_SC_PAGESIZE);
+
+	snprintf(path,128,"%s/sub",testDir);
+	mkdir(path,0700);
+	snprintf(path,128,"%s/sub/deeper",testDir);
+	mkdir(path,0700);
+	writeFile("a",64 << 10);
+	writeFile("sub/b",128 << 10);
+	writeFile("sub/deeper/c",32 << 10);
+	writeFile("sub/empty",0);
+
+	residency = residencyOpen(testDir);
+	CHECK(residency != NULL);
+	if(!residency) return;
+
+	// several calls make up a pass, empty files are not counted
+	CHECK(scanPass(residency) > 1);
+	CHECK(residency->last.files == 3);
+	CHECK(residency->last.pages == (unsigned long)((224 << 10) / pageSize));
+	CHECK(residency->last.cached <= residency->last.pages);
+
+	// the next pass waits for its interval
+	CHECK(residencyScan(residency,2) == 0);
+
+	if(dropFile("sub/b") > 0) {
+		printf("The page cache of '%s' cannot be dropped, skipping the eviction checks.\n",testDir);
+	} else {
+		testClockMs += 61000;
+		scanPass(residency);
+		CHECK(residency->last.files == 3);
+		CHECK(residency->last.cached + (128 << 10) / pageSize <= residency->last.pages);
+	}
+
+	residencyClose(residency);
+	snprintf(path,128,"%s/a",testDir);
+	unlink(path);
+	snprintf(path,128,"%s/sub/b",testDir);
+	unlink(path);
+	snprintf(path,128,"%s/sub/deeper/c",testDir);
+	unlink(path);
+	snprintf(path,128,"%s/sub/empty",testDir);
+	unlink(path);
+	snprintf(path,128,"%s/sub/deeper",testDir);
+	rmdir(path);
+	snprintf(path,128,"%s/sub",testDir);
+	rmdir(path);
+}
+
+int main(void)
+{
+	strcpy(testDir,"/tmp/wdantiparkd-residency-XXXXXX");
+	if(!mkdtemp(testDir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	testPass();
+	rmdir(testDir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,118 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Touch deadlines: a busy disk is left alone, an idle one never goes
+	longer than the interval without a touch.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stagger.h"
+#include "test.h"
+
+struct touchRun
+{
+	int touches;
+	long long longestQuiet; // ms without I/O or a touch
+};
+
+/*
+ Polls a disk like a touching state does for ten minutes, with I/O every
+ ioEvery ms (0 for none).
+ */
+static struct touchRun runTouches(int pollInterval,int interval,long long phase,int ioEvery)
+{
+	struct touchRun run = { 0, 0 };
+	long long start = 1000000, now = start, lastSample = start, lastTouch = start, lastOrganicIo = start, lastLoaded = start, deadline;
+	long long tick = touchPollInterval(pollInterval,interval) * 1000LL;
+
+	while(now < start + 600000) {
+		if(ioEvery) {
+			long long io = now - now % ioEvery;
+			if(io > lastSample) lastOrganicIo = lastSample;
+			if(io > lastLoaded) lastLoaded = io;
+		}
+		lastSample = now;
+
+		deadline = touchDeadline(lastTouch,lastOrganicIo,interval,phase);
+		if(now >= deadline) {
+			run.touches++;
+			lastTouch = now;
+			deadline = now + interval * 1000LL;
+		}
+		if(now - lastLoaded > run.longestQuiet) run.longestQuiet = now - lastLoaded;
+		if(now == lastTouch) lastLoaded = now;
+
+		now = deadline < now + tick ? deadline : now + tick;
+	}
+	return run;
+}
+
+static void testPollInterval(void)
+{
+	CHECK(touchPollInterval(7,7) == 3);
+	CHECK(touchPollInterval(2,7) == 2);
+	CHECK(touchPollInterval(7,270) == 7);
+	CHECK(touchPollInterval(7,1) == 1);
+}
+
+static void testAlign(void)
+{
+	CHECK(alignTouchDeadline(12500,2500,7) == 9500);
+	CHECK(alignTouchDeadline(9500,2500,7) == 9500);
+
+	// no interval, no phase to put the deadline on
+	CHECK(alignTouchDeadline(12500,2500,0) == 12500);
+}
+
+static void testBusyDisk(void)
+{
+	struct touchRun run;
+
+	run = runTouches(7,7,-1,1000);
+	CHECK(run.touches == 0);
+	run = runTouches(7,7,2500,1000);
+	CHECK(run.touches == 0);
+	run = runTouches(2,7,-1,3000);
+	CHECK(run.touches == 0);
+}
+
+static void testIdleDisk(void)
+{
+	struct touchRun run;
+
+	run = runTouches(7,7,-1,0);
+	CHECK(run.touches >= 600 / 7 - 1);
+	CHECK(run.longestQuiet <= 7000);
+	run = runTouches(7,7,2500,0);
+	CHECK(run.touches >= 600 / 7 - 1);
+	CHECK(run.longestQuiet <= 7000);
+
+	// sparse I/O does not stretch the time between touches
+	run = runTouches(7,7,2500,20000);
+	CHECK(run.longestQuiet <= 7000);
+}
+
+int main(void)
+{
+	testPollInterval();
+	testAlign();
+	testBusyDisk();
+	testIdleDisk();
+	return TEST_RESULT();
+}
@@ -0,0 +1,111 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Metadata warming: the walk visits every entry a slice at a time, waits
+	for its pass interval, and without fanotify holds the top level
+	directories open.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "warmer.h"
+#include "test.h"
+
+static char testDir[64];
+
+static void makeEntry(const char *name,int isDir)
+{
+	char path[128];
+	snprintf(path,128,"%s/%s",testDir,name);
+	if(isDir) CHECK(mkdir(path,0700) == 0);
+	else {
+		int fd = open(path,O_WRONLY | O_CREAT | O_TRUNC,0600);
+		CHECK(fd >= 0);
+		if(fd >= 0) close(fd);
+	}
+}
+
+static void removeEntry(const char *name,int isDir)
+{
+	char path[128];
+	snprintf(path,128,"%s/%s",testDir,name);
+	if(isDir) rmdir(path);
+	else unlink(path);
+}
+
+static void testWalk(void)
+{
+	struct metaWarmer *warmer;
+	char path[128];
+	int calls = 0, visited;
+
+	makeEntry("x",1);
+	makeEntry("y",1);
+	makeEntry("y/z",1);
+	makeEntry("f1",0);
+	makeEntry("y/f2",0);
+
+	warmer = warmerOpen("sdz",testDir);
+	CHECK(warmer != NULL);
+	if(!warmer) return;
+
+	// as without root
+	if(warmer->fanotifyFd >= 0) close(warmer->fanotifyFd);
+	warmer->fanotifyFd = -1;
+
+	do {
+		visited = warmerWalk(warmer,2);
+		CHECK(visited <= 2);
+		calls++;
+	} while(!warmer->lastPass && calls < 100);
+	CHECK(calls > 1);
+	CHECK(warmer->lastPassEntries == 5);
+
+	snprintf(path,128,"%s/x",testDir);
+	CHECK(warmer->count == 2 && (!strcmp(warmer->dirs[0].path,path) || !strcmp(warmer->dirs[1].path,path)));
+
+	// the next pass waits for its interval
+	CHECK(warmerWalk(warmer,2) == 0);
+	testClockMs += 121000;
+	CHECK(warmerWalk(warmer,2) > 0);
+
+	warmerClose(warmer);
+	removeEntry("y/f2",0);
+	removeEntry("f1",0);
+	removeEntry("y/z",1);
+	removeEntry("y",1);
+	removeEntry("x",1);
+}
+
+int main(void)
+{
+	strcpy(testDir,"/tmp/wdantiparkd-warmer-XXXXXX");
+	if(!mkdtemp(testDir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	testWalk();
+	rmdir(testDir);
+	return TEST_RESULT();
+}
@@ -0,0 +1,136 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	The disk access that keeps the heads loaded.
+
+	The write engine rewrites a few bytes of the temp file with O_SYNC,
+	which needs a writable filesystem on the disk and costs a journal
+	commit every time. The read engine instead reads one block at a random
+	offset of the raw device, bypassing the page cache, which works on any
+	disk and never writes. Where O_DIRECT is not available, the block is
+	dropped from the page cache before it is read.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include "diskinfo.h"
+#include "touch.h"
+
+#define TOUCH_BLOCK_SIZE 4096
+
+/*
+ Sets up the engine. The read engine opens the raw device, so it must be
+ set up before dropping privileges.
+ Returns 0, or -errno.
+ */
+int touchOpen(struct touchEngine *touch,int type,const char *disk,const char *tempFile)
+{
+	char path[64], value[64];
+
+	memset(touch,0,sizeof(struct touchEngine));
+	touch->type = type;
+	touch->fd = -1;
+	strncpy(touch->tempFile,tempFile,128);
+	touch->tempFile[127] = 0;
+
+	if(type != TouchRead) return 0;
+
+	if(readDiskAttribute(disk,"size",value,64) <= 0) {
+		fprintf(stderr,"Could not read size of '%s'.\n",disk);
+		return -ENOENT;
+	}
+	touch->blocks = strtoull(value,NULL,10) * 512 / TOUCH_BLOCK_SIZE;
+	if(!touch->blocks) return -EINVAL;
+
+	snprintf(path,64,"/dev/%s",disk);
+	path[63] = 0;
+	touch->direct = 1;
+	touch->fd = open(path,O_RDONLY | O_DIRECT | O_CLOEXEC);
+	if(touch->fd < 0 && errno == EINVAL) {
+		touch->direct = 0;
+		touch->fd = open(path,O_RDONLY | O_CLOEXEC);
+	}
+	if(touch->fd < 0) {
+		fprintf(stderr,"Failed to open '%s' for reading (root required).\n",path);
+		return -errno;
+	}
+
+	if(posix_memalign(&touch->buffer,TOUCH_BLOCK_SIZE,TOUCH_BLOCK_SIZE)) {
+		close(touch->fd);
+		touch->fd = -1;
+		return -ENOMEM;
+	}
+	touch->seed = (unsigned int)time(NULL);
+	return 0;
+}
+
+/*
+ Touches the disk once. Failures are reported by the caller, which keeps
+ retrying.
+ Returns 0, or -errno.
+ */
+int touchDisk(struct touchEngine *touch)
+{
+	if(touch->type == TouchRead) {
+		unsigned long long block = ((unsigned long long)rand_r(&touch->seed) << 16 ^ rand_r(&touch->seed)) % touch->blocks;
+		off_t offset = block * TOUCH_BLOCK_SIZE;
+
+		if(!touch->direct) posix_fadvise(touch->fd,offset,TOUCH_BLOCK_SIZE,POSIX_FADV_DONTNEED);
+		if(pread(touch->fd,touch->buffer,TOUCH_BLOCK_SIZE,offset) < 0) return -errno;
+	} else {
+		time_t now = time(NULL);
+		int tmpFileFp = open(touch->tempFile,O_WRONLY | O_TRUNC | O_CREAT | O_SYNC,0600);
+		if(tmpFileFp < 0) return -errno;
+		if(write(tmpFileFp,&now,4) != 4) {
+			int error = errno ? errno : EIO;
+			close(tmpFileFp);
+			return -error;
+		}
+		close(tmpFileFp);
+	}
+	return 0;
+}
+
+const char *touchEngineName(int type)
+{
+	return type == TouchRead ? "read" : "write";
+}
+
+/*
+ Returns the TouchEngineType of the name, or -1.
+ */
+int parseTouchEngine(const char *name)
+{
+	if(!strcmp(name,"write")) return TouchWrite;
+	if(!strcmp(name,"read")) return TouchRead;
+	return -1;
+}
+
+void touchClose(struct touchEngine *touch)
+{
+	if(touch->fd >= 0) close(touch->fd);
+	touch->fd = -1;
+	free(touch->buffer);
+	touch->buffer = NULL;
+}
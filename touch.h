@@ -0,0 +1,52 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	The disk access that keeps the heads loaded.
+*/
+
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TOUCH_H
+#define TOUCH_H
+
+enum TouchEngineType
+{
+	TouchWrite, // a synchronous write to the temp file
+	TouchRead // an uncached read of a random block of the disk
+};
+
+struct touchEngine
+{
+	int type;
+	char tempFile[128];
+
+	// read engine
+	int fd;
+	int direct; // O_DIRECT, or page cache dropped before each read
+	void *buffer;
+	unsigned long long blocks;
+	unsigned int seed;
+};
+
+int touchOpen(struct touchEngine *touch,int type,const char *disk,const char *tempFile);
+int touchDisk(struct touchEngine *touch);
+const char *touchEngineName(int type);
+int parseTouchEngine(const char *name);
+void touchClose(struct touchEngine *touch);
+
+#endif
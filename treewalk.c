@@ -0,0 +1,146 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Incremental walk of directory trees, a few entries at a time.
+
+	Scanners run from the main loop and must not stall it, so the walk
+	keeps its open directories between calls and hands out one entry per
+	call. When all roots are done, a pass is complete and the next call
+	starts over. The walk stays on the filesystem of each root.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "treewalk.h"
+
+void treeWalkInit(struct treeWalk *walk,const char *roots)
+{
+	memset(walk,0,sizeof(struct treeWalk));
+	strncpy(walk->roots,roots,512);
+	walk->roots[511] = 0;
+	walk->depth = -1;
+}
+
+/*
+ Descends into the directory in walk->path, which is opened relative to
+ dirFd (or as an absolute path when dirFd is -1).
+ */
+static int pushDirectory(struct treeWalk *walk,int dirFd,const char *name)
+{
+	struct stat st;
+	DIR *dir;
+	int fd;
+
+	if(walk->depth + 1 >= MAX_WALK_DEPTH) return -ELOOP;
+
+	fd = openat(dirFd < 0 ? AT_FDCWD : dirFd,name,O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_NOATIME | O_CLOEXEC);
+	if(fd < 0 && errno == EPERM) fd = openat(dirFd < 0 ? AT_FDCWD : dirFd,name,O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd < 0) return -errno;
+
+	if(fstat(fd,&st) < 0) {
+		close(fd);
+		return -errno;
+	}
+	if(dirFd < 0) walk->rootDev = st.st_dev;
+	else if(st.st_dev != walk->rootDev) {
+		close(fd);
+		return -EXDEV;
+	}
+
+	dir = fdopendir(fd);
+	if(!dir) {
+		close(fd);
+		return -errno;
+	}
+
+	walk->depth++;
+	walk->dirs[walk->depth] = dir;
+	walk->pathLen[walk->depth] = strlen(walk->path);
+	return 0;
+}
+
+/*
+ Fetches the next entry of the walk into entry, with its full path in
+ walk->path. Directories are descended into right after being returned.
+ Returns 1 for an entry, 0 when the pass is complete.
+ */
+int treeWalkNext(struct treeWalk *walk,struct treeWalkEntry *entry)
+{
+	for(;;) {
+		struct dirent *ent;
+		int len;
+
+		if(walk->depth < 0) {
+			const char *root = walk->roots + walk->nextRoot;
+
+			if(!*root) {
+				walk->nextRoot = 0;
+				walk->passes++;
+				return 0;
+			}
+			len = strcspn(root,"\n");
+			walk->nextRoot += len + (root[len] == '\n');
+			if(len >= (int)sizeof(walk->path)) continue;
+
+			memcpy(walk->path,root,len);
+			while(len > 1 && walk->path[len - 1] == '/') len--;
+			walk->path[len] = 0;
+			pushDirectory(walk,-1,walk->path);
+			continue;
+		}
+
+		ent = readdir(walk->dirs[walk->depth]);
+		if(!ent) {
+			closedir(walk->dirs[walk->depth]);
+			walk->depth--;
+			continue;
+		}
+		if(!strcmp(ent->d_name,".") || !strcmp(ent->d_name,"..")) continue;
+
+		len = walk->pathLen[walk->depth];
+		if(len + 1 + strlen(ent->d_name) >= sizeof(walk->path)) continue;
+		walk->path[len] = '/';
+		strcpy(walk->path + len + 1,ent->d_name);
+
+		entry->dirFd = dirfd(walk->dirs[walk->depth]);
+		entry->name = ent->d_name;
+		entry->type = ent->d_type;
+		entry->depth = walk->depth;
+
+		if(entry->type == DT_UNKNOWN) {
+			struct stat st;
+			if(fstatat(entry->dirFd,entry->name,&st,AT_SYMLINK_NOFOLLOW) < 0) continue;
+			entry->type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+		}
+
+		// the parent stays open, so entry->dirFd remains valid
+		if(entry->type == DT_DIR) pushDirectory(walk,entry->dirFd,entry->name);
+		return 1;
+	}
+}
+
+void treeWalkClose(struct treeWalk *walk)
+{
+	while(walk->depth >= 0) closedir(walk->dirs[walk->depth--]);
+	walk->nextRoot = 0;
+}
@@ -0,0 +1,55 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Incremental walk of directory trees, a few entries at a time.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TREEWALK_H
+#define TREEWALK_H
+
+#include <sys/types.h>
+#include <dirent.h>
+
+#define MAX_WALK_DEPTH 24
+
+struct treeWalk
+{
+	char roots[512]; // newline separated
+	int nextRoot; // offset of the next root in roots
+	int depth; // -1 between roots
+	DIR *dirs[MAX_WALK_DEPTH];
+	int pathLen[MAX_WALK_DEPTH];
+	dev_t rootDev;
+	char path[4096]; // path of the current entry
+	unsigned long passes;
+};
+
+struct treeWalkEntry
+{
+	int dirFd; // directory holding the entry, valid until the next call
+	const char *name;
+	unsigned char type; // DT_REG, DT_DIR, ...
+	int depth;
+};
+
+void treeWalkInit(struct treeWalk *walk,const char *roots);
+int treeWalkNext(struct treeWalk *walk,struct treeWalkEntry *entry);
+void treeWalkClose(struct treeWalk *walk);
+
+#endif
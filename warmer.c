@@ -0,0 +1,218 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Keeps dentries and inodes of the watched trees in memory.
+
+	Many wakes of a parked disk are not file reads, but directory listings
+	and stat() calls of clients browsing a share after the kernel reclaimed
+	the dentries and inodes. While the heads are loaded anyway (ANTI-PARK),
+	the trees given with --warm are walked with getdents64 (readdir) and
+	statx, a slice per tick, which puts the metadata back in the caches.
+
+	Directories that get listed often are held open, which keeps them from
+	being reclaimed at all. Listings are seen through fanotify when running
+	as root; otherwise the top level directories of the trees are held.
+	Optionally vfs_cache_pressure is lowered so the kernel prefers to
+	reclaim page cache over metadata, which the caller does once for all
+	disks.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/fanotify.h>
+#include "wdantiparkd.h"
+#include "flush.h"
+#include "warmer.h"
+
+// seconds between the start of two walks over the trees
+#define WARM_PASS_INTERVAL 120
+
+static int isUnderRoots(const char *roots,const char *path)
+{
+	while(*roots) {
+		int len = strcspn(roots,"\n");
+		while(len > 1 && roots[len - 1] == '/') len--;
+		if(len && !strncmp(path,roots,len) && (path[len] == '/' || !path[len])) return 1;
+		roots += strcspn(roots,"\n");
+		if(*roots) roots++;
+	}
+	return 0;
+}
+
+static struct warmDir *findWarmDir(struct metaWarmer *warmer,const char *path)
+{
+	int i;
+	for(i = 0; i < warmer->count; i++) {
+		if(!strcmp(warmer->dirs[i].path,path)) return &warmer->dirs[i];
+	}
+	return NULL;
+}
+
+/*
+ Holds the directory open through fd, which is taken over. When the table
+ is full, the least listed directory makes room.
+ */
+static void holdWarmDir(struct metaWarmer *warmer,const char *path,int fd,unsigned long listings)
+{
+	struct warmDir *dir;
+	int i;
+
+	if(warmer->count < MAX_WARM_DIRS) {
+		dir = &warmer->dirs[warmer->count++];
+	} else {
+		dir = &warmer->dirs[0];
+		for(i = 1; i < warmer->count; i++) {
+			if(warmer->dirs[i].listings < dir->listings) dir = &warmer->dirs[i];
+		}
+		if(dir->listings > listings) {
+			close(fd);
+			return;
+		}
+		close(dir->fd);
+	}
+
+	strncpy(dir->path,path,256);
+	dir->path[255] = 0;
+	dir->fd = fd;
+	dir->listings = listings;
+}
+
+struct metaWarmer *warmerOpen(const char *disk,const char *dirs)
+{
+	struct metaWarmer *warmer;
+
+	if(!dirs[0]) return NULL;
+
+	warmer = calloc(1,sizeof(struct metaWarmer));
+	if(!warmer) return NULL;
+	treeWalkInit(&warmer->walk,dirs);
+	warmer->fanotifyFd = -1;
+
+	strncpy(warmer->disk,disk,16);
+	warmer->disk[15] = 0;
+
+	warmer->fanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_NONBLOCK | FAN_CLOEXEC,O_RDONLY | O_LARGEFILE | O_NOATIME);
+	if(warmer->fanotifyFd >= 0) markDiskMounts(warmer->fanotifyFd,disk,FAN_OPEN | FAN_ONDIR,"directory listings",&warmer->lastMark);
+
+	return warmer;
+}
+
+/*
+ Counts the directory listings since the previous tick, and holds the
+ listed directories open.
+ */
+void warmerPoll(struct metaWarmer *warmer,int headsParked)
+{
+	char buffer[4096];
+	ssize_t len;
+	pid_t self = getpid();
+
+	if(warmer->fanotifyFd < 0) return;
+	markDiskMounts(warmer->fanotifyFd,warmer->disk,FAN_OPEN | FAN_ONDIR,"directory listings",&warmer->lastMark);
+
+	while((len = read(warmer->fanotifyFd,buffer,sizeof(buffer))) > 0) {
+		struct fanotify_event_metadata *event = (struct fanotify_event_metadata *)buffer;
+
+		for(; FAN_EVENT_OK(event,len); event = FAN_EVENT_NEXT(event,len)) {
+			char link[64], path[256];
+			struct warmDir *dir;
+			int pathLen;
+
+			if(event->fd < 0) continue;
+			if(event->pid == self || !(event->mask & FAN_ONDIR)) {
+				close(event->fd);
+				continue;
+			}
+
+			snprintf(link,64,"/proc/self/fd/%d",event->fd);
+			pathLen = readlink(link,path,255);
+			if(pathLen <= 0) {
+				close(event->fd);
+				continue;
+			}
+			path[pathLen] = 0;
+
+			dir = findWarmDir(warmer,path);
+			if(dir) {
+				dir->listings++;
+				if(headsParked) warmer->listingsWhileParked++;
+				close(event->fd);
+			} else if(isUnderRoots(warmer->walk.roots,path)) {
+				holdWarmDir(warmer,path,event->fd,1);
+			} else {
+				close(event->fd);
+			}
+		}
+	}
+}
+
+/*
+ Walks up to maxEntries entries of the trees, pulling their dentries and
+ inodes into the caches. Reads metadata from the disk, so only call while
+ the heads are loaded. Returns the number of entries visited.
+ */
+int warmerWalk(struct metaWarmer *warmer,int maxEntries)
+{
+	struct treeWalkEntry entry;
+	int visited = 0, i;
+
+	if(warmer->walk.depth < 0 && !warmer->walk.nextRoot && warmer->lastPass &&
+	   monotonicTimeMs() - warmer->lastPass < WARM_PASS_INTERVAL * 1000LL) return 0;
+
+	while(visited < maxEntries) {
+		struct statx stx;
+
+		if(!treeWalkNext(&warmer->walk,&entry)) {
+			warmer->lastPass = monotonicTimeMs();
+			warmer->lastPassEntries = warmer->passEntries;
+			warmer->passEntries = 0;
+
+			// old listings count for less every pass
+			for(i = 0; i < warmer->count; i++) warmer->dirs[i].listings /= 2;
+			break;
+		}
+		visited++;
+		warmer->passEntries++;
+
+		statx(entry.dirFd,entry.name,AT_SYMLINK_NOFOLLOW | AT_STATX_SYNC_AS_STAT,STATX_BASIC_STATS,&stx);
+
+		// without fanotify, hold the top level directories
+		if(warmer->fanotifyFd < 0 && entry.type == DT_DIR && entry.depth == 0 &&
+		   warmer->count < MAX_WARM_DIRS && !findWarmDir(warmer,warmer->walk.path)) {
+			int fd = openat(entry.dirFd,entry.name,O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+			if(fd >= 0) holdWarmDir(warmer,warmer->walk.path,fd,0);
+		}
+	}
+	return visited;
+}
+
+void warmerClose(struct metaWarmer *warmer)
+{
+	int i;
+	if(!warmer) return;
+	for(i = 0; i < warmer->count; i++) close(warmer->dirs[i].fd);
+	if(warmer->fanotifyFd >= 0) close(warmer->fanotifyFd);
+	treeWalkClose(&warmer->walk);
+	free(warmer);
+}
@@ -0,0 +1,58 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Keeps dentries and inodes of the watched trees in memory.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WARMER_H
+#define WARMER_H
+
+#include "treewalk.h"
+
+#define MAX_WARM_DIRS 64
+#define WARM_ENTRIES_PER_TICK 1024
+
+struct warmDir
+{
+	char path[256];
+	int fd; // held open, pins the directory's dentry and inode
+	unsigned long listings;
+};
+
+struct metaWarmer
+{
+	struct treeWalk walk;
+	int fanotifyFd;
+	char disk[16];
+	long long lastMark;
+	long long lastPass;
+	unsigned long passEntries;
+	unsigned long lastPassEntries;
+	unsigned long listingsWhileParked;
+
+	int count;
+	struct warmDir dirs[MAX_WARM_DIRS];
+};
+
+struct metaWarmer *warmerOpen(const char *disk,const char *dirs);
+void warmerPoll(struct metaWarmer *warmer,int headsParked);
+int warmerWalk(struct metaWarmer *warmer,int maxEntries);
+void warmerClose(struct metaWarmer *warmer);
+
+#endif
@@ -30,6 +30,19 @@
 	In IDLE state, the operation is the same as PARKED state, except that any 
 	interruptions returns to the ANTI-PARK state with the default 1 minutes timeout.
 	Also, in IDLE state, disk spindown may occur if your kernel supports it.
+
+	With --standby, IDLE times out into STANDBY, where the daemon spins the
+	disk down itself with ATA STANDBY IMMEDIATE. Spindowns are kept apart
+	and within a daily spin-up budget to spare the start/stop count. Any
+	disk activity returns to ANTI-PARK. With --power-poll, the daemon also
+	asks the drive for its power mode, and leaves a drive that went to
+	sleep on its own untouched.
+
+	Any number of disks are managed by one process, each with its own state
+	machine, from one loop that samples /proc/diskstats once per wakeup.
+	With --match, disks are picked by their serial or WWN instead of their
+	names, and followed as they are removed and plugged in, as in hot-swap
+	bays and USB enclosures.
 */
 
 /*
@@ -58,28 +71,34 @@
 #include <time.h>
 #include <pwd.h>
 #include <grp.h>
+#include <sys/stat.h>
+#include "wdantiparkd.h"
+#include "diskinfo.h"
+#include "calibrate.h"
+#include "stagger.h"
+#include "group.h"
+#include "flush.h"
+#include "writeback.h"
+#include "laptopmode.h"
+#include "hotset.h"
+#include "residency.h"
+#include "warmer.h"
+#include "prefetch.h"
+#include "policy.h"
+#include "gapmodel.h"
+#include "budget.h"
+#include "diurnal.h"
+#include "standby.h"
+#include "powermode.h"
+#include "smart.h"
+#include "touch.h"
+#include "profile.h"
+#include "hotplug.h"
 
-// global parameters
-struct wdAntiParkConfig
-{
-	char disk[16];
-	char tempFile[128];
-	int verbose;
-	int interval;
-	int antiParkTimeout; 
-	int antiParkTimeoutMax;
-	int parkedTimeout;
-	int syncBeforeIdle;
-};
-
-enum AntiParkState
-{
-	AntiPark,
-	Parked,
-	Idle
-};
+// polls due within this many ms of each other are done in one wakeup
+#define COALESCE_MS 500
 
-static int terminateProgram = 0;
+int terminateProgram = 0;
 static void signalHandler(int sig)
 {
 	if(sig == SIGINT || sig == SIGTERM) {
@@ -88,7 +107,7 @@ static void signalHandler(int sig)
 	}
 }
 
-static const char *formatSeconds(time_t secs,char *buffer,int max)
+const char *formatSeconds(time_t secs,char *buffer,int max)
 {
 	static char format[32];
 	if(!buffer) {
@@ -104,7 +123,7 @@ static const char *formatSeconds(time_t secs,char *buffer,int max)
 	return buffer;
 }
 
-static const char *formatCurrentTime(char *buffer,int max)
+const char *formatCurrentTime(char *buffer,int max)
 {
 	static char format[32];
 	if(!buffer) {
@@ -117,16 +136,24 @@ static const char *formatCurrentTime(char *buffer,int max)
 	return buffer;
 }
 
+long long monotonicTimeMs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
 /*
- Checks for disk activity since the last call to checkForDiskActivity()
+ Reads the number of sectors read from and written to the disk so far.
+ Returns 0, or -errno. Failures are left to the caller to report, they
+ repeat on every tick once a disk is gone.
  */
-int checkForDiskActivity(const char *disk,int *haveReadAcitvity,int *haveWriteActivity)
+int readDiskSectors(const char *disk,unsigned long *readSectorCount,unsigned long *writeSectorCount)
 {
-	static unsigned long lastReadSectorCount = 0, lastWriteSectorCount = 0;
-	unsigned long readSectorCount, writeSectorCount;
 	char statsPath[256];
 	char statsLine[512];
 	char *value;
+	int len;
 	
 	// kernel 2.6.. read from /sys
 	snprintf(statsPath,256,"/sys/block/%s/stat",disk);
@@ -134,35 +161,42 @@ int checkForDiskActivity(const char *disk,int *haveReadAcitvity,int *haveWriteAc
 	
 	// read stats
 	int diskStatFp = open(statsPath,O_RDONLY);
-	if(diskStatFp < 0) {
-		fprintf(stderr,"Could not open '%s' stats for reading.\n",disk);
-		return -errno;
-	}
-	read(diskStatFp,statsLine,512);
-	statsLine[511] = 0;
+	if(diskStatFp < 0) return -errno;
+	len = read(diskStatFp,statsLine,511);
+	statsLine[len > 0 ? len : 0] = 0;
 	close(diskStatFp);
 	
 	// split the lines
 	strtok(statsLine," "); // read I/Os
 	strtok(NULL," "); // read merges
 	value = strtok(NULL," ");
-	if(!value) {
-		fprintf(stderr,"Failed to read I/O stats.\n");
-		return -1;
-	}
-	readSectorCount = strtoul(value,NULL,10);
+	if(!value) return -EIO;
+	*readSectorCount = strtoul(value,NULL,10);
 	
 	strtok(NULL," "); // write I/Os
 	strtok(NULL," "); // write merges
 	value = strtok(NULL," ");
-	if(!value) {
-		fprintf(stderr,"Failed to read I/O stats.\n");
-		return -1;
-	}
-	writeSectorCount = strtoul(value,NULL,10);
+	if(!value) return -EIO;
+	*writeSectorCount = strtoul(value,NULL,10);
+	
+	return 0;
+}
+
+/*
+ Sectors read and written since the last call to readDiskActivity() or
+ checkForDiskActivity()
+ */
+int readDiskActivity(const char *disk,unsigned long *readSectors,unsigned long *writeSectors)
+{
+	static unsigned long lastReadSectorCount = 0, lastWriteSectorCount = 0;
+	unsigned long readSectorCount, writeSectorCount;
+	int result;
+	
+	result = readDiskSectors(disk,&readSectorCount,&writeSectorCount);
+	if(result < 0) return result;
 	
-	if(haveReadAcitvity) *haveReadAcitvity = readSectorCount != lastReadSectorCount;
-	if(haveWriteActivity) *haveWriteActivity = writeSectorCount != lastWriteSectorCount;
+	if(readSectors) *readSectors = readSectorCount - lastReadSectorCount;
+	if(writeSectors) *writeSectors = writeSectorCount - lastWriteSectorCount;
 	
 	lastReadSectorCount = readSectorCount;
 	lastWriteSectorCount = writeSectorCount;
@@ -171,219 +205,971 @@ int checkForDiskActivity(const char *disk,int *haveReadAcitvity,int *haveWriteAc
 }
 
 /*
- From: http://www.gnu.org/s/libc/manual/html_node/Elapsed-Time.html
+ Checks for disk activity since the last call to checkForDiskActivity()
+ */
+int checkForDiskActivity(const char *disk,int *haveReadAcitvity,int *haveWriteActivity)
+{
+	unsigned long readSectors, writeSectors;
+	int result;
+	
+	result = readDiskActivity(disk,&readSectors,&writeSectors);
+	if(result < 0) return result;
+	
+	if(haveReadAcitvity) *haveReadAcitvity = readSectors != 0;
+	if(haveWriteActivity) *haveWriteActivity = writeSectors != 0;
+	
+	return 0;
+}
 
- Subtract the `struct timeval' values X and Y,
- storing the result in RESULT.
- Return 1 if the difference is negative, otherwise 0.  */
+// a disk managed by the daemon, with its settings, resources and state machine
+struct diskContext
+{
+	struct wdAntiParkConfig config; // with the drive's profile applied
+	struct policy policy;
+	struct touchEngine touch;
+	struct cycleBudget budget;
+	struct diurnal diurnal;
+	struct ataDevice ata;
+	struct standby standby;
+	struct powerMonitor power;
+	struct smartLog smart;
+	int useAta;
+	int useStandby;
+	struct hotSet *hotset;
+	struct residency *residency;
+	struct metaWarmer *warmer;
+	struct prefetcher *prefetcher;
+	
+	int state; // in the policy
+	int timeouts[MAX_POLICY_STATES]; // current timeouts of the states, they back off and reset
+	time_t timeoutCountBegin, stateTimeBegin, antiParkStart, idleTime, lastSync;
+	int llc; // estimate llc
+	
+	// small writes let through while parked
+	unsigned long absorbedKb, absorbedTotalKb, absorbedWrites;
+	
+	// idle gaps between bursts of I/O, for predicted timeouts
+	struct gapModel gaps;
+	
+	// the state machine is polled more often than the disk is touched when
+	// the touch interval is long
+	int tick;
+	
+	// touches are only needed in the gaps left by organic I/O
+	long long lastSample, lastTouch, lastOrganicIo, nextTouch;
+	long long touchPhase;
+	unsigned long touches;
+	
+	// next poll by the scheduler, and whether it is a touch deadline
+	long long wakeAt;
+	int wakeForTouch;
+	
+	// sector counts at the last poll, and from the scheduler's sample
+	unsigned long lastReadSectorCount, lastWriteSectorCount;
+	unsigned long sampleReadSectorCount, sampleWriteSectorCount;
+	int sampled;
+	
+	// failures in a row, reported once until they clear
+	int statErrors, touchErrors;
+	
+	// members of the same array, woken together
+	struct diskSiblings siblings;
+	
+	// kernel writeback that would wake the disk while parked
+	struct dirtyMonitor dirty;
+	long long lastOpportunisticFlush;
+	int flushReported; // mount points too long to flush, reported once
+	
+	// a flush whose writeback is polled until it drains, then the transition
+	// it belongs to is taken, or none for a pre-emptive flush
+	struct writebackDrain drain;
+	const struct policyTransition *drainTransition;
+	unsigned long drainWriteSectorCount;
+};
+
+// the disks polled by the scheduler
+static struct diskContext *managedDisks[MAX_DISKS];
+static int managedCount = 0;
+
+/*
+ Reads the sector counts of all managed disks in one pass over
+ /proc/diskstats, instead of opening the stat file of each. Disks not
+ found are read on their own when polled.
+ */
+static void sampleDisks(void)
+{
+	char line[512], name[32];
+	unsigned long readSectorCount, writeSectorCount;
+	FILE *in;
+	int i;
+	
+	for(i = 0; i < managedCount; i++) managedDisks[i]->sampled = 0;
+	in = fopen("/proc/diskstats","r");
+	if(!in) return;
+	
+	while(fgets(line,512,in)) {
+		// major, minor and name, then the fields of /sys/block/<disk>/stat
+		if(sscanf(line,"%*u %*u %31s %*u %*u %lu %*u %*u %*u %lu",name,&readSectorCount,&writeSectorCount) != 3) continue;
+		for(i = 0; i < managedCount; i++) {
+			struct diskContext *ctx = managedDisks[i];
+			if(!ctx->sampled && !strcmp(ctx->config.disk,name)) {
+				ctx->sampleReadSectorCount = readSectorCount;
+				ctx->sampleWriteSectorCount = writeSectorCount;
+				ctx->sampled = 1;
+				break;
+			}
+		}
+	}
+	fclose(in);
+}
 
-int timeval_subtract (result, x, y)
-struct timeval *result, *x, *y;
+/*
+ Sectors read and written since the last poll of the disk, or since
+ resyncDiskActivity()
+ */
+static int readDiskDelta(struct diskContext *ctx,unsigned long *readSectors,unsigned long *writeSectors)
 {
-	/* Perform the carry for the later subtraction by updating y. */
-	if (x->tv_usec < y->tv_usec) {
-		int nsec = (y->tv_usec - x->tv_usec) / 1000000 + 1;
-		y->tv_usec -= 1000000 * nsec;
-		y->tv_sec += nsec;
+	unsigned long readSectorCount = ctx->sampleReadSectorCount, writeSectorCount = ctx->sampleWriteSectorCount;
+	int result;
+	
+	if(!ctx->sampled) {
+		result = readDiskSectors(ctx->config.disk,&readSectorCount,&writeSectorCount);
+		if(result < 0) return result;
 	}
-	if (x->tv_usec - y->tv_usec > 1000000) {
-		int nsec = (x->tv_usec - y->tv_usec) / 1000000;
-		y->tv_usec += 1000000 * nsec;
-		y->tv_sec -= nsec;
+	ctx->sampled = 0;
+	
+	*readSectors = readSectorCount - ctx->lastReadSectorCount;
+	*writeSectors = writeSectorCount - ctx->lastWriteSectorCount;
+	ctx->lastReadSectorCount = readSectorCount;
+	ctx->lastWriteSectorCount = writeSectorCount;
+	return 0;
+}
+
+/*
+ Takes the current sector counts as the disk's baseline, so the daemon's
+ own I/O is not taken for organic I/O, nor for reads of an array sibling by
+ the disks it is a sibling of.
+ */
+static void resyncDiskActivity(struct diskContext *ctx)
+{
+	unsigned long readSectorCount, writeSectorCount;
+	int i;
+	
+	if(readDiskSectors(ctx->config.disk,&readSectorCount,&writeSectorCount) < 0) return;
+	ctx->lastReadSectorCount = readSectorCount;
+	ctx->lastWriteSectorCount = writeSectorCount;
+	ctx->sampled = 0;
+	
+	for(i = 0; i < managedCount; i++) {
+		if(managedDisks[i] != ctx) resyncSiblingReads(&managedDisks[i]->siblings,ctx->config.disk,readSectorCount);
 	}
+}
+
+/*
+ Flushes the disk's dirty data now, while PARKED or IDLE, because the kernel
+ is about to do so on its own schedule. Costs one controlled head load, once
+ the writeback has drained and the flush is seen to have written.
+ */
+static void preemptKernelWriteback(struct diskContext *ctx)
+{
+	struct wdAntiParkConfig *config = &ctx->config;
+	unsigned long readSectorCount;
 	
-	/* Compute the time remaining to wait.
-	 tv_usec is certainly positive. */
-	result->tv_sec = x->tv_sec - y->tv_sec;
-	result->tv_usec = x->tv_usec - y->tv_usec;
+	if(readDiskSectors(config->disk,&readSectorCount,&ctx->drainWriteSectorCount) < 0) ctx->drainWriteSectorCount = 0;
+	if(config->verbose) {
+		printf("[%s] Pre-empting kernel writeback of %ld kB dirty of %s for %s.\n",formatCurrentTime(NULL,0),ctx->dirty.stats.dirtyKb,config->disk,
+			   formatSeconds(ctx->dirty.dirtySince ? (monotonicTimeMs() - ctx->dirty.dirtySince) / 1000 : 0,NULL,0));
+		fflush(stdout);
+	}
 	
-	/* Return 1 if result is negative. */
-	return x->tv_sec < y->tv_sec;
+	flushDisk(config->disk,config->globalSync,&ctx->flushReported);
+	startWritebackDrain(&ctx->drain,config->drainTimeout);
+	ctx->drainTransition = NULL;
 }
 
-// the loop that does it all
-int wdAntiParkRun(struct wdAntiParkConfig *config)
+/*
+ Settles the settings that depend on the drive: its profile, its kind and
+ the calibrated interval.
+ Returns 0, or -1 if the disk is not to be run on.
+ */
+static int configureDisk(struct wdAntiParkConfig *config)
 {
-	enum AntiParkState state = AntiPark;
-	time_t timeoutCountBegin, stateTimeBegin, antiParkStart, idleTime, lastSync;
-	int llc = 0; // estimate llc
+	int result, diskKind;
 	
-	// current antipark timeout
-	int antiParkTimeout = config->antiParkTimeout;
+	// settings for the drive model, before anything is derived from them
+	if(config->useProfiles) {
+		struct driveProfile profile;
+		result = findDriveProfile(config->disk,config->profilesFile,&profile);
+		if(result < 0) return -1;
+		if(result > 0) {
+			applyDriveProfile(&profile,config);
+			if(config->verbose) {
+				printf("[%s] Using drive profile %s for %s.\n",formatCurrentTime(NULL,0),profile.name,config->disk);
+				fflush(stdout);
+			}
+		}
+	}
 	
-	struct timeval loopStartTime, loopEndTime, loopTime;
-	suseconds_t sleepFor;
+	// only spinning disks have heads to keep loaded, and SMR disks are read
+	diskKind = readDiskKind(config->disk);
+	if(diskKind >= DiskSolidState) {
+		if(!config->forceDisk) {
+			fprintf(stderr,"Disk %s is %s, there are no heads to keep loaded (--force-disk to run anyway).\n",config->disk,diskKindName(diskKind));
+			return -1;
+		}
+		fprintf(stderr,"Warning: disk %s is %s, there are no heads to keep loaded.\n",config->disk,diskKindName(diskKind));
+	}
+	if(diskKind == DiskSmr && !config->touchEngineSet && config->touchEngine != TouchRead) {
+		config->touchEngine = TouchRead;
+		if(config->verbose) {
+			printf("[%s] Disk %s is zoned, touching it with reads.\n",formatCurrentTime(NULL,0),config->disk);
+			fflush(stdout);
+		}
+	}
 	
-	idleTime = 0; // count idle time
-	antiParkStart = time(NULL); // start time of when anti park is executed
-	timeoutCountBegin = time(NULL); // timeout timer
-	stateTimeBegin = time(NULL); // state timer
-	lastSync = time(NULL);
+	if(!config->intervalSet) {
+		char serial[128], timerStr[32];
+		int unloadTimer;
+		if(readDiskSerial(config->disk,serial,128) > 0 && (unloadTimer = loadCalibratedTimer(config->stateDir,serial)) > 0) {
+			config->interval = calibratedInterval(unloadTimer);
+			if(config->verbose) {
+				printf("[%s] Using calibrated interval %s for %s (head unload timer: %s).\n",formatCurrentTime(NULL,0),
+					   formatSeconds(config->interval,NULL,0),serial,formatSeconds(unloadTimer,timerStr,32));
+				fflush(stdout);
+			}
+		}
+	}
+	return 0;
+}
+
+static int compileDiskPolicy(struct diskContext *ctx)
+{
+	return ctx->config.policyFile[0] ? loadPolicy(ctx->config.policyFile,&ctx->policy) : builtinPolicy(&ctx->config,&ctx->policy);
+}
+
+/*
+ Sets up what needs root, so before dropping privileges. ATA commands
+ through SG_IO need root for as long as they are sent, main() refuses -u
+ and -g with them. Of the trees to warm and watch, the disk only takes
+ those on its own filesystems, so they are read while its heads are
+ loaded and not another disk's.
+ Returns 0, or -1.
+ */
+static int openDiskContext(struct diskContext *ctx)
+{
+	struct wdAntiParkConfig *config = &ctx->config;
+	char dirs[512];
+	
+	filterDiskPaths(config->disk,"--warm",config->warmDirs,dirs,512);
+	strcpy(config->warmDirs,dirs);
+	filterDiskPaths(config->disk,"--residency",config->residencyDirs,dirs,512);
+	strcpy(config->residencyDirs,dirs);
+	
+	if(touchOpen(&ctx->touch,config->touchEngine,config->disk,config->tempFile) < 0) {
+		return -1;
+	}
+	ctx->useStandby = policyHasFlag(&ctx->policy,StateStandby);
+	ctx->useAta = ctx->useStandby || config->powerPoll || config->smartInterval;
+	if(ctx->useAta && ataOpen(&ctx->ata,config->disk,config->ataBackend,config->ataMockTimer) < 0) {
+		touchClose(&ctx->touch);
+		return -1;
+	}
+	ctx->hotset = hotsetOpen(config->disk,config->hotsetGlobs,config->hotsetLearn,config->hotsetBudget,config->hotsetMlock);
+	ctx->warmer = warmerOpen(config->disk,config->warmDirs);
+	if(config->cycleBudget) budgetOpen(&ctx->budget,config->stateDir,config->disk,config->cycleBudget,config->cycleRating);
+	if(config->diurnal) diurnalOpen(&ctx->diurnal,config->stateDir,config->disk);
+	standbyInit(&ctx->standby,&ctx->ata,config->spindownInterval,config->spinupBudget);
+	powerInit(&ctx->power,&ctx->ata,config->powerPoll);
+	if(config->smartInterval) smartOpen(&ctx->smart,&ctx->ata,config->stateDir,config->disk,config->smartInterval);
+	ctx->prefetcher = prefetchOpen(config->disk,config->prefetchWindow,config->prefetchBudget);
+	ctx->residency = residencyOpen(config->residencyDirs);
+	return 0;
+}
+
+static void closeDiskContext(struct diskContext *ctx)
+{
+	struct wdAntiParkConfig *config = &ctx->config;
+	
+	if(config->smartInterval) smartClose(&ctx->smart);
+	touchClose(&ctx->touch);
+	if(ctx->useAta) ataClose(&ctx->ata);
+	if(config->cycleBudget) budgetClose(&ctx->budget);
+	if(config->diurnal) diurnalClose(&ctx->diurnal);
+	prefetchClose(ctx->prefetcher);
+	residencyClose(ctx->residency);
+	warmerClose(ctx->warmer);
+	hotsetClose(ctx->hotset);
+}
+
+/*
+ Starts the disk's state machine in the first state of its policy, to be
+ polled right away.
+ */
+static void diskStart(struct diskContext *ctx)
+{
+	struct wdAntiParkConfig *config = &ctx->config;
+	const struct policy *policy = &ctx->policy;
+	int i;
+	
+	ctx->state = 0;
+	for(i = 0; i < policy->stateCount; i++) ctx->timeouts[i] = policy->states[i].timeout;
+	gapModelInit(&ctx->gaps,config);
+	ctx->tick = touchPollInterval(config->pollInterval,config->interval);
+	
+	ctx->idleTime = 0; // count idle time
+	ctx->antiParkStart = time(NULL); // start time of when anti park is executed
+	ctx->timeoutCountBegin = time(NULL); // timeout timer
+	ctx->stateTimeBegin = time(NULL); // state timer
+	ctx->lastSync = time(NULL);
+	ctx->wakeAt = 0;
 	if(config->verbose) {
-		printf("[%s] Starting wdantiparkd.\n",formatCurrentTime(NULL,0));
-		printf("[%s] Settings:\n",formatCurrentTime(NULL,0));
+		printf("[%s] Settings for %s:\n",formatCurrentTime(NULL,0),config->disk);
 		printf("[%s]  Interval: %s\n",formatCurrentTime(NULL,0),formatSeconds(config->interval,NULL,0));
+		printf("[%s]  Poll Interval: %s\n",formatCurrentTime(NULL,0),formatSeconds(ctx->tick,NULL,0));
 		printf("[%s]  AntiPark Timeout: %s\n",formatCurrentTime(NULL,0),formatSeconds(config->antiParkTimeout,NULL,0));
 		printf("[%s]  AntiPark Timeout Max: %s\n",formatCurrentTime(NULL,0),formatSeconds(config->antiParkTimeoutMax,NULL,0));
 		printf("[%s]  Parked Timeout: %s\n",formatCurrentTime(NULL,0),formatSeconds(config->parkedTimeout,NULL,0));
 		printf("[%s]  Sync before IDLE: %s\n",formatCurrentTime(NULL,0),config->syncBeforeIdle ? "true" : "false");
+		printf("[%s]  Touch Engine: %s\n",formatCurrentTime(NULL,0),touchEngineName(ctx->touch.type));
+		printf("[%s]  Policy: %s (%d states)\n",formatCurrentTime(NULL,0),policy->source,policy->stateCount);
 		fflush(stdout);
 	}
 	
-	// infinite loop
-	while(!terminateProgram) {
-		int haveReadActivity, haveWriteActivity;
+	if(config->stagger) ctx->touchPhase = touchPhaseMs(config->disk,config->interval,config->verbose);
+	
+	if(findDiskSiblings(config->disk,config->groups,config->autoGroup,&ctx->siblings) > 0 && config->verbose) {
+		printf("[%s] Array siblings of %s:",formatCurrentTime(NULL,0),config->disk);
+		for(i = 0; i < ctx->siblings.count; i++) printf(" %s",ctx->siblings.disk[i]);
+		printf("\n");
+		fflush(stdout);
+	}
+}
+
+/*
+ Polls the disk's state machine once, and sets when it is due next.
+ Returns 0, or -ENODEV once the disk is gone.
+ */
+/*
+ Enters the state a transition leads to: counts the cycle, spins down on
+ entering standby and resets the timers.
+ */
+static void enterState(struct diskContext *ctx,const struct policyTransition *transition)
+{
+	struct wdAntiParkConfig *config = &ctx->config;
+	const struct policyState *cur = &ctx->policy.states[ctx->state], *next = &ctx->policy.states[transition->to];
+	struct standby *standby = ctx->useStandby ? &ctx->standby : NULL;
+	
+	// llc + 1
+	if(transition->actions & ActionCycle) ctx->llc++;
+	
+	// spin down on entering standby
+	if((next->flags & StateStandby) && !(cur->flags & StateStandby) && standbyEnter(standby,config->verbose) == 0) {
+		resyncDiskActivity(ctx);
+	}
+	
+	// change states reset timers
+	ctx->timeoutCountBegin = time(NULL);
+	ctx->stateTimeBegin = time(NULL);
+	ctx->state = transition->to;
+	
+	// loaded heads start a new write budget
+	if(next->flags & StateTouch) ctx->absorbedKb = 0;
+}
 
-		// grab
-		gettimeofday(&loopStartTime,NULL);
+/*
+ Takes a sample of the pending drain. Once the writeback has drained or
+ timed out, the transition waiting for it is taken, or the pre-emptive
+ flush is counted as a cycle if it wrote to the disk.
+ Returns 1 while the drain is still pending.
+ */
+static int pollDrain(struct diskContext *ctx)
+{
+	struct wdAntiParkConfig *config = &ctx->config;
+	unsigned long readSectorCount, writtenSectorCount;
+	int result = pollWritebackDrain(config->disk,&ctx->drain);
+	
+	if(result == 0) return 1;
+	if(ctx->drainTransition) {
+		if(result < 0) {
+			printf("[%s] Writeback of %s did not drain within %s.\n",formatCurrentTime(NULL,0),config->disk,formatSeconds(config->drainTimeout,NULL,0));
+			fflush(stdout);
+		}
+		ctx->lastSync = time(NULL);
 		
-		// check for disk activity
-		checkForDiskActivity(config->disk,&haveReadActivity,&haveWriteActivity);
+		// sync stats
+		resyncDiskActivity(ctx);
+		enterState(ctx,ctx->drainTransition);
+		ctx->drainTransition = NULL;
+	} else {
+		if(readDiskSectors(config->disk,&readSectorCount,&writtenSectorCount) == 0 && writtenSectorCount != ctx->drainWriteSectorCount) ctx->llc++;
 		
-		switch(state) {
-			case AntiPark:
-				// if there is read activity, reset timeout count
-				if(haveReadActivity) {
-					timeoutCountBegin = time(NULL);
-				}
-				
-				// write some random data, and sync to keep head's unparked
-				int tmpFileFp = open(config->tempFile,O_WRONLY | O_TRUNC | O_CREAT | O_SYNC,0600);
-				if(tmpFileFp < 0) {
-					fprintf(stderr,"Failed to open tmp file '%s' for writing.\n",config->tempFile);
-					return -errno;
-				}
-				write(tmpFileFp,&antiParkStart,4);
-				close(tmpFileFp);
-				
-				if(time(NULL) - lastSync > 30) {
-					sync(); // force sync every 30 secs
-					lastSync = time(NULL);
-				}
-				
-				if((time(NULL) - timeoutCountBegin) > antiParkTimeout) {
-					if(config->verbose) {
-						printf("[%s] Switching state to PARKED. Time spent in ANTIPARK: %s.\n",formatCurrentTime(NULL,0),formatSeconds(time(NULL) - stateTimeBegin,NULL,0));
-						fflush(stdout);
-					}
-					timeoutCountBegin = time(NULL);
-					stateTimeBegin = time(NULL);
-					state = Parked;
-					
-					sync();
-					sleep(1);
+		// the flush is not an interruption
+		resyncDiskActivity(ctx);
+		updateDirtyMonitor(config->disk,&ctx->dirty);
+	}
+	return 0;
+}
 
-					// sync stats
-					checkForDiskActivity(config->disk,NULL,NULL);
-					
-					// llc + 1
-					llc++;
-				}
-				break;
-			case Parked:
-				if(haveReadActivity || haveWriteActivity) {
-					// if PARKED is interrupted, then restart ANTIPARK with timeout * 2
-					antiParkTimeout *= 2; 
-					if(antiParkTimeout > config->antiParkTimeoutMax) 
-						antiParkTimeout = config->antiParkTimeoutMax;
-					
-					if(config->verbose) {
-						char timeoutStr[32], timeSpentStr[32];
-						time_t parkedTime = time(NULL) - stateTimeBegin;
-						idleTime += parkedTime;
-						printf("[%s] Switching state to ANTIPARK with timeout: %s. Time spent in PARKED: %s.\n",
-							   formatCurrentTime(NULL,0),formatSeconds(antiParkTimeout,timeoutStr,32),formatSeconds(parkedTime,timeSpentStr,32));
+static int diskTick(struct diskContext *ctx)
+{
+	struct wdAntiParkConfig *config = &ctx->config;
+	const struct policy *policy = &ctx->policy;
+	struct touchEngine *touch = &ctx->touch;
+	struct cycleBudget *budget = config->cycleBudget ? &ctx->budget : NULL;
+	struct diurnal *diurnal = config->diurnal ? &ctx->diurnal : NULL;
+	struct standby *standby = ctx->useStandby ? &ctx->standby : NULL;
+	struct powerMonitor *power = config->powerPoll ? &ctx->power : NULL;
+	struct smartLog *smart = config->smartInterval ? &ctx->smart : NULL;
+	struct hotSet *hotset = ctx->hotset;
+	struct residency *residency = ctx->residency;
+	struct metaWarmer *warmer = ctx->warmer;
+	struct prefetcher *prefetcher = ctx->prefetcher;
+	int haveReadActivity = 0, haveWriteActivity = 0, headsParked, timeout, result;
+	unsigned long readSectors = 0, writeSectors = 0;
+	const struct policyState *cur;
+	const struct policyTransition *transition;
+	unsigned int conditions;
+	const char *siblingReader;
+	long long loopStart = monotonicTimeMs();
+	
+	// the state machine waits while a flush drains
+	if(ctx->drain.deadline && pollDrain(ctx)) {
+		ctx->wakeAt = loopStart + DRAIN_POLL_MS;
+		ctx->wakeForTouch = 0;
+		return 0;
+	}
+	
+	// check for disk activity, retried a tick later on errors
+	result = readDiskDelta(ctx,&readSectors,&writeSectors);
+	if(result < 0) {
+		if(!diskAttached(config->disk)) return -ENODEV;
+		if(!ctx->statErrors++) fprintf(stderr,"Could not read I/O stats of %s (%s), retrying.\n",config->disk,strerror(-result));
+		ctx->wakeAt = loopStart + ctx->tick * 1000LL;
+		ctx->wakeForTouch = 0;
+		return 0;
+	}
+	if(ctx->statErrors && config->verbose) {
+		printf("[%s] I/O stats of %s are back after %d failed reads.\n",formatCurrentTime(NULL,0),config->disk,ctx->statErrors);
+		fflush(stdout);
+	}
+	ctx->statErrors = 0;
+	haveReadActivity = readSectors != 0;
+	haveWriteActivity = writeSectors != 0;
+	if(power) powerPoll(power,0,config->verbose);
+	
+	// the I/O happened some time after the previous sample, assume the earliest
+	if(haveReadActivity || haveWriteActivity) ctx->lastOrganicIo = ctx->lastSample;
+	ctx->lastSample = loopStart;
+	
+	gapModelSample(&ctx->gaps,loopStart,haveReadActivity || haveWriteActivity,
+				   (policy->states[ctx->state].poll ? policy->states[ctx->state].poll : ctx->tick) * 1000);
+	if(diurnal) diurnalSample(diurnal,haveReadActivity || haveWriteActivity,policy->states[ctx->state].flags & StateTouch);
+	
+	// a read on a sibling means the array is in use
+	siblingReader = ctx->siblings.count ? checkForSiblingReads(&ctx->siblings) : NULL;
+	if(siblingReader && !(policy->states[ctx->state].flags & StateTouch) && config->verbose) {
+		printf("[%s] Pre-waking %s with array sibling %s.\n",formatCurrentTime(NULL,0),config->disk,siblingReader);
+		fflush(stdout);
+	}
+	
+	headsParked = !(policy->states[ctx->state].flags & StateTouch) && !haveReadActivity;
+	if(hotset) hotsetPoll(hotset,headsParked);
+	if(warmer) warmerPoll(warmer,headsParked);
+	if(prefetcher) prefetchPoll(prefetcher);
+	
+	if(residency && residencySampleCandidates(residency) && !(policy->states[ctx->state].flags & StateTouch) && config->verbose) {
+		printf("[%s] Page cache is evicting likely wake sources.\n",formatCurrentTime(NULL,0));
+		fflush(stdout);
+	}
+	
+	if(config->preemptWriteback || config->writebackThreshold) updateDirtyMonitor(config->disk,&ctx->dirty);
+	
+	// organic I/O loaded the heads, piggyback the writeback on it
+	if(config->writebackThreshold && (haveReadActivity || haveWriteActivity) &&
+	   loopStart - ctx->lastOpportunisticFlush >= config->writebackInterval * 1000LL &&
+	   isOpportunisticWritebackDue(&ctx->dirty,config->writebackThreshold)) {
+		if(config->verbose) {
+			printf("[%s] Writing back %ld kB dirty of %s along with disk activity.\n",formatCurrentTime(NULL,0),ctx->dirty.stats.dirtyKb,config->disk);
+			fflush(stdout);
+		}
+		flushDisk(config->disk,config->globalSync,&ctx->flushReported);
+		ctx->lastOpportunisticFlush = loopStart;
+		ctx->lastSync = time(NULL);
+		
+		// its writes are ours, not more organic I/O
+		resyncDiskActivity(ctx);
+	}
+	
+	cur = &policy->states[ctx->state];
+	
+	// small writes on their own are left to the write buffering, up to a budget
+	if(cur->absorb && haveWriteActivity && !haveReadActivity && !siblingReader &&
+	   writeSectors / 2 <= (unsigned long)cur->absorb && ctx->absorbedKb + writeSectors / 2 <= (unsigned long)cur->absorbBudget) {
+		ctx->absorbedKb += writeSectors / 2;
+		ctx->absorbedTotalKb += writeSectors / 2;
+		ctx->absorbedWrites++;
+		haveWriteActivity = 0;
+		if(config->verbose) {
+			printf("[%s] Absorbed %lu kB write to %s in %s (%lu of %d kB).\n",formatCurrentTime(NULL,0),writeSectors / 2,config->disk,cur->label,ctx->absorbedKb,cur->absorbBudget);
+			fflush(stdout);
+		}
+	}
+	
+	// reads keep the state alive
+	if((cur->flags & StateExtend) && (haveReadActivity || siblingReader)) {
+		ctx->timeoutCountBegin = time(NULL);
+	}
+	
+	conditions = (haveReadActivity || haveWriteActivity || siblingReader) ? CondActivity : CondQuiet;
+	if(haveReadActivity || siblingReader) conditions |= CondRead;
+	timeout = budget ? budgetTimeout(budget,ctx->timeouts[ctx->state]) : ctx->timeouts[ctx->state];
+	if(cur->timeout && (time(NULL) - ctx->timeoutCountBegin) > timeout) conditions |= CondTimeout;
+	if(cur->timeout && (time(NULL) - ctx->timeoutCountBegin) > (budget ? budgetTimeout(budget,cur->timeoutMax) : cur->timeoutMax)) conditions |= CondMaxTimeout;
+	
+	// what the learned schedule expects of this hour
+	if(diurnal) {
+		enum HourClass hourClass = diurnalClass(diurnal);
+		conditions |= hourClass == HourBusy ? CondBusy : hourClass == HourDead ? CondDead : CondNormal;
+		if(diurnalPrewake(diurnal)) conditions |= CondPrewake;
+	} else {
+		conditions |= CondNormal;
+	}
+	
+	if(standby && standbyAllowed(standby)) conditions |= CondSpindown;
+	if(power && power->mode == PowerStandby && (conditions & CondQuiet)) conditions |= CondAsleep;
+	
+	transition = matchTransition(policy,ctx->state,conditions);
+	if(transition) {
+		const struct policyState *next = &policy->states[transition->to];
+		time_t timeInState = time(NULL) - ctx->stateTimeBegin;
+		
+		if(!(cur->flags & StateTouch)) ctx->idleTime += timeInState;
+		
+		// whatever leaves standby spins the disk up
+		if((cur->flags & StateStandby) && !(next->flags & StateStandby)) standbySpinup(standby);
+		
+		if(transition->actions & ActionBackoff) {
+			ctx->timeouts[transition->to] *= 2;
+			if(ctx->timeouts[transition->to] > next->timeoutMax) ctx->timeouts[transition->to] = next->timeoutMax;
+		}
+		if(transition->actions & ActionReset) ctx->timeouts[transition->to] = next->timeout;
+		if(transition->actions & ActionPredict) ctx->timeouts[transition->to] = gapModelTimeout(&ctx->gaps);
+		
+		if(transition->conditions & CondPrewake) {
+			diurnalPrewakeTaken(diurnal);
+			if(config->verbose) {
+				printf("[%s] Pre-waking %s ahead of a busy hour.\n",formatCurrentTime(NULL,0),config->disk);
+				fflush(stdout);
+			}
+		}
+		
+		if((transition->actions & ActionLearn) && haveReadActivity) {
+			if(hotset) hotsetLearnWake(hotset);
+			if(prefetcher) prefetchWake(prefetcher,config->verbose);
+		}
+		
+		if(config->verbose) {
+			char timeoutStr[32], timeSpentStr[32];
+			printf("[%s] Switching %s to %s",formatCurrentTime(NULL,0),config->disk,next->label);
+			if(next->timeout) printf(" with timeout: %s",formatSeconds(budget ? budgetTimeout(budget,ctx->timeouts[transition->to]) : ctx->timeouts[transition->to],timeoutStr,32));
+			printf(". Time spent in %s: %s.\n",cur->label,formatSeconds(timeInState,timeSpentStr,32));
+			fflush(stdout);
+		}
+		
+		if((transition->actions & ActionStats) && config->verbose) {
+			time_t uptime = time(NULL) - ctx->antiParkStart;
+			double hours = (uptime / 3600.0f);
+			double llcPerHour = hours > 0.0f ? (ctx->llc / hours) : ctx->llc;
+			printf("[%s] Current stats of %s - uptime: %s, ",formatCurrentTime(NULL,0),config->disk,formatSeconds(uptime,NULL,0));
+			printf("idle time: %s, ",formatSeconds(ctx->idleTime,NULL,0));
+			printf("%% idle: %ld%%, ",uptime ? ctx->idleTime * 100 / uptime : 0);
+			printf("est. LLC/hr: %.2g, ",llcPerHour);
+			printf("touches: %lu, ",ctx->touches);
+			printf("writes absorbed: %lu (%lu kB)\n",ctx->absorbedWrites,ctx->absorbedTotalKb);
+			if(hotset) {
+				printf("[%s] Hot-set - files: %d, pinned: %lld kB, wakes learned: %lu, wakes avoided: %lu\n",formatCurrentTime(NULL,0),
+					   hotset->count,hotset->pinnedBytes >> 10,hotset->wakesLearned,hotset->wakesAvoided);
+			}
+			if(config->predictiveTimeout) gapModelReport(&ctx->gaps);
+			if(budget) budgetReport(budget);
+			if(diurnal) diurnalReport(diurnal);
+			if(standby) standbyReport(standby);
+			if(power) powerReport(power);
+			if(smart) smartReport(smart,policy);
+			if(residency) residencyReport(residency);
+			if(warmer) {
+				printf("[%s] Metadata - entries warmed: %lu, directories held: %d, listings while parked: %lu\n",formatCurrentTime(NULL,0),
+					   warmer->lastPassEntries,warmer->count,warmer->listingsWhileParked);
+			}
+			if(prefetcher) {
+				printf("[%s] Prefetch - sequences: %d, wakes: %lu, bursts: %lu, files read ahead: %lu, hits: %lu\n",formatCurrentTime(NULL,0),
+					   prefetcher->count,prefetcher->wakes,prefetcher->bursts,prefetcher->filesPrefetched,prefetcher->hits);
+			}
+			fflush(stdout);
+		}
+		
+		// the drive's own count, while the heads are still loaded
+		if(smart && (cur->flags & StateTouch) && !(next->flags & StateTouch)) smartLeave(smart,policy,ctx->state,transition->to,config->verbose);
+		
+		// the state is entered once the writeback has drained
+		if(transition->actions & ActionDrain) {
+			flushDisk(config->disk,config->globalSync,&ctx->flushReported);
+			startWritebackDrain(&ctx->drain,config->drainTimeout);
+			ctx->drainTransition = transition;
+		} else {
+			enterState(ctx,transition);
+		}
+	} else {
+		// write some random data, and sync to keep head's unparked,
+		// unless organic I/O has already done so within the interval
+		if(cur->flags & StateTouch) {
+			if(smart && !(power && power->mode == PowerStandby)) smartPoll(smart,policy,ctx->state,config->verbose);
+			
+			ctx->nextTouch = touchDeadline(ctx->lastTouch,ctx->lastOrganicIo,config->interval,config->stagger ? ctx->touchPhase : -1);
+			
+			// a touch would only spin up a drive that went to sleep
+			if(loopStart >= ctx->nextTouch && power && powerPoll(power,1,config->verbose) == PowerStandby) {
+				ctx->lastTouch = loopStart;
+				ctx->nextTouch = ctx->lastTouch + config->interval * 1000LL;
+				power->touchesSkipped++;
+			}
+			if(loopStart >= ctx->nextTouch) {
+				result = touchDisk(touch);
+				if(result < 0 && !diskAttached(config->disk)) return -ENODEV;
+				
+				// a failed touch is tried again at the next interval, not every tick
+				ctx->lastTouch = loopStart;
+				ctx->nextTouch = ctx->lastTouch + config->interval * 1000LL;
+				if(result < 0) {
+					if(!ctx->touchErrors++) fprintf(stderr,"Failed to touch %s with a %s (%s), retrying.\n",config->disk,touchEngineName(touch->type),strerror(-result));
+				} else {
+					if(ctx->touchErrors && config->verbose) {
+						printf("[%s] Touching %s again after %d failures.\n",formatCurrentTime(NULL,0),config->disk,ctx->touchErrors);
 						fflush(stdout);
 					}
+					ctx->touchErrors = 0;
+					ctx->touches++;
 					
-					timeoutCountBegin = time(NULL);
-					stateTimeBegin = time(NULL);
-					state = AntiPark;
-					continue;
-				} else {
-					if((time(NULL) - timeoutCountBegin) > config->parkedTimeout) {
-						if(config->verbose) {
-							time_t parkedTime = time(NULL) - stateTimeBegin;
-							idleTime += parkedTime;
-							printf("[%s] Switching state to IDLE. Time spent in PARKED: %s.\n",formatCurrentTime(NULL,0),formatSeconds(parkedTime,NULL,0));
-							fflush(stdout);
-						}
-						
-						// reset counters
-						timeoutCountBegin = time(NULL);
-						stateTimeBegin = time(NULL);
-						state = Idle;
-						
-						if(config->syncBeforeIdle) {
-							printf("[%s] Syncing disks.\n",formatCurrentTime(NULL,0));
-							fflush(stdout);
-							
-							// sync disk first
-							sync();
-							sleep(1);
-							
-							// sync stats
-							checkForDiskActivity(config->disk,NULL,NULL);
-							
-							llc++;
-						}
-						
-						// change states reset timers
-						timeoutCountBegin = time(NULL);
-						stateTimeBegin = time(NULL);
-						state = Idle;
-						continue;
-					} 
-				}
-				break;
-			case Idle:
-				if(!haveReadActivity && !haveWriteActivity) break;
-				
-				antiParkTimeout = config->antiParkTimeout;
-				
-				if(config->verbose) {
-					char timeoutStr[32], timeSpentStr[32];
-					time_t parkedTime = time(NULL) - stateTimeBegin;
-					time_t uptime = time(NULL) - antiParkStart;
-					double hours = (uptime / 3600.0f);
-					double llcPerHour = hours >= 0.0f ? (llc / hours) : llc;
-					idleTime += parkedTime;
-					printf("[%s] Switch state to ANTIPARK with timeout: %s. Time spent in IDLE: %s.\n",
-						   formatCurrentTime(NULL,0),formatSeconds(antiParkTimeout,timeoutStr,32),formatSeconds(parkedTime,timeSpentStr,32));
-					printf("[%s] Current stats - uptime: %s, ",formatCurrentTime(NULL,0),formatSeconds(uptime,NULL,0));
-					printf("idle time: %s, ",formatSeconds(idleTime,NULL,0));
-					printf("%% idle: %ld%%, ",idleTime * 100 / uptime);
-					printf("est. LLC/hr: %.2g\n",llcPerHour);
-					fflush(stdout);
+					// our own write is not organic I/O
+					resyncDiskActivity(ctx);
 				}
-				
-				// change states reset timers
-				timeoutCountBegin = time(NULL);
-				stateTimeBegin = time(NULL);
-				state = AntiPark;
-				continue;
+			}
+		}
+		
+		if(cur->flags & StateMaintain) {
+			// read the hot-set in while the heads are loaded
+			if(hotset && hotsetMaintain(hotset) > 0) {
+				resyncDiskActivity(ctx);
+			}
+			
+			// the residency walk reads metadata, also only with the heads loaded
+			if(residency && residencyScan(residency,RESIDENCY_ENTRIES_PER_TICK) > 0) {
+				resyncDiskActivity(ctx);
+			}
+			
+			// pull metadata back into the dentry and inode caches
+			if(warmer && warmerWalk(warmer,WARM_ENTRIES_PER_TICK) > 0) {
+				resyncDiskActivity(ctx);
+			}
+		}
+		
+		if(cur->flush && time(NULL) - ctx->lastSync > cur->flush) {
+			flushDisk(config->disk,config->globalSync,&ctx->flushReported);
+			ctx->lastSync = time(NULL);
+		}
+		
+		if((cur->flags & StatePreempt) && (conditions & CondQuiet) && config->preemptWriteback &&
+		   isKernelWritebackImminent(&ctx->dirty,(cur->poll ? cur->poll : ctx->tick) * 1000L + 1000)) {
+			preemptKernelWriteback(ctx);
+		}
+	}
+	
+	if(budget) budgetUpdate(budget,ctx->llc,ctx->touches,policy->states[ctx->state].flags & StateTouch);
+	
+	if(ctx->drain.deadline) {
+		ctx->wakeAt = loopStart + DRAIN_POLL_MS;
+		ctx->wakeForTouch = 0;
+		return 0;
+	}
+	
+	// due at the next poll, or the touch deadline if it comes first
+	cur = &policy->states[ctx->state];
+	ctx->wakeAt = loopStart + (cur->poll ? cur->poll : ctx->tick) * 1000LL;
+	ctx->wakeForTouch = (cur->flags & StateTouch) && ctx->nextTouch < ctx->wakeAt;
+	if(ctx->wakeForTouch) ctx->wakeAt = ctx->nextTouch;
+	return 0;
+}
+
+/*
+ Sets up a context for the disk with its settings and policy, nothing is
+ opened yet. An empty tempFile keeps the one of config. A disk found by
+ --match has none, NULL, and is touched with reads: the temp file of
+ config lives on another disk.
+ Returns the context, or NULL if the disk is not to be run on.
+ */
+static struct diskContext *prepareDisk(const struct wdAntiParkConfig *config,const char *disk,const char *tempFile)
+{
+	struct diskContext *ctx = calloc(1,sizeof(struct diskContext));
+	
+	if(!ctx) return NULL;
+	ctx->config = *config;
+	strncpy(ctx->config.disk,disk,16);
+	ctx->config.disk[15] = 0;
+	if(!tempFile) {
+		ctx->config.touchEngine = TouchRead;
+		ctx->config.touchEngineSet = 1;
+	} else if(tempFile[0]) {
+		strncpy(ctx->config.tempFile,tempFile,128);
+		ctx->config.tempFile[127] = 0;
+	}
+	
+	if(configureDisk(&ctx->config) < 0 || compileDiskPolicy(ctx) < 0) {
+		free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+/*
+ Opens what the disk needs and hands it to the scheduler.
+ Returns 0, or -1 with the context freed.
+ */
+static int addDisk(struct diskContext *ctx)
+{
+	int i;
+	
+	if(managedCount >= MAX_DISKS) {
+		fprintf(stderr,"Too many disks, %s is not managed (%d max).\n",ctx->config.disk,MAX_DISKS);
+		free(ctx);
+		return -1;
+	}
+	if(openDiskContext(ctx) < 0) {
+		free(ctx);
+		return -1;
+	}
+	
+	// a temp file lives on one disk, the write touches keep only that one loaded
+	for(i = 0; i < managedCount; i++) {
+		struct diskContext *other = managedDisks[i];
+		if(ctx->touch.type == TouchWrite && other->touch.type == TouchWrite && !strcmp(ctx->config.tempFile,other->config.tempFile)) {
+			fprintf(stderr,"Warning: %s and %s are touched through the same temp file '%s'.\n",other->config.disk,ctx->config.disk,ctx->config.tempFile);
+		}
+	}
+	
+	diskStart(ctx);
+	managedDisks[managedCount++] = ctx;
+	return 0;
+}
+
+static void removeDisk(int i)
+{
+	closeDiskContext(managedDisks[i]);
+	free(managedDisks[i]);
+	memmove(&managedDisks[i],&managedDisks[i + 1],(managedCount - i - 1) * sizeof(struct diskContext *));
+	managedCount--;
+}
+
+static int findManagedDisk(const char *disk)
+{
+	int i;
+	
+	for(i = 0; i < managedCount; i++) {
+		if(!strcmp(managedDisks[i]->config.disk,disk)) return i;
+	}
+	return -1;
+}
+
+/*
+ Sleeps until wakeAt. With --match, matching disks are added and removed
+ as their uevents arrive, which ends the sleep early.
+ */
+static void sleepUntil(long long wakeAt,struct hotplug *hotplug,const struct wdAntiParkConfig *config)
+{
+	struct hotplugEvent event;
+	long long remaining = wakeAt - monotonicTimeMs();
+	int i;
+	
+	if(remaining <= 0) return;
+	if(!hotplug) {
+		usleep(remaining * 1000);
+		return;
+	}
+	if(!hotplugWait(hotplug,remaining)) return;
+	
+	while(hotplugNext(hotplug,&event)) {
+		i = findManagedDisk(event.disk);
+		if(event.action == HotplugRemove && i >= 0) {
+			if(config->verbose) {
+				printf("[%s] Detached %s.\n",formatCurrentTime(NULL,0),event.disk);
+				fflush(stdout);
+			}
+			removeDisk(i);
+		} else if(event.action == HotplugAdd && i < 0 && diskMatches(event.disk,config->matchPattern)) {
+			struct diskContext *ctx = prepareDisk(config,event.disk,NULL);
+			if(ctx && addDisk(ctx) == 0 && config->verbose) {
+				printf("[%s] Attached %s matching %s.\n",formatCurrentTime(NULL,0),event.disk,config->matchPattern);
+				fflush(stdout);
+			}
+		}
+	}
+}
+
+/*
+ The loop that does it all. Drives the state machines of all managed disks:
+ each round samples /proc/diskstats once, polls the disks that are due and
+ sleeps until the next one is. Polls due within COALESCE_MS are taken
+ along in the same round. Touch deadlines are kept as they are, so
+ staggered touches stay apart.
+ Returns 0, or -ENODEV once all disks are gone and none can come back.
+ */
+int wdAntiParkRun(const struct wdAntiParkConfig *config,struct hotplug *hotplug)
+{
+	int result = 0;
+	int i;
+	
+	// write buffering follows the states, buffered while all disks are parked,
+	// original values kept in the state directory and restored on exit
+	struct laptopModeSettings originalLaptopMode, laptopMode;
+	int laptopModeControl = config->laptopMode, buffered = -1;
+	long originalCachePressure = -1;
+	
+	if(laptopModeControl && readLaptopMode(&originalLaptopMode) < 0) {
+		fprintf(stderr,"Failed to read laptop mode settings.\n");
+		laptopModeControl = 0;
+	}
+	
+	// the current values are our own if the last run was killed before restoring
+	if(laptopModeControl && loadLaptopMode(config->stateDir,&originalLaptopMode) == 0 && config->verbose) {
+		printf("[%s] Restoring the laptop mode settings left by the previous run.\n",formatCurrentTime(NULL,0));
+		fflush(stdout);
+	}
+	
+	// for the metadata of the warmed trees, of all disks as they come and go
+	if(config->vfsCachePressure && config->warmDirs[0]) {
+		originalCachePressure = readVmValue("vfs_cache_pressure");
+		if(originalCachePressure < 0 || writeVmValue("vfs_cache_pressure",config->vfsCachePressure) < 0) {
+			fprintf(stderr,"Failed to set vfs_cache_pressure (root required).\n");
+			originalCachePressure = -1;
 		}
+	}
+	
+	// infinite loop
+	while(!terminateProgram) {
+		long long wakeAt;
+		int sampled = 0;
 		
-		gettimeofday(&loopEndTime,NULL);
+		for(i = 0; i < managedCount; i++) {
+			struct diskContext *ctx = managedDisks[i];
+			long long now = monotonicTimeMs();
+			
+			if(ctx->wakeAt > now && (ctx->wakeForTouch || ctx->wakeAt - now > COALESCE_MS)) continue;
+			if(!sampled) {
+				sampleDisks();
+				sampled = 1;
+			}
+			if(diskTick(ctx) < 0) {
+				fprintf(stderr,"Disk %s is gone.\n",ctx->config.disk);
+				removeDisk(i--);
+			}
+		}
+		if(!managedCount && !hotplug) {
+			result = -ENODEV;
+			break;
+		}
 		
-		// compute the time the loop took
-		timeval_subtract(&loopTime,&loopEndTime,&loopStartTime);
+		// buffer writes in RAM while the heads of all disks are parked
+		if(laptopModeControl) {
+			int allBuffered = managedCount > 0;
+			for(i = 0; i < managedCount; i++) {
+				if(!(managedDisks[i]->policy.states[managedDisks[i]->state].flags & StateBuffer)) allBuffered = 0;
+			}
+			if(allBuffered != buffered) {
+				if(allBuffered) bufferedLaptopMode(&originalLaptopMode,config->laptopMode,&laptopMode);
+				else promptLaptopMode(&originalLaptopMode,&laptopMode);
+				if(buffered < 0 && saveLaptopMode(config->stateDir,&originalLaptopMode) < 0)
+					fprintf(stderr,"Failed to save the laptop mode settings to '%s', they are lost if the daemon is killed.\n",config->stateDir);
+				if(writeLaptopMode(&laptopMode) < 0 && buffered < 0) {
+					fprintf(stderr,"Failed to take over laptop mode, root required.\n");
+					if(writeLaptopMode(&originalLaptopMode) == 0) forgetLaptopMode(config->stateDir);
+					laptopModeControl = 0;
+				}
+				buffered = allBuffered;
+			}
+		}
 		
-		// sleep for interval seconds minus loop time
-		sleepFor = (config->interval * 1000000) - (loopTime.tv_sec * 1000000 + loopTime.tv_usec);
-		if((useconds_t)sleepFor < config->interval * 1000000)
-			usleep(sleepFor);
+		// sleep until the first disk is due
+		wakeAt = monotonicTimeMs() + 60000;
+		for(i = 0; i < managedCount; i++) {
+			if(managedDisks[i]->wakeAt < wakeAt) wakeAt = managedDisks[i]->wakeAt;
+		}
+		sleepUntil(wakeAt,hotplug,config);
 	}
 	
+	if(laptopModeControl && writeLaptopMode(&originalLaptopMode) == 0) forgetLaptopMode(config->stateDir);
+	if(originalCachePressure >= 0) writeVmValue("vfs_cache_pressure",originalCachePressure);
+	
 	if(config->verbose) {
 		printf("[%s] Shutting down. Done.\n",formatCurrentTime(NULL,0));
 	}
-	return 0;
+	return result;
 }
 
+// long options without a short equivalent
+enum
+{
+	OptionCalibrateMax = 256,
+	OptionStateDir,
+	OptionNoStagger,
+	OptionArray,
+	OptionNoAutoArray,
+	OptionGlobalSync,
+	OptionDrainTimeout,
+	OptionNoWritebackPreempt,
+	OptionLaptopMode,
+	OptionWritebackThreshold,
+	OptionWritebackInterval,
+	OptionHotset,
+	OptionHotsetLearn,
+	OptionHotsetBudget,
+	OptionHotsetFadvise,
+	OptionResidency,
+	OptionWarm,
+	OptionVfsCachePressure,
+	OptionPrefetch,
+	OptionPrefetchBudget,
+	OptionPolicy,
+	OptionPrintPolicy,
+	OptionPredictiveTimeout,
+	OptionCycleBudget,
+	OptionCycleRating,
+	OptionDiurnal,
+	OptionAbsorbWrites,
+	OptionAbsorbBudget,
+	OptionStandby,
+	OptionSpindownInterval,
+	OptionSpinupBudget,
+	OptionAtaBackend,
+	OptionPowerPoll,
+	OptionSmart,
+	OptionProfiles,
+	OptionNoProfile,
+	OptionTouch,
+	OptionForceDisk,
+	OptionMatch
+};
+
 int main(int argc,char *argv[])
 {
 	int daemonize = 0;
+	int calibrate = 0;
+	int result;
+	char diskNames[MAX_DISKS][16], diskTempFiles[MAX_DISKS][128], matched[MAX_DISKS][16];
+	struct diskContext *prepared[MAX_DISKS];
+	int diskCount = 0, firstMatched = MAX_DISKS;
+	int i, j, found;
+	char *separator;
+	struct hotplug hotplug;
+	int printPolicy = 0;
 	struct passwd *pw;
 	struct group *gr;
 	uid_t user = 0;
@@ -408,62 +1194,418 @@ int main(int argc,char *argv[])
 		{ "group", required_argument, NULL, 'g' },
 		{ "log", required_argument, NULL, 'l' },
 		{ "pid-file", required_argument, NULL, 'y' },
+		{ "poll-interval", required_argument, NULL, 'P' },
+		{ "calibrate", no_argument, NULL, 'C' },
+		{ "calibrate-max", required_argument, NULL, OptionCalibrateMax },
+		{ "state-dir", required_argument, NULL, OptionStateDir },
+		{ "no-stagger", no_argument, NULL, OptionNoStagger },
+		{ "array", required_argument, NULL, OptionArray },
+		{ "no-auto-array", no_argument, NULL, OptionNoAutoArray },
+		{ "global-sync", no_argument, NULL, OptionGlobalSync },
+		{ "drain-timeout", required_argument, NULL, OptionDrainTimeout },
+		{ "no-writeback-preempt", no_argument, NULL, OptionNoWritebackPreempt },
+		{ "laptop-mode", optional_argument, NULL, OptionLaptopMode },
+		{ "writeback-threshold", required_argument, NULL, OptionWritebackThreshold },
+		{ "writeback-interval", required_argument, NULL, OptionWritebackInterval },
+		{ "hotset", required_argument, NULL, OptionHotset },
+		{ "hotset-learn", no_argument, NULL, OptionHotsetLearn },
+		{ "hotset-budget", required_argument, NULL, OptionHotsetBudget },
+		{ "hotset-fadvise", no_argument, NULL, OptionHotsetFadvise },
+		{ "residency", required_argument, NULL, OptionResidency },
+		{ "warm", required_argument, NULL, OptionWarm },
+		{ "vfs-cache-pressure", required_argument, NULL, OptionVfsCachePressure },
+		{ "prefetch", optional_argument, NULL, OptionPrefetch },
+		{ "prefetch-budget", required_argument, NULL, OptionPrefetchBudget },
+		{ "policy", required_argument, NULL, OptionPolicy },
+		{ "print-policy", no_argument, NULL, OptionPrintPolicy },
+		{ "predictive-timeout", no_argument, NULL, OptionPredictiveTimeout },
+		{ "cycle-budget", required_argument, NULL, OptionCycleBudget },
+		{ "cycle-rating", required_argument, NULL, OptionCycleRating },
+		{ "diurnal", no_argument, NULL, OptionDiurnal },
+		{ "absorb-writes", required_argument, NULL, OptionAbsorbWrites },
+		{ "absorb-budget", required_argument, NULL, OptionAbsorbBudget },
+		{ "standby", required_argument, NULL, OptionStandby },
+		{ "spindown-interval", required_argument, NULL, OptionSpindownInterval },
+		{ "spinup-budget", required_argument, NULL, OptionSpinupBudget },
+		{ "ata-backend", required_argument, NULL, OptionAtaBackend },
+		{ "power-poll", required_argument, NULL, OptionPowerPoll },
+		{ "smart", optional_argument, NULL, OptionSmart },
+		{ "profiles", required_argument, NULL, OptionProfiles },
+		{ "no-profile", no_argument, NULL, OptionNoProfile },
+		{ "touch", required_argument, NULL, OptionTouch },
+		{ "force-disk", no_argument, NULL, OptionForceDisk },
+		{ "match", required_argument, NULL, OptionMatch },
 		{ 0, 0, 0, 0 }
     };
 
 	struct wdAntiParkConfig config = {
 		"sda", // disk
 		"/tmp/wdantiparkd.tmp",
+		"/var/lib/wdantiparkd", // stateDir
+		"", // groups
+		"", // hotsetGlobs
+		"", // residencyDirs
+		"", // warmDirs
+		"", // policyFile
+		"/etc/wdantiparkd.profiles", // profilesFile
+		"", // matchPattern
 		0, // verbose
 		7, // interval
+		7, // pollInterval
 		60, // antiParkTimeout 
 		300, // antiParkTimeoutMax
 		300, // parkedTimeout
-		0 // syncBeforeIdle
+		0, // syncBeforeIdle
+		0, // globalSync
+		10, // drainTimeout
+		1, // preemptWriteback
+		0, // laptopMode
+		1024, // writebackThreshold
+		10, // writebackInterval
+		0, // hotsetLearn
+		64, // hotsetBudget
+		1, // hotsetMlock
+		0, // vfsCachePressure
+		0, // prefetchWindow
+		256, // prefetchBudget
+		0, // predictiveTimeout
+		0, // cycleBudget
+		300000, // cycleRating
+		0, // diurnal
+		0, // absorbWrites
+		4096, // absorbBudget
+		0, // standbyTimeout
+		1800, // spindownInterval
+		24, // spinupBudget
+		AtaSgIo, // ataBackend
+		0, // ataMockTimer
+		0, // powerPoll
+		0, // smartInterval
+		TouchWrite, // touchEngine
+		600, // calibrateMax
+		1, // stagger
+		1, // autoGroup
+		1, // useProfiles
+		0, // forceDisk
+		0, // intervalSet
+		0, // antiParkTimeoutSet
+		0, // antiParkTimeoutMaxSet
+		0, // parkedTimeoutSet
+		0, // touchEngineSet
+		0 // cycleRatingSet
 	};
 	
 	int optionIndex;
 	int c;
-	while((c = getopt_long(argc,argv,"hvd:i:a:A:p:P:t:zDu:g:l:y:",longOptions,&optionIndex)) != -1) {
+	while((c = getopt_long(argc,argv,"hvd:i:a:A:p:P:t:zDu:g:l:y:C",longOptions,&optionIndex)) != -1) {
 		switch(c) {
 			case 'v': 
 				config.verbose = 1; 
 				break;
 			case 'd':
+				if(diskCount >= MAX_DISKS) {
+					fprintf(stderr,"Too many disks specified by -d, --disk (%d max).\n",MAX_DISKS);
+					return -1;
+				}
+				separator = strchr(optarg,':');
+				if(separator) *separator++ = 0;
 				if(strlen(optarg) > 15) {
 					fprintf(stderr,"Filename of disk is too long (15 chars max).\n");
 					return -1;
 				}
-				strncpy(config.disk,optarg,16); 
-				config.disk[15] = 0; 
+				if(separator && strlen(separator) > 127) {
+					fprintf(stderr,"Filename of temp-file is too long.\n");
+					return -1;
+				}
+				strcpy(diskNames[diskCount],optarg);
+				strcpy(diskTempFiles[diskCount],separator ? separator : "");
+				
+				// the first disk is the one calibrated
+				if(!diskCount) strcpy(config.disk,optarg);
+				diskCount++;
 				break;
 			case 'i':
 				config.interval = strtol(optarg,NULL,10);
-				if(config.interval < 0 || config.interval > 3600) {
+				if(config.interval < 1 || config.interval > 3600) {
 					fprintf(stderr,"Invalid interval specified by -i, --interval.\n");
 					return -1;
 				}
+				config.intervalSet = 1;
+				break;
+			case 'P':
+				config.pollInterval = strtol(optarg,NULL,10);
+				if(config.pollInterval < 1 || config.pollInterval > 3600) {
+					fprintf(stderr,"Invalid interval specified by -P, --poll-interval.\n");
+					return -1;
+				}
+				break;
+			case 'C':
+				calibrate = 1;
+				config.verbose = 1;
+				break;
+			case OptionCalibrateMax:
+				config.calibrateMax = strtol(optarg,NULL,10);
+				if(config.calibrateMax < 2 || config.calibrateMax > 3600) {
+					fprintf(stderr,"Invalid timeout specified by --calibrate-max.\n");
+					return -1;
+				}
+				break;
+			case OptionStateDir:
+				if(strlen(optarg) > 127) {
+					fprintf(stderr,"Filename of --state-dir is too long.\n");
+					return -1;
+				}
+				strncpy(config.stateDir,optarg,128);
+				config.stateDir[127] = 0;
+				break;
+			case OptionNoStagger:
+				config.stagger = 0;
+				break;
+			case OptionArray:
+				if(strlen(config.groups) + strlen(optarg) + 1 > 255) {
+					fprintf(stderr,"Too many disks specified by --array.\n");
+					return -1;
+				}
+				if(config.groups[0]) strcat(config.groups," ");
+				strcat(config.groups,optarg);
+				break;
+			case OptionNoAutoArray:
+				config.autoGroup = 0;
+				break;
+			case OptionGlobalSync:
+				config.globalSync = 1;
+				break;
+			case OptionDrainTimeout:
+				config.drainTimeout = strtol(optarg,NULL,10);
+				if(config.drainTimeout < 0 || config.drainTimeout > 3600) {
+					fprintf(stderr,"Invalid timeout specified by --drain-timeout.\n");
+					return -1;
+				}
+				break;
+			case OptionNoWritebackPreempt:
+				config.preemptWriteback = 0;
+				break;
+			case OptionLaptopMode:
+				config.laptopMode = optarg ? strtol(optarg,NULL,10) : 600;
+				if(config.laptopMode < 1 || config.laptopMode > 86400) {
+					fprintf(stderr,"Invalid age specified by --laptop-mode.\n");
+					return -1;
+				}
+				break;
+			case OptionWritebackThreshold:
+				config.writebackThreshold = strtol(optarg,NULL,10);
+				if(config.writebackThreshold < 0) {
+					fprintf(stderr,"Invalid size specified by --writeback-threshold.\n");
+					return -1;
+				}
+				break;
+			case OptionWritebackInterval:
+				config.writebackInterval = strtol(optarg,NULL,10);
+				if(config.writebackInterval < 0 || config.writebackInterval > 3600) {
+					fprintf(stderr,"Invalid interval specified by --writeback-interval.\n");
+					return -1;
+				}
+				break;
+			case OptionHotset:
+				if(strlen(config.hotsetGlobs) + strlen(optarg) + 1 > 511) {
+					fprintf(stderr,"Too many patterns specified by --hotset.\n");
+					return -1;
+				}
+				if(config.hotsetGlobs[0]) strcat(config.hotsetGlobs,"\n");
+				strcat(config.hotsetGlobs,optarg);
+				break;
+			case OptionHotsetLearn:
+				config.hotsetLearn = 1;
+				break;
+			case OptionHotsetBudget:
+				config.hotsetBudget = strtol(optarg,NULL,10);
+				if(config.hotsetBudget < 1 || config.hotsetBudget > 65536) {
+					fprintf(stderr,"Invalid size specified by --hotset-budget.\n");
+					return -1;
+				}
+				break;
+			case OptionHotsetFadvise:
+				config.hotsetMlock = 0;
+				break;
+			case OptionResidency:
+				if(strlen(config.residencyDirs) + strlen(optarg) + 1 > 511) {
+					fprintf(stderr,"Too many directories specified by --residency.\n");
+					return -1;
+				}
+				if(config.residencyDirs[0]) strcat(config.residencyDirs,"\n");
+				strcat(config.residencyDirs,optarg);
+				break;
+			case OptionWarm:
+				if(strlen(config.warmDirs) + strlen(optarg) + 1 > 511) {
+					fprintf(stderr,"Too many directories specified by --warm.\n");
+					return -1;
+				}
+				if(config.warmDirs[0]) strcat(config.warmDirs,"\n");
+				strcat(config.warmDirs,optarg);
+				break;
+			case OptionVfsCachePressure:
+				config.vfsCachePressure = strtol(optarg,NULL,10);
+				if(config.vfsCachePressure < 1 || config.vfsCachePressure > 1000) {
+					fprintf(stderr,"Invalid value specified by --vfs-cache-pressure.\n");
+					return -1;
+				}
+				break;
+			case OptionPrefetch:
+				config.prefetchWindow = optarg ? strtol(optarg,NULL,10) : 30;
+				if(config.prefetchWindow < 1 || config.prefetchWindow > 3600) {
+					fprintf(stderr,"Invalid window specified by --prefetch.\n");
+					return -1;
+				}
+				break;
+			case OptionPrefetchBudget:
+				config.prefetchBudget = strtol(optarg,NULL,10);
+				if(config.prefetchBudget < 1 || config.prefetchBudget > 65536) {
+					fprintf(stderr,"Invalid size specified by --prefetch-budget.\n");
+					return -1;
+				}
+				break;
+			case OptionPolicy:
+				strncpy(config.policyFile,optarg,128);
+				config.policyFile[127] = 0;
+				break;
+			case OptionPrintPolicy:
+				printPolicy = 1;
+				break;
+			case OptionPredictiveTimeout:
+				config.predictiveTimeout = 1;
+				break;
+			case OptionCycleBudget:
+				config.cycleBudget = strtol(optarg,NULL,10);
+				if(config.cycleBudget < 1 || config.cycleBudget > 100000) {
+					fprintf(stderr,"Invalid number of cycles specified by --cycle-budget.\n");
+					return -1;
+				}
+				break;
+			case OptionCycleRating:
+				config.cycleRating = strtol(optarg,NULL,10);
+				if(config.cycleRating < 1) {
+					fprintf(stderr,"Invalid number of cycles specified by --cycle-rating.\n");
+					return -1;
+				}
+				config.cycleRatingSet = 1;
+				break;
+			case OptionDiurnal:
+				config.diurnal = 1;
+				break;
+			case OptionAbsorbWrites:
+				config.absorbWrites = strtol(optarg,NULL,10);
+				if(config.absorbWrites < 1 || config.absorbWrites > 1048576) {
+					fprintf(stderr,"Invalid size specified by --absorb-writes.\n");
+					return -1;
+				}
+				break;
+			case OptionAbsorbBudget:
+				config.absorbBudget = strtol(optarg,NULL,10);
+				if(config.absorbBudget < 1 || config.absorbBudget > 1048576) {
+					fprintf(stderr,"Invalid size specified by --absorb-budget.\n");
+					return -1;
+				}
+				break;
+			case OptionStandby:
+				config.standbyTimeout = strtol(optarg,NULL,10);
+				if(config.standbyTimeout < 1 || config.standbyTimeout > 86400) {
+					fprintf(stderr,"Invalid timeout specified by --standby.\n");
+					return -1;
+				}
+				break;
+			case OptionSpindownInterval:
+				config.spindownInterval = strtol(optarg,NULL,10);
+				if(config.spindownInterval < 0 || config.spindownInterval > 86400) {
+					fprintf(stderr,"Invalid interval specified by --spindown-interval.\n");
+					return -1;
+				}
+				break;
+			case OptionSpinupBudget:
+				config.spinupBudget = strtol(optarg,NULL,10);
+				if(config.spinupBudget < 1 || config.spinupBudget > MAX_SPINUP_BUDGET) {
+					fprintf(stderr,"Invalid count specified by --spinup-budget.\n");
+					return -1;
+				}
+				break;
+			case OptionAtaBackend:
+				if(!strcmp(optarg,"sgio")) {
+					config.ataBackend = AtaSgIo;
+				} else if(!strncmp(optarg,"mock",4) && (!optarg[4] || optarg[4] == ':')) {
+					config.ataBackend = AtaMock;
+					config.ataMockTimer = optarg[4] ? strtol(optarg + 5,NULL,10) : 0;
+					if(config.ataMockTimer < 0) config.ataMockTimer = 0;
+				} else {
+					fprintf(stderr,"Invalid backend specified by --ata-backend.\n");
+					return -1;
+				}
+				break;
+			case OptionPowerPoll:
+				config.powerPoll = strtol(optarg,NULL,10);
+				if(config.powerPoll < 1 || config.powerPoll > 3600) {
+					fprintf(stderr,"Invalid interval specified by --power-poll.\n");
+					return -1;
+				}
+				break;
+			case OptionSmart:
+				config.smartInterval = optarg ? strtol(optarg,NULL,10) : 600;
+				if(config.smartInterval < 1 || config.smartInterval > 86400) {
+					fprintf(stderr,"Invalid interval specified by --smart.\n");
+					return -1;
+				}
+				break;
+			case OptionProfiles:
+				if(strlen(optarg) > 127) {
+					fprintf(stderr,"Filename of profiles is too long.\n");
+					return -1;
+				}
+				strncpy(config.profilesFile,optarg,128);
+				config.profilesFile[127] = 0;
+				break;
+			case OptionNoProfile:
+				config.useProfiles = 0;
+				break;
+			case OptionTouch:
+				config.touchEngine = parseTouchEngine(optarg);
+				if(config.touchEngine < 0) {
+					fprintf(stderr,"Invalid engine specified by --touch.\n");
+					return -1;
+				}
+				config.touchEngineSet = 1;
+				break;
+			case OptionForceDisk:
+				config.forceDisk = 1;
+				break;
+			case OptionMatch:
+				if(!optarg[0] || strlen(optarg) > 127) {
+					fprintf(stderr,"Invalid pattern specified by --match.\n");
+					return -1;
+				}
+				strncpy(config.matchPattern,optarg,128);
+				config.matchPattern[127] = 0;
 				break;
 			case 'a':
 				config.antiParkTimeout = strtol(optarg,NULL,10);
-				if(config.antiParkTimeout < 0 || config.antiParkTimeout > 3600) {
-					fprintf(stderr,"Invalid timeout specified by -a, --antipark-timeout.\n");
+				if(config.antiParkTimeout < 1 || config.antiParkTimeout > 3600) {
+					fprintf(stderr,"Invalid timeout specified by -a, --antipark-timeout, 1 to 3600 seconds.\n");
 					return -1;
 				}
+				config.antiParkTimeoutSet = 1;
 				break;
 			case 'A':
 				config.antiParkTimeoutMax = strtol(optarg,NULL,10);
-				if(config.antiParkTimeoutMax < 0 || config.antiParkTimeoutMax > 3600) {
-					fprintf(stderr,"Invalid timeout specified by -A, --antipark-timeout-max.\n");
+				if(config.antiParkTimeoutMax < 1 || config.antiParkTimeoutMax > 3600) {
+					fprintf(stderr,"Invalid timeout specified by -A, --antipark-timeout-max, 1 to 3600 seconds.\n");
 					return -1;
 				}
+				config.antiParkTimeoutMaxSet = 1;
 				break;
 			case 'p':
 				config.parkedTimeout = strtol(optarg,NULL,10);
-				if(config.antiParkTimeoutMax < 0 || config.antiParkTimeoutMax > 3600) {
-					fprintf(stderr,"Invalid timeout specified by -p, --parked-timeout.\n");
+				if(config.parkedTimeout < 1 || config.parkedTimeout > 3600) {
+					fprintf(stderr,"Invalid timeout specified by -p, --parked-timeout, 1 to 3600 seconds.\n");
 					return -1;
 				}
+				config.parkedTimeoutSet = 1;
 				break;
 			case 't':
 				if(strlen(optarg) > 127) {
@@ -527,22 +1669,136 @@ int main(int argc,char *argv[])
 				printf("Options:\n");
 				printf(" -h, --help                     Display this help\n");
 				printf(" -v, --verbose                  Be verbose\n");
-				printf(" -d, --disk=DISK                Disk to monitor (default: %s)\n",config.disk);
-				printf(" -i, --interval=SEC             Interval between generated disk activity (default: %d)\n",config.interval);
+				printf(" -d, --disk=DISK[:FILE]         Disk to monitor, with its own temp file (may be repeated, default: %s)\n",config.disk);
+				printf("     --match=PATTERN            Also monitor disks whose serial or WWN matches, as they come and go (root only)\n");
+				printf(" -i, --interval=SEC             Interval between generated disk activity (default: calibrated or %d)\n",config.interval);
+				printf(" -P, --poll-interval=SEC        Interval between checks for disk activity, at most half the -i interval (default: %d)\n",config.pollInterval);
 				printf(" -a, --antipark-timeout=SEC     Timeout for antipark (default: %d)\n",config.antiParkTimeout);
 				printf(" -A, --antipark-timeout-max=SEC Timeout max for antipark (default: %d)\n",config.antiParkTimeoutMax);
 				printf(" -p, --park-timeout=SEC         Timeout for parked (default: %d)\n",config.parkedTimeout);
 				printf(" -t, --temp-file=FILE           File residing on disk to write to (default: %s)\n",config.tempFile);
 				printf(" -z, --sync-before-idle         Sync disks before switching to IDLE (default: %s)\n",config.syncBeforeIdle ? "true" : "false");
+				printf("     --global-sync              Sync all filesystems, not only the ones on the disk\n");
+				printf("     --drain-timeout=SEC        Longest wait for writeback before parking (default: %d)\n",config.drainTimeout);
+				printf("     --no-writeback-preempt     Let the kernel write back while parked\n");
+				printf("     --laptop-mode[=SEC]        Buffer writes up to SEC while parked (default: off, 600; root only)\n");
+				printf("     --writeback-threshold=KB   Flush along with disk activity once KB are dirty, 0 = never (default: %d)\n",config.writebackThreshold);
+				printf("     --writeback-interval=SEC   Minimum time between such flushes (default: %d)\n",config.writebackInterval);
+				printf("     --hotset=GLOB              Keep matching files in the page cache (may be repeated)\n");
+				printf("     --hotset-learn             Add files that wake the disk to the hot-set (root only)\n");
+				printf("     --hotset-budget=MB         Memory for the hot-set (default: %d)\n",config.hotsetBudget);
+				printf("     --hotset-fadvise           Refresh the hot-set with WILLNEED instead of mlock\n");
+				printf("     --residency=DIR            Report page cache residency of the tree (may be repeated)\n");
+				printf("     --warm=DIR                 Keep the tree's metadata cached (may be repeated)\n");
+				printf("     --vfs-cache-pressure=N     Set vm.vfs_cache_pressure while running, e.g. 50\n");
+				printf("     --prefetch[=SEC]           Read ahead what followed a wake before (root only, default: 30)\n");
+				printf("     --prefetch-budget=MB       Data read ahead per wake (default: %d)\n",config.prefetchBudget);
+				printf("     --policy=FILE              Run the state machine described in FILE\n");
+				printf("     --print-policy             Print the built-in policy for the given options and exit\n");
+				printf("     --predictive-timeout       Learn the ANTIPARK timeout from idle gaps, from -A/4 to -A\n");
+				printf("     --cycle-budget=N           Scale the timeouts to stay under N load cycles a day\n");
+				printf("     --cycle-rating=N           Load cycles the drive is rated for (default: %ld)\n",config.cycleRating);
+				printf("     --diurnal                  Learn busy and dead hours of the week and plan for them\n");
+				printf("     --absorb-writes=KB         Stay PARKED/IDLE on writes up to KB without reads\n");
+				printf("     --absorb-budget=KB         Total absorbed until the heads are loaded (default: %d)\n",config.absorbBudget);
+				printf("     --standby=SEC              Spin the disk down after SEC in IDLE (root only)\n");
+				printf("     --spindown-interval=SEC    Least time between spindowns (default: %d)\n",config.spindownInterval);
+				printf("     --spinup-budget=N          Most spin-ups a day (default: %d)\n",config.spinupBudget);
+				printf("     --ata-backend=NAME         sgio, or mock[:SEC] for a drive that sleeps after SEC idle (default: sgio)\n");
+				printf("     --power-poll=SEC           Poll the drive's power mode, no touches while it sleeps (root only)\n");
+				printf("     --smart[=SEC]              Read load cycles from SMART in ANTI-PARK (root only, default: 600)\n");
+				printf("     --touch=ENGINE             Touch the disk with a write to the temp file or a raw read (default: write)\n");
+				printf("     --profiles=FILE            Drive profiles tried before the built-in ones (default: %s)\n",config.profilesFile);
+				printf("     --no-profile               Do not apply a profile for the drive model\n");
+				printf("     --force-disk               Run on solid state or virtual disks too\n");
 				printf(" -D, --daemonize                Daemonize and run in the background\n");
 				printf(" -u, --user=USER                Drop privileges to user (root only)\n");
 				printf(" -g, --group=GROUP              Drop privileges to group (root only)\n");
 				printf(" -l, --log=LOGFILE              Log messages to file (default: no logging; implies -v)\n");
 				printf(" -y, --pid-file=PIDFILE         PID file when running as a daemon (default: /var/run/wdantiparkd.pid)\n");
+				printf(" -C, --calibrate                Learn the head unload timer of the disk and exit (root only)\n");
+				printf("     --calibrate-max=SEC        Longest unload timer probed by --calibrate (default: %d)\n",config.calibrateMax);
+				printf("     --state-dir=DIR            Directory for learned disk data (default: %s)\n",config.stateDir);
+				printf("     --no-stagger               Do not spread touches of disks on the same adapter\n");
+				printf("     --array=DISK,DISK...       Wake these disks together (may be repeated)\n");
+				printf("     --no-auto-array            Do not group disks by their md/dm arrays\n");
 				return -1;
 		}
 	}
 	
+	if(config.absorbWrites > config.absorbBudget) config.absorbBudget = config.absorbWrites;
+	
+	// calibration takes a while and stops between probes too
+	signal(SIGINT,signalHandler);
+	signal(SIGTERM,signalHandler);
+	
+	if(calibrate) {
+		return wdAntiParkCalibrate(&config);
+	}
+	
+	// the disks given, or the default one, and with --match the matching ones attached
+	if(!diskCount && !config.matchPattern[0]) {
+		strcpy(diskNames[0],config.disk);
+		diskTempFiles[0][0] = 0;
+		diskCount = 1;
+	}
+	if(config.matchPattern[0]) {
+		if(user || group) {
+			fprintf(stderr,"Disks are set up as they come, which needs root, -u and -g cannot be used with --match.\n");
+			return -1;
+		}
+		if(config.touchEngineSet && config.touchEngine == TouchWrite) {
+			fprintf(stderr,"Disks found by --match have no temp file of their own and are touched with reads, --touch=write cannot be used with --match.\n");
+			return -1;
+		}
+		firstMatched = diskCount;
+		found = findMatchingDisks(config.matchPattern,matched,MAX_DISKS);
+		for(i = 0; i < found && diskCount < MAX_DISKS; i++) {
+			for(j = 0; j < diskCount && strcmp(diskNames[j],matched[i]); j++);
+			if(j < diskCount) continue;
+			strcpy(diskNames[diskCount],matched[i]);
+			diskTempFiles[diskCount++][0] = 0;
+		}
+	}
+	
+	// policies are compiled before daemonizing, so errors are seen
+	for(i = 0; i < diskCount; i++) {
+		prepared[i] = prepareDisk(&config,diskNames[i],i >= firstMatched ? NULL : diskTempFiles[i]);
+		if(!prepared[i]) return -1;
+	}
+	if(!diskCount) {
+		struct policy policy;
+		if((config.policyFile[0] ? loadPolicy(config.policyFile,&policy) : builtinPolicy(&config,&policy)) < 0) return -1;
+	}
+	
+	// SG_IO needs CAP_SYS_RAWIO for every command, not just to open the disk
+	if((user || group) && config.ataBackend == AtaSgIo) {
+		for(i = 0; i < diskCount && !config.powerPoll && !config.smartInterval && !policyHasFlag(&prepared[i]->policy,StateStandby); i++);
+		if(i < diskCount) {
+			fprintf(stderr,"ATA commands through SG_IO need root, -u and -g cannot be used with --standby, --power-poll or --smart.\n");
+			return -1;
+		}
+	}
+	
+	// laptop mode is switched with every park and restored on exit, as root
+	if((user || group) && config.laptopMode) {
+		fprintf(stderr,"Laptop mode is switched while running, which needs root, -u and -g cannot be used with --laptop-mode.\n");
+		return -1;
+	}
+	
+	// restored on exit, as root
+	if((user || group) && config.vfsCachePressure && config.warmDirs[0]) {
+		fprintf(stderr,"vfs_cache_pressure is restored on exit, which needs root, -u and -g cannot be used with --vfs-cache-pressure.\n");
+		return -1;
+	}
+	
+	if(printPolicy) {
+		char text[2048];
+		formatBuiltinPolicy(diskCount ? &prepared[0]->config : &config,text,2048);
+		fputs(text,stdout);
+		return 0;
+	}
+	
 	if(daemonize) {
 		pid_t id;
 		int i;
@@ -593,8 +1849,6 @@ int main(int argc,char *argv[])
 		signal(SIGTTIN,SIG_IGN);
 		signal(SIGHUP,SIG_IGN); 
 	}
-	signal(SIGINT,signalHandler);
-	signal(SIGTERM,signalHandler);
 	
 	// redirect log
 	if(enableLog) {
@@ -612,6 +1866,23 @@ int main(int argc,char *argv[])
 		dup2(logFd,STDERR_FILENO);
 	}
 	
+	if(config.verbose) {
+		printf("[%s] Starting wdantiparkd.\n",formatCurrentTime(NULL,0));
+		fflush(stdout);
+	}
+	
+	// needs root, set up before dropping privileges
+	if(config.matchPattern[0]) {
+		if(hotplugOpen(&hotplug,config.matchPattern) < 0) return -1;
+		if(config.verbose) {
+			printf("[%s] Watching for disks matching %s.\n",formatCurrentTime(NULL,0),config.matchPattern);
+			fflush(stdout);
+		}
+	}
+	for(i = 0; i < diskCount; i++) {
+		if(addDisk(prepared[i]) < 0) return -1;
+	}
+	
 	if(group) {
 		if(setresgid(group,group,group) < 0) {
 			fprintf(stderr,"Failed to change group to gid %d, permission denied.\n",group);
@@ -626,5 +1897,10 @@ int main(int argc,char *argv[])
 		}
 	}
 
-	return wdAntiParkRun(&config);
+	result = wdAntiParkRun(&config,config.matchPattern[0] ? &hotplug : NULL);
+	
+	// in reverse, so settings taken over are restored in order
+	while(managedCount) removeDisk(managedCount - 1);
+	if(config.matchPattern[0]) hotplugClose(&hotplug);
+	return result;
 }
@@ -0,0 +1,99 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Shared declarations between the daemon's modules.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WDANTIPARKD_H
+#define WDANTIPARKD_H
+
+#include <time.h>
+
+#define MAX_DISKS 64 // managed by one process
+
+// global parameters
+struct wdAntiParkConfig
+{
+	char disk[16];
+	char tempFile[128];
+	char stateDir[128];
+	char groups[256];
+	char hotsetGlobs[512];
+	char residencyDirs[512];
+	char warmDirs[512];
+	char policyFile[128];
+	char profilesFile[128];
+	char matchPattern[128]; // serial or WWN of the disk to follow, empty for -d
+	int verbose;
+	int interval;
+	int pollInterval;
+	int antiParkTimeout;
+	int antiParkTimeoutMax;
+	int parkedTimeout;
+	int syncBeforeIdle;
+	int globalSync;
+	int drainTimeout;
+	int preemptWriteback;
+	int laptopMode; // max age of buffered writes, 0 to leave laptop mode alone
+	int writebackThreshold; // kB dirty before flushing along with organic I/O
+	int writebackInterval;
+	int hotsetLearn;
+	int hotsetBudget; // MB
+	int hotsetMlock;
+	int vfsCachePressure; // 0 to leave it alone
+	int prefetchWindow; // seconds learned after a wake, 0 to disable
+	int prefetchBudget; // MB
+	int predictiveTimeout;
+	int cycleBudget; // load cycles per day, 0 for no budget
+	long cycleRating;
+	int diurnal;
+	int absorbWrites; // kB, 0 to wake on any write
+	int absorbBudget; // kB
+	int standbyTimeout; // seconds in IDLE before spinning down, 0 to leave spindown alone
+	int spindownInterval; // least seconds between spindowns
+	int spinupBudget; // spin-ups a day
+	int ataBackend; // enum AtaBackend
+	int ataMockTimer; // seconds the mock drive idles before spinning down, 0 for never
+	int powerPoll; // seconds between CHECK POWER MODE polls, 0 for none
+	int smartInterval; // seconds between SMART readings while touching, 0 for none
+	int touchEngine; // enum TouchEngineType
+	int calibrateMax;
+	int stagger;
+	int autoGroup;
+	int useProfiles;
+	int forceDisk; // run on disks without heads to keep loaded
+
+	int intervalSet; // -i given explicitly, overrides learned values
+	int antiParkTimeoutSet; // the rest override the drive profile
+	int antiParkTimeoutMaxSet;
+	int parkedTimeoutSet;
+	int touchEngineSet;
+	int cycleRatingSet;
+};
+
+extern int terminateProgram;
+
+const char *formatSeconds(time_t secs,char *buffer,int max);
+const char *formatCurrentTime(char *buffer,int max);
+long long monotonicTimeMs(void);
+int readDiskSectors(const char *disk,unsigned long *readSectorCount,unsigned long *writeSectorCount);
+int readDiskActivity(const char *disk,unsigned long *readSectors,unsigned long *writeSectors);
+int checkForDiskActivity(const char *disk,int *haveReadAcitvity,int *haveWriteActivity);
+
+#endif
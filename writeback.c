@@ -0,0 +1,275 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Tracking of dirty pages and writeback for the monitored disk.
+
+	Dirty and writeback pages are counted per backing device from
+	/sys/kernel/debug/bdi when debugfs is available, summed over the disk
+	and the md/dm devices stacked on it. Otherwise the system wide counters
+	in /proc/meminfo are used.
+
+	The dirty monitor predicts when the kernel is about to write back on its
+	own, which would wake a parked disk at an arbitrary moment: either the
+	oldest dirty data reaches dirty_expire_centisecs, or the dirty set grows
+	past the background threshold. The daemon can then flush at a moment of
+	its choosing instead. That needs the per-bdi counters, without debugfs
+	the kernel is left to write back on its own.
+
+	The monitor also tells when it is worth flushing right after organic I/O
+	has loaded the heads anyway, as long as the disk is not busy streaming
+	writes of its own.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include "wdantiparkd.h"
+#include "diskinfo.h"
+#include "flush.h"
+#include "writeback.h"
+
+// samples without new writes before writeback counts as drained
+#define DRAIN_STABLE_SAMPLES 2
+
+// write rate above which the disk is considered to be streaming
+#define STREAMING_WRITE_KBS 8192
+
+/*
+ Reads "Key: value" pairs (kB) from a stats file, returns the number found
+ */
+static int readKbValues(const char *path,const char *dirtyKey,const char *writebackKey,long *dirtyKb,long *writebackKb)
+{
+	char line[256];
+	int found = 0;
+	FILE *fp = fopen(path,"r");
+
+	if(!fp) return -errno;
+	while(fgets(line,256,fp)) {
+		long value;
+		char *colon = strchr(line,':');
+		if(!colon) continue;
+		*colon = 0;
+		value = strtol(colon + 1,NULL,10);
+		if(!strcmp(line,dirtyKey)) { *dirtyKb += value; found++; }
+		else if(!strcmp(line,writebackKey)) { *writebackKb += value; found++; }
+	}
+	fclose(fp);
+	return found;
+}
+
+static int readBdiStats(const char *disk,struct writebackStats *stats)
+{
+	struct blockDevices devices;
+	char bdis[MAX_DEVICES][32];
+	int bdiCount = 0, i, j;
+
+	collectBlockDevices(disk,&devices);
+	for(i = 0; i < devices.count; i++) {
+		char link[256], target[256], *name;
+		int len;
+
+		// partitions share the bdi of their disk and have no link
+		snprintf(link,256,"/sys/class/block/%s/bdi",devices.name[i]);
+		link[255] = 0;
+		len = readlink(link,target,255);
+		if(len <= 0) continue;
+		target[len] = 0;
+		name = strrchr(target,'/');
+		name = name ? name + 1 : target;
+
+		for(j = 0; j < bdiCount; j++) {
+			if(!strcmp(bdis[j],name)) break;
+		}
+		if(j < bdiCount) continue;
+		if(strlen(name) >= sizeof(bdis[0])) return -ENOENT;
+		strcpy(bdis[bdiCount++],name);
+	}
+
+	stats->dirtyKb = stats->writebackKb = 0;
+	for(i = 0; i < bdiCount; i++) {
+		char path[64];
+		if(snprintf(path,64,"/sys/kernel/debug/bdi/%s/stats",bdis[i]) >= 64) return -ENOENT;
+		if(readKbValues(path,"BdiReclaimable","BdiWriteback",&stats->dirtyKb,&stats->writebackKb) != 2) return -ENOENT;
+	}
+	return bdiCount ? 0 : -ENOENT;
+}
+
+/*
+ Reads the dirty and writeback kB for the disk, per bdi if possible
+ */
+int readWritebackStats(const char *disk,struct writebackStats *stats)
+{
+	stats->perBdi = 1;
+	if(readBdiStats(disk,stats) == 0) return 0;
+
+	stats->perBdi = 0;
+	stats->dirtyKb = stats->writebackKb = 0;
+	if(readKbValues("/proc/meminfo","Dirty","Writeback",&stats->dirtyKb,&stats->writebackKb) != 2) return -ENOENT;
+	return 0;
+}
+
+static long readInflightWrites(const char *disk)
+{
+	char value[64];
+	long reads, writes;
+
+	if(readDiskAttribute(disk,"inflight",value,64) <= 0) return 0;
+	if(sscanf(value,"%ld %ld",&reads,&writes) != 2) return 0;
+	return writes;
+}
+
+/*
+ Starts waiting for the writeback of the disk to drain, for at most
+ timeout seconds. The drain is polled with pollWritebackDrain.
+ */
+void startWritebackDrain(struct writebackDrain *drain,int timeout)
+{
+	drain->deadline = monotonicTimeMs() + timeout * 1000LL;
+	drain->lastWriteSectorCount = 0;
+	drain->stable = -1;
+}
+
+/*
+ Takes one sample of a pending drain. The writeback has drained when
+ nothing is under writeback or in flight, nothing dirty is left for the
+ disk (when counted per bdi), and the disk's written sector count has
+ settled over DRAIN_STABLE_SAMPLES polls.
+ Returns 1 once drained, 0 while still pending, or -ETIMEDOUT. The drain
+ is no longer pending after 1 or -ETIMEDOUT.
+ */
+int pollWritebackDrain(const char *disk,struct writebackDrain *drain)
+{
+	struct writebackStats stats;
+	unsigned long readSectorCount, writeSectorCount;
+	int drained = 1;
+
+	if(readWritebackStats(disk,&stats) == 0) {
+		if(stats.writebackKb > 0 || (stats.perBdi && stats.dirtyKb > 0)) drained = 0;
+	}
+	if(readInflightWrites(disk) > 0) drained = 0;
+
+	if(readDiskSectors(disk,&readSectorCount,&writeSectorCount) == 0) {
+		drain->stable = (drain->stable >= 0 && writeSectorCount == drain->lastWriteSectorCount) ? drain->stable + 1 : 0;
+		drain->lastWriteSectorCount = writeSectorCount;
+		if(drain->stable < DRAIN_STABLE_SAMPLES) drained = 0;
+	}
+
+	if(drained) {
+		drain->deadline = 0;
+		return 1;
+	}
+	if(monotonicTimeMs() >= drain->deadline) {
+		drain->deadline = 0;
+		return -ETIMEDOUT;
+	}
+	return 0;
+}
+
+static long readSysctl(const char *name)
+{
+	char path[128], value[32];
+	long result = -1;
+	FILE *fp;
+
+	snprintf(path,128,"/proc/sys/vm/%s",name);
+	path[127] = 0;
+	fp = fopen(path,"r");
+	if(!fp) return -1;
+	if(fgets(value,32,fp)) result = strtol(value,NULL,10);
+	fclose(fp);
+	return result;
+}
+
+/*
+ The background threshold as the kernel computes it: dirty_background_bytes,
+ or dirty_background_ratio percent of free and file backed memory.
+ */
+static long readBackgroundThresholdKb(void)
+{
+	long bytes = readSysctl("dirty_background_bytes");
+	long ratio, freeKb = 0, fileKb = 0;
+
+	if(bytes > 0) return bytes / 1024;
+	ratio = readSysctl("dirty_background_ratio");
+	if(ratio <= 0) return 0;
+	if(readKbValues("/proc/meminfo","Active(file)","Inactive(file)",&fileKb,&fileKb) != 2) return 0;
+	if(readKbValues("/proc/meminfo","MemFree","MemFree",&freeKb,&freeKb) != 1) return 0;
+	return (freeKb + fileKb) * ratio / 100;
+}
+
+/*
+ Samples the disk's dirty set and the writeback tunables, called every tick
+ */
+void updateDirtyMonitor(const char *disk,struct dirtyMonitor *monitor)
+{
+	long expire = readSysctl("dirty_expire_centisecs");
+	long writeback = readSysctl("dirty_writeback_centisecs");
+
+	// without periodic writeback, dirty data never expires
+	monitor->expireMs = (expire > 0 && writeback > 0) ? expire * 10 : 0;
+	monitor->backgroundKb = readBackgroundThresholdKb();
+
+	if(readWritebackStats(disk,&monitor->stats) < 0) {
+		monitor->stats.dirtyKb = 0;
+		monitor->stats.perBdi = 0;
+	}
+
+	unsigned long readSectorCount, writeSectorCount;
+	long long now = monotonicTimeMs();
+
+	if(monitor->stats.dirtyKb <= 0) monitor->dirtySince = 0;
+	else if(!monitor->dirtySince) monitor->dirtySince = now;
+
+	if(readDiskSectors(disk,&readSectorCount,&writeSectorCount) == 0) {
+		if(monitor->lastUpdate && now > monitor->lastUpdate)
+			monitor->writeRateKbs = (long)((writeSectorCount - monitor->lastWriteSectorCount) / 2 * 1000 / (now - monitor->lastUpdate));
+		monitor->lastWriteSectorCount = writeSectorCount;
+		monitor->lastUpdate = now;
+	}
+}
+
+/*
+ Will the kernel start writing back within marginMs? Only known with the
+ per-bdi counters, the system wide ones include data that belongs to other
+ disks and would have the disk flushed on every tick.
+ */
+int isKernelWritebackImminent(struct dirtyMonitor *monitor,long marginMs)
+{
+	if(!monitor->stats.perBdi || monitor->stats.dirtyKb <= 0) return 0;
+
+	if(monitor->backgroundKb > 0 && monitor->stats.dirtyKb * 10 >= monitor->backgroundKb * 9) return 1;
+
+	if(monitor->expireMs && monitor->dirtySince &&
+	   monotonicTimeMs() - monitor->dirtySince >= monitor->expireMs - marginMs) return 1;
+
+	return 0;
+}
+
+/*
+ Is it worth flushing the disk now that organic I/O has loaded the heads?
+ Only when enough is dirty, and not while the disk streams writes: the
+ kernel is writing back already and a flush would only stall the stream.
+ */
+int isOpportunisticWritebackDue(struct dirtyMonitor *monitor,long thresholdKb)
+{
+	if(monitor->stats.dirtyKb < thresholdKb) return 0;
+	return monitor->writeRateKbs < STREAMING_WRITE_KBS;
+}
@@ -0,0 +1,61 @@
+/*
+	wdantiparkd - A anti-intellipark daemon
+	(C) 2010 Sound <sound ~at~ sagaforce -dot- com>
+
+	Tracking of dirty pages and writeback for the monitored disk.
+*/
+
+/*
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WRITEBACK_H
+#define WRITEBACK_H
+
+struct writebackStats
+{
+	long dirtyKb;
+	long writebackKb;
+	int perBdi; // counted for the disk's backing devices, not system wide
+};
+
+// poll period while waiting for writeback to drain
+#define DRAIN_POLL_MS 100
+
+struct writebackDrain
+{
+	long long deadline; // when to give up, 0 while no drain is pending
+	unsigned long lastWriteSectorCount;
+	int stable; // polls without new writes
+};
+
+struct dirtyMonitor
+{
+	struct writebackStats stats;
+	long long dirtySince; // when the dirty set became non-empty, 0 while clean
+	long expireMs; // age at which the kernel writes dirty data back, 0 if never
+	long backgroundKb; // dirty size at which background writeback starts
+	long writeRateKbs; // disk write rate since the previous update
+	unsigned long lastWriteSectorCount;
+	long long lastUpdate;
+};
+
+int readWritebackStats(const char *disk,struct writebackStats *stats);
+void startWritebackDrain(struct writebackDrain *drain,int timeout);
+int pollWritebackDrain(const char *disk,struct writebackDrain *drain);
+void updateDirtyMonitor(const char *disk,struct dirtyMonitor *monitor);
+int isKernelWritebackImminent(struct dirtyMonitor *monitor,long marginMs);
+int isOpportunisticWritebackDue(struct dirtyMonitor *monitor,long thresholdKb);
+
+#endif